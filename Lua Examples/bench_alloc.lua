@@ -0,0 +1,79 @@
+-- bench_alloc.lua
+--
+-- Measures allocation speed and heap fragmentation.
+--
+-- Each round churns through a mix of small tables, strings, and closures (the sizes
+-- Lua allocates most), keeping a random subset alive between rounds the way a long
+-- running script does. After each round it reports the time taken and how large a
+-- single array it can still allocate, which falls as the heap fragments.
+--
+-- Load it as an anonymous chunk with `*`, and compare the results between firmware built
+-- with and without POOL_ALLOCATOR_ENABLED (lua_support.cpp). (tests/alloc_bench.cpp runs the
+-- same workload on a host.)
+--
+
+print( "Loading the allocation benchmark" )
+
+ard = require "arduino"
+plat = require "luaplatform"
+
+
+local ROUNDS = 10
+local ALLOCS = 10000
+local KEEP = 500
+
+
+-- Largest array (in 1K element steps) that can be allocated right now.
+local function largestArray()
+    local n = 0
+    while true do
+        local ok = pcall( function()
+            local t = {}
+            for i = 1, (n + 1) * 1024 do
+                t[i] = i
+            end
+        end )
+
+        if not ok or n >= 64 then
+            return n
+        end
+
+        n = n + 1
+        collectgarbage()
+    end
+end
+
+
+local keep = {}
+
+for round = 1, ROUNDS do
+    local start = ard.micros()
+
+    for i = 1, ALLOCS do
+        local kind = i % 3
+        local obj
+
+        if kind == 0 then
+            obj = { i, i + 1 }
+        elseif kind == 1 then
+            obj = "s" .. i
+        else
+            obj = function() return i end
+        end
+
+        if math.random( ALLOCS // KEEP ) == 1 then
+            keep[math.random( KEEP )] = obj
+        end
+    end
+
+    local elapsed = ard.micros() - start
+
+    collectgarbage()
+
+    print( string.format( "round %d: %.2f us per alloc, heap %d KB, largest array %dK",
+        round, elapsed / ALLOCS, collectgarbage( "count" ), largestArray() ) )
+end
+
+local pool = plat.poolStats()
+print( string.format( "pool arena %d/%d bytes, %d large blocks, %d fallbacks",
+    pool.arenaUsed, pool.arena, pool.largeBlocks, pool.fallbacks ) )
@@ -0,0 +1,153 @@
+-- bench_control.lua
+--
+-- Benchmarks of the sort of arithmetic done by control loop scripts.
+--
+-- Run it on firmware built with the default Lua number types (64-bit integers and double
+-- floats) and again with LUA_32BITS set in luaconf.h (32-bit integers and single floats),
+-- and compare. Floats are done in software on the RP2040, and doubles are much slower.
+--
+-- Each test reports microseconds per iteration, and the number of allocations it made.
+-- Load it as an anonymous chunk with `*`.
+--
+
+print( "Loading the control loop benchmark" )
+
+ard = require "arduino"
+plat = require "luaplatform"
+
+
+local ITERATIONS = 2000
+
+
+-- PID controller update
+local function pid()
+    local kp, ki, kd = 1.2, 0.05, 0.3
+    local integral, lastError = 0.0, 0.0
+    local setpoint, measured = 90.0, 0.0
+    local out
+
+    return function()
+        local err = setpoint - measured
+        integral = integral + err * 0.01
+        local derivative = (err - lastError) / 0.01
+        lastError = err
+        out = kp * err + ki * integral + kd * derivative
+        measured = measured + out * 0.001
+    end
+end
+
+
+-- Differential drive odometry
+local function odometry()
+    local x, y, heading = 0.0, 0.0, 0.0
+    local wheelDia, axleTrack = 62.4, 178.0
+    local lastLeft, lastRight = 0.0, 0.0
+    local left, right = 0.0, 0.0
+
+    return function()
+        left = left + 3.7
+        right = right + 4.1
+        local dl = (left - lastLeft) * math.pi * wheelDia / 360
+        local dr = (right - lastRight) * math.pi * wheelDia / 360
+        lastLeft, lastRight = left, right
+
+        local d = (dl + dr) / 2
+        heading = heading + (dr - dl) / axleTrack
+        x = x + d * math.cos( heading )
+        y = y + d * math.sin( heading )
+    end
+end
+
+
+-- Exponential moving average and clamping of a sensor reading
+local function filter()
+    local avg = 0.0
+    local alpha = 0.2
+    local reading = 0
+
+    return function()
+        reading = (reading + 37) % 1024
+        avg = avg + alpha * (reading - avg)
+        local pct = math.max( 0, math.min( 100, avg * 100 / 1023 ) )
+        return pct
+    end
+end
+
+
+-- Integer timing and counting, as done around the millis() and micros() calls
+local function timing()
+    local last = 0
+    local now = 0
+    local count = 0
+
+    return function()
+        now = now + 1234
+        if now - last >= 10000 then
+            last = now
+            count = count + 1
+        end
+        count = count & 0xFFFF
+    end
+end
+
+
+-- Moving average over a ring of samples
+local function ring()
+    local samples = {}
+    for i = 1, 16 do
+        samples[i] = 0.0
+    end
+    local index = 1
+    local sum = 0.0
+    local value = 0.0
+
+    return function()
+        value = value + 0.5
+        sum = sum - samples[index] + value
+        samples[index] = value
+        index = index % 16 + 1
+        return sum / 16
+    end
+end
+
+
+local tests = {
+    { "pid", pid },
+    { "odometry", odometry },
+    { "filter", filter },
+    { "timing", timing },
+    { "ring", ring },
+}
+
+
+local function allocCount()
+    local n = 0
+    for _, count in pairs( plat.memStats().allocs ) do
+        n = n + count
+    end
+    return n
+end
+
+
+print( string.format( "lua_Integer %d bytes, lua_Number %d bytes",
+    string.packsize( "j" ), string.packsize( "n" ) ) )
+
+for _, test in ipairs( tests ) do
+    local step = test[2]()
+
+    collectgarbage()
+    local before = allocCount()
+
+    local start = ard.micros()
+    for i = 1, ITERATIONS do
+        step()
+    end
+    local elapsed = ard.micros() - start
+
+    local allocs = allocCount() - before
+
+    print( string.format( "%-10s %8.2f us/iter  %6d allocs", test[1], elapsed / ITERATIONS, allocs ) )
+end
+
+collectgarbage()
+print( string.format( "heap in use %d KB", collectgarbage( "count" ) ) )
@@ -0,0 +1,39 @@
+-- bench_loop.lua
+--
+-- Measures the per-pass overhead of the Lua EVN run loop.
+--
+-- Both loop functions are empty apart from counting, so the time per pass is almost
+-- entirely the cost of the platform calling into Lua (plus the shell poll).
+--
+-- Load it as an anonymous chunk with `*`, let it run, and compare the reported
+-- microseconds per pass between firmware builds.
+--
+
+print( "Loading the loop benchmark" )
+
+ard = require "arduino"
+
+
+local REPORT_MS = 5000
+
+passes = 0
+start = ard.micros()
+report = ard.millis() + REPORT_MS
+
+
+function exec_loop()
+    passes = passes + 1
+end
+
+
+function housekeeping_loop()
+    if ard.millis() >= report then
+        local elapsed = ard.micros() - start
+
+        print( string.format( "%d passes, %.2f us per pass", passes, elapsed / passes ) )
+
+        passes = 0
+        start = ard.micros()
+        report = ard.millis() + REPORT_MS
+    end
+end
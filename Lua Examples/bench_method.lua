@@ -0,0 +1,60 @@
+-- bench_method.lua
+--
+-- Measures the overhead of calling a method on an EVN object.
+--
+-- An empty loop and a call to an empty Lua function are timed as a baseline, then calls to
+-- m:getPosition(), which does little besides check its argument and push the result.
+-- Compare the results on firmware before and after a change to the bindings.
+-- The last test looks the method up once, outside the loop, which shows how much of the
+-- cost of m:getPosition() is the method lookup.
+-- (The motor doesn't need to be connected, or begin() called.)
+--
+-- Load it as an anonymous chunk with `*`.
+--
+
+print( "Loading the method call benchmark" )
+
+ard = require "arduino"
+evn = require "evn"
+
+
+local CALLS = 10000
+
+local m = evn.Motor.new( 1 )
+
+
+local function time( name, f )
+    collectgarbage()
+    local start = ard.micros()
+    f()
+    local elapsed = ard.micros() - start
+    print( string.format( "%-20s %7.2f us per call", name, elapsed / CALLS ) )
+end
+
+
+local function empty() end
+
+
+time( "empty loop", function()
+    for i = 1, CALLS do
+    end
+end )
+
+time( "Lua function", function()
+    for i = 1, CALLS do
+        empty()
+    end
+end )
+
+time( "m:getPosition()", function()
+    for i = 1, CALLS do
+        m:getPosition()
+    end
+end )
+
+time( "m.getPosition( m )", function()
+    local getPosition = m.getPosition
+    for i = 1, CALLS do
+        getPosition( m )
+    end
+end )
@@ -0,0 +1,64 @@
+-- bench_require.lua
+--
+-- Measures the heap used and the time taken by loading each of the built in libraries,
+-- and by the first use of each evn class (which is when the class gets set up).
+--
+-- Each library is removed from package.loaded first, so it is loaded fresh even if the
+-- main script already required it. Load it as an anonymous chunk with `*`.
+--
+
+print( "Loading the require benchmark" )
+
+-- Needed for the timing, so it is loaded (and measured) without it.
+local ard
+
+
+local function measure( name )
+    package.loaded[name] = nil
+    collectgarbage()
+    collectgarbage()
+
+    local before = collectgarbage( "count" )
+    local start = ard and ard.micros()
+
+    local lib = require( name )
+
+    local elapsed = ard and (ard.micros() - start)
+
+    collectgarbage()
+    collectgarbage()
+    local bytes = (collectgarbage( "count" ) - before) * 1024
+
+    if elapsed then
+        print( string.format( "%-12s %6d bytes  %6d us", name, bytes, elapsed ) )
+    else
+        print( string.format( "%-12s %6d bytes", name, bytes ) )
+    end
+
+    return lib
+end
+
+
+ard = measure( "arduino" )
+measure( "luaplatform" )
+local evn = measure( "evn" )
+
+-- (Not found with pairs(), as that would set up every class.)
+local classes = {
+    "Motor", "Servo", "ContinuousServo", "Drivebase",
+    "DistanceSensor", "ColourSensor", "CompassSensor", "IMUSensor",
+    "Display", "MatrixLED", "RGBLED", "SevenSegmentLED",
+}
+
+-- A class that was already used by the main script will show as free here.
+for _, name in ipairs( classes ) do
+    collectgarbage()
+    local before = collectgarbage( "count" )
+    local start = ard.micros()
+
+    local class = evn[name]
+
+    local elapsed = ard.micros() - start
+    collectgarbage()
+    print( string.format( "evn.%-16s %6d bytes  %6d us", name, (collectgarbage( "count" ) - before) * 1024, elapsed ) )
+end
@@ -47,6 +47,10 @@
 EVNAlpha board( BUTTON_PUSHBUTTON, false );
 
 
+// Give core 1 its own stack, as it may be running a Lua state of its own.
+bool core1_separate_stack = true;
+
+
 volatile bool setup0done = false;
 volatile bool setup1done = false;
 
@@ -110,3 +114,10 @@ void loop()
         runLua();
     }
 }
+
+
+void loop1()
+{
+    // Only does anything if core 1 has its own Lua state.
+    runLua1();
+}
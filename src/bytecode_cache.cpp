@@ -0,0 +1,299 @@
+// bytecode_cache.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#if defined (ARDUINO_ARCH_RP2040)
+#include <SDFS.h>
+#else
+#include <SD.h>
+#endif
+
+#include "lua.hpp"
+
+#include "lua_support.h"
+#include "bytecode_cache.h"
+#include "file_reader.h"
+
+
+
+#define CACHE_MAGIC     "LEVC"
+#define CACHE_VERSION   2
+
+// Files written without a clock get a time in 1980 or on 1 Jan 2000, depending on the
+// filesystem library. Times up to this (1 Jan 2001) can't be trusted to change on an edit.
+#define RELIABLE_TIME   978307200UL
+
+
+struct CacheHeader {
+    char magic[4];
+    uint8_t version;
+    uint8_t stripped;
+    uint8_t reserved[2];
+    SourceInfo source;
+};
+
+
+static bool cacheEnabled = true;
+static bool stripDebug = false;
+
+
+static bool hashSource( const char *name, uint32_t *hash );
+static File openRead( const char *fname );
+static File openWrite( const char *fname );
+static void removeFile( const char *fname );
+static int writeChunk( lua_State *L, const void *p, size_t size, void *ud );
+
+
+
+bool sourceInfo( const char *fname, SourceInfo *info )
+{
+    lockFilesystem();
+
+    File file = openRead( fname );
+    if( ! file )
+    {
+        unlockFilesystem();
+        return false;
+    }
+
+    info->size = file.size();
+#if defined (ARDUINO_ARCH_RP2040)
+    info->time = file.getLastWrite();
+#else
+    info->time = 0;
+#endif
+    info->hash = 0;
+
+    file.close();
+    unlockFilesystem();
+
+    return true;
+}
+
+
+int loadBytecode( lua_State *L, const char *name, const SourceInfo *info )
+{
+    char fname[64];
+    snprintf( fname, sizeof(fname), "/%s.luac", name );
+
+    lockFilesystem();
+
+    File file = openRead( fname );
+    if( ! file )
+    {
+        unlockFilesystem();
+        return -1;
+    }
+
+    CacheHeader hdr;
+    if( file.read( (uint8_t*)&hdr, sizeof(hdr) ) != sizeof(hdr)
+        || memcmp( hdr.magic, CACHE_MAGIC, sizeof(hdr.magic) ) != 0
+        || hdr.version != CACHE_VERSION
+        || hdr.stripped != stripDebug
+        || hdr.source.size != info->size
+        || hdr.source.time != info->time )
+    {
+        // Stale
+        file.close();
+        unlockFilesystem();
+        return -1;
+    }
+
+    // The size and time match. If the time can't be trusted, the contents must match too.
+    uint32_t hash;
+    if( info->time <= RELIABLE_TIME && (! hashSource( name, &hash ) || hash != hdr.source.hash) )
+    {
+        file.close();
+        unlockFilesystem();
+        return -1;
+    }
+
+    unlockFilesystem();
+
+    // Binary chunks only. (Lua checks the bytecode is for this build of Lua.)
+    int ret = loadFileChunk( L, file, name, "b" );
+
+    lockFilesystem();
+    file.close();
+    unlockFilesystem();
+
+    if( ret != LUA_OK )
+    {
+        lua_pop( L, 1 );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void saveBytecode( lua_State *L, const char *name, const SourceInfo *info )
+{
+    char fname[64];
+    snprintf( fname, sizeof(fname), "/%s.luac", name );
+
+    CacheHeader hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, CACHE_MAGIC, sizeof(hdr.magic) );
+    hdr.version = CACHE_VERSION;
+    hdr.stripped = stripDebug;
+    hdr.source = *info;
+
+    if( info->time <= RELIABLE_TIME && ! hashSource( name, &hdr.source.hash ) )
+    {
+        return;
+    }
+
+    lockFilesystem();
+
+    File file = openWrite( fname );
+    if( file )
+    {
+        bool ok = file.write( (const uint8_t*)&hdr, sizeof(hdr) ) == sizeof(hdr);
+        if( ok )
+        {
+            ok = lua_dump( L, writeChunk, &file, stripDebug ) == 0;
+        }
+
+        file.close();
+
+        if( ! ok )
+        {
+            // Don't leave a partial cache file behind.
+            removeFile( fname );
+        }
+    }
+
+    unlockFilesystem();
+}
+
+
+void removeBytecode( const char *name )
+{
+    char fname[64];
+    snprintf( fname, sizeof(fname), "/%s.luac", name );
+
+    lockFilesystem();
+    removeFile( fname );
+    unlockFilesystem();
+}
+
+
+void setBytecodeCache( bool enabled, bool strip )
+{
+    cacheEnabled = enabled;
+    stripDebug = strip;
+}
+
+
+bool bytecodeCacheEnabled()
+{
+    return cacheEnabled;
+}
+
+
+bool bytecodeStripped()
+{
+    return stripDebug;
+}
+
+
+//==================================================================================
+
+/**
+ * 32-bit FNV-1a hash of the source of the named script.
+ */
+static bool hashSource( const char *name, uint32_t *hash )
+{
+    char fname[64];
+    snprintf( fname, sizeof(fname), "/%s.lua", name );
+
+    lockFilesystem();
+
+    File file = openRead( fname );
+    if( ! file )
+    {
+        unlockFilesystem();
+        return false;
+    }
+
+    uint32_t h = 2166136261UL;
+    uint8_t buf[128];
+    size_t len;
+
+    while( (len = file.read( buf, sizeof(buf) )) > 0 )
+    {
+        for( size_t i = 0; i < len; i++ )
+        {
+            h = (h ^ buf[i]) * 16777619UL;
+        }
+    }
+
+    file.close();
+    unlockFilesystem();
+
+    *hash = h;
+    return true;
+}
+
+
+static File openRead( const char *fname )
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    return SDFS.open( fname, "r" );
+#else
+    return SD.open( fname );
+#endif
+}
+
+
+static File openWrite( const char *fname )
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    return SDFS.open( fname, "w" );
+#else
+    SD.remove( fname );
+    return SD.open( fname, FILE_WRITE );
+#endif
+}
+
+
+static void removeFile( const char *fname )
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    if( SDFS.exists( fname ) )
+    {
+        SDFS.remove( fname );
+    }
+#else
+    if( SD.exists( fname ) )
+    {
+        SD.remove( fname );
+    }
+#endif
+}
+
+
+// lua_Writer for lua_dump()
+static int writeChunk( lua_State *L, const void *p, size_t size, void *ud )
+{
+    (void)L;
+
+    File *file = (File*)ud;
+    return (file->write( (const uint8_t*)p, size ) == size) ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+// bytecode_cache.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Cache of compiled scripts.
+//
+// Compiling a script takes far longer than reading it, so once '/<name>.lua' has been compiled
+// the bytecode is saved as '/<name>.luac'. The cache file starts with the size and modification
+// time of the source it was compiled from, and is only used while those still match the source.
+// Checking them doesn't need the source to be read. Files written without a clock all get
+// the same old time though, so for those the hash of the source is saved and checked as well.
+//
+
+#ifndef BYTECODE_CACHE_H
+#define BYTECODE_CACHE_H  1
+
+#include <stdint.h>
+
+
+struct lua_State;
+
+
+struct SourceInfo {
+    uint32_t size;
+    uint32_t time;
+    uint32_t hash;
+};
+
+
+// Get the size and time of the source file. Returns false if it can't be opened.
+bool sourceInfo( const char *fname, SourceInfo *info );
+
+// Push the cached function for the named script if the cache matches the source info.
+// Returns zero if it did, otherwise nothing is pushed.
+int loadBytecode( lua_State *L, const char *name, const SourceInfo *info );
+
+// Save the function on the top of the stack as the cache for the named script.
+void saveBytecode( lua_State *L, const char *name, const SourceInfo *info );
+
+// Remove the cache for the named script, if there is one.
+void removeBytecode( const char *name );
+
+void setBytecodeCache( bool enabled, bool strip );
+bool bytecodeCacheEnabled();
+bool bytecodeStripped();
+
+#endif
@@ -0,0 +1,450 @@
+// channel.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (ARDUINO_ARCH_RP2040)
+#include <pico/mutex.h>
+#else
+#include <mutex>
+#endif
+
+#include "lua.hpp"
+
+#include "channel.h"
+
+
+
+// The channel list is only locked when opening a channel, never when using one.
+#if defined (ARDUINO_ARCH_RP2040)
+auto_init_mutex( channelListMutex );
+#define LOCK_CHANNEL_LIST()     mutex_enter_blocking( &channelListMutex )
+#define UNLOCK_CHANNEL_LIST()   mutex_exit( &channelListMutex )
+#else
+static std::mutex channelListMutex;
+#define LOCK_CHANNEL_LIST()     channelListMutex.lock()
+#define UNLOCK_CHANNEL_LIST()   channelListMutex.unlock()
+#endif
+
+static Channel channels[CHANNEL_MAX_CHANNELS];
+static int numChannels = 0;
+
+
+//
+// Encoded value tags
+//
+enum {
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_INTEGER,        // Zig-zag varint
+    TAG_FLOAT,          // Raw lua_Number
+    TAG_STRING,         // Varint length, then the bytes
+    TAG_TABLE           // 16-bit pair count, then key/value pairs
+};
+
+
+struct Encoder {
+    uint8_t *p;
+    uint8_t *end;
+};
+
+struct Decoder {
+    const uint8_t *p;
+};
+
+
+static const char *encodeValue( lua_State *L, int idx, Encoder *enc, bool allowTable );
+static void decodeValue( lua_State *L, Decoder *dec );
+static bool claimSide( std::atomic<int> &side, int core );
+
+
+
+//==================================================================================
+// Ring
+//==================================================================================
+
+bool Channel::init( const char *name, uint32_t capacity )
+{
+    uint32_t size = 1;
+    while( size < capacity )
+    {
+        size <<= 1;
+    }
+
+    _slots = (ChannelSlot*)malloc( size * sizeof(ChannelSlot) );
+    if( _slots == NULL )
+    {
+        return false;
+    }
+
+    strncpy( _name, name, sizeof(_name) - 1 );
+    _name[sizeof(_name) - 1] = '\0';
+
+    _mask = size - 1;
+    _head.store( 0, std::memory_order_relaxed );
+    _tail.store( 0, std::memory_order_relaxed );
+
+    _producer.store( -1, std::memory_order_relaxed );
+    _consumer.store( -1, std::memory_order_relaxed );
+
+    return true;
+}
+
+
+bool Channel::claimProducer( int core )
+{
+    return claimSide( _producer, core );
+}
+
+
+bool Channel::claimConsumer( int core )
+{
+    return claimSide( _consumer, core );
+}
+
+
+uint32_t Channel::count() const
+{
+    return _head.load( std::memory_order_acquire ) - _tail.load( std::memory_order_acquire );
+}
+
+
+ChannelSlot *Channel::reserve()
+{
+    const uint32_t head = _head.load( std::memory_order_relaxed );
+    const uint32_t tail = _tail.load( std::memory_order_acquire );
+
+    if( head - tail > _mask )
+    {
+        // Full
+        return NULL;
+    }
+
+    return &_slots[head & _mask];
+}
+
+
+void Channel::commit()
+{
+    // The release makes the slot contents visible before the new head.
+    const uint32_t head = _head.load( std::memory_order_relaxed );
+    _head.store( head + 1, std::memory_order_release );
+}
+
+
+const ChannelSlot *Channel::front() const
+{
+    const uint32_t tail = _tail.load( std::memory_order_relaxed );
+    const uint32_t head = _head.load( std::memory_order_acquire );
+
+    if( head == tail )
+    {
+        return NULL;
+    }
+
+    return &_slots[tail & _mask];
+}
+
+
+const ChannelSlot *Channel::back() const
+{
+    const uint32_t tail = _tail.load( std::memory_order_relaxed );
+    const uint32_t head = _head.load( std::memory_order_acquire );
+
+    if( head == tail )
+    {
+        return NULL;
+    }
+
+    // The producer won't touch this slot until the consumer has released it.
+    return &_slots[(head - 1) & _mask];
+}
+
+
+void Channel::release()
+{
+    // The release keeps the producer from reusing the slot before we're done reading it.
+    const uint32_t tail = _tail.load( std::memory_order_relaxed );
+    _tail.store( tail + 1, std::memory_order_release );
+}
+
+
+static bool claimSide( std::atomic<int> &side, int core )
+{
+    int owner = -1;
+    if( side.compare_exchange_strong( owner, core ) )
+    {
+        // First use
+        return true;
+    }
+
+    return owner == core;
+}
+
+
+Channel *openChannel( const char *name, uint32_t capacity )
+{
+    Channel *ch = NULL;
+
+    LOCK_CHANNEL_LIST();
+
+    for( int i = 0; i < numChannels; i++ )
+    {
+        if( strncmp( channels[i].name(), name, CHANNEL_NAME_SIZE - 1 ) == 0 )
+        {
+            ch = &channels[i];
+            break;
+        }
+    }
+
+    if( ch == NULL && numChannels < CHANNEL_MAX_CHANNELS && capacity > 0 )
+    {
+        if( channels[numChannels].init( name, capacity ) )
+        {
+            ch = &channels[numChannels++];
+        }
+    }
+
+    UNLOCK_CHANNEL_LIST();
+
+    return ch;
+}
+
+
+//==================================================================================
+// Codec
+//==================================================================================
+
+static bool putByte( Encoder *enc, uint8_t b )
+{
+    if( enc->p >= enc->end )
+    {
+        return false;
+    }
+
+    *enc->p++ = b;
+    return true;
+}
+
+
+static bool putBytes( Encoder *enc, const void *data, size_t len )
+{
+    if( (size_t)(enc->end - enc->p) < len )
+    {
+        return false;
+    }
+
+    memcpy( enc->p, data, len );
+    enc->p += len;
+    return true;
+}
+
+
+static bool putVarint( Encoder *enc, lua_Unsigned v )
+{
+    while( v >= 0x80 )
+    {
+        if( ! putByte( enc, (uint8_t)(v | 0x80) ) )
+        {
+            return false;
+        }
+        v >>= 7;
+    }
+
+    return putByte( enc, (uint8_t)v );
+}
+
+
+static lua_Unsigned getVarint( Decoder *dec )
+{
+    lua_Unsigned v = 0;
+    int shift = 0;
+    uint8_t b;
+
+    do
+    {
+        b = *dec->p++;
+        v |= (lua_Unsigned)(b & 0x7F) << shift;
+        shift += 7;
+    }
+    while( b & 0x80 );
+
+    return v;
+}
+
+
+const char *channelEncode( lua_State *L, int idx, ChannelSlot *slot )
+{
+    Encoder enc;
+    enc.p = slot->data;
+    enc.end = slot->data + sizeof(slot->data);
+
+    const char *err = encodeValue( L, lua_absindex( L, idx ), &enc, true );
+    if( err == NULL )
+    {
+        slot->len = enc.p - slot->data;
+    }
+
+    return err;
+}
+
+
+void channelDecode( lua_State *L, const ChannelSlot *slot )
+{
+    Decoder dec;
+    dec.p = slot->data;
+
+    decodeValue( L, &dec );
+}
+
+
+static const char *encodeValue( lua_State *L, int idx, Encoder *enc, bool allowTable )
+{
+    static const char *tooBig = "value is too large to send over a channel";
+    bool ok;
+
+    switch( lua_type( L, idx ) )
+    {
+        case LUA_TBOOLEAN:
+            ok = putByte( enc, lua_toboolean( L, idx ) ? TAG_TRUE : TAG_FALSE );
+            break;
+
+        case LUA_TNUMBER:
+            if( lua_isinteger( L, idx ) )
+            {
+                lua_Integer i = lua_tointeger( L, idx );
+                lua_Unsigned zz = ((lua_Unsigned)i << 1) ^ (lua_Unsigned)(i < 0 ? -1 : 0);
+                ok = putByte( enc, TAG_INTEGER ) && putVarint( enc, zz );
+            }
+            else
+            {
+                lua_Number n = lua_tonumber( L, idx );
+                ok = putByte( enc, TAG_FLOAT ) && putBytes( enc, &n, sizeof(n) );
+            }
+            break;
+
+        case LUA_TSTRING:
+        {
+            size_t len;
+            const char *s = lua_tolstring( L, idx, &len );
+            ok = putByte( enc, TAG_STRING ) && putVarint( enc, len ) && putBytes( enc, s, len );
+            break;
+        }
+
+        case LUA_TTABLE:
+        {
+            if( ! allowTable )
+            {
+                return "nested tables cannot be sent over a channel";
+            }
+
+            // Leave room for the count, and fill it in once we know it.
+            uint8_t *countPos = enc->p + 1;
+            if( ! putByte( enc, TAG_TABLE ) || ! putBytes( enc, "\0\0", 2 ) )
+            {
+                return tooBig;
+            }
+
+            uint16_t count = 0;
+
+            lua_pushnil( L );
+            while( lua_next( L, idx ) )
+            {
+                // key -2, value -1
+                const char *err = encodeValue( L, lua_gettop( L ) - 1, enc, false );
+                if( err == NULL )
+                {
+                    err = encodeValue( L, lua_gettop( L ), enc, false );
+                }
+
+                if( err )
+                {
+                    lua_pop( L, 2 );
+                    return err;
+                }
+
+                lua_pop( L, 1 );
+                count++;
+            }
+
+            countPos[0] = count & 0xFF;
+            countPos[1] = count >> 8;
+            ok = true;
+            break;
+        }
+
+        default:
+            return "only numbers, booleans, strings, and flat tables can be sent over a channel";
+    }
+
+    return ok ? NULL : tooBig;
+}
+
+
+static void decodeValue( lua_State *L, Decoder *dec )
+{
+    switch( *dec->p++ )
+    {
+        case TAG_FALSE:
+            lua_pushboolean( L, 0 );
+            break;
+
+        case TAG_TRUE:
+            lua_pushboolean( L, 1 );
+            break;
+
+        case TAG_INTEGER:
+        {
+            lua_Unsigned zz = getVarint( dec );
+            lua_pushinteger( L, (lua_Integer)(zz >> 1) ^ -(lua_Integer)(zz & 1) );
+            break;
+        }
+
+        case TAG_FLOAT:
+        {
+            lua_Number n;
+            memcpy( &n, dec->p, sizeof(n) );
+            dec->p += sizeof(n);
+            lua_pushnumber( L, n );
+            break;
+        }
+
+        case TAG_STRING:
+        {
+            size_t len = getVarint( dec );
+            lua_pushlstring( L, (const char*)dec->p, len );
+            dec->p += len;
+            break;
+        }
+
+        case TAG_TABLE:
+        {
+            int count = dec->p[0] | (dec->p[1] << 8);
+            dec->p += 2;
+
+            lua_createtable( L, 0, count );
+            for( int i = 0; i < count; i++ )
+            {
+                decodeValue( L, dec );      // key
+                decodeValue( L, dec );      // value
+                lua_rawset( L, -3 );
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+// channel.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Channels pass Lua values between the Lua states on the two cores.
+//
+// Each channel is a single-producer, single-consumer ring of fixed size slots. The core that
+// first pushes to a channel is its producer, and the core that first pops from it is its
+// consumer; the other core can't then do the same (see claimProducer()). Values are
+// serialized into a slot by the producer and deserialized out of it by the consumer, so the
+// two Lua states never share any Lua memory. The ring itself uses only atomic loads and stores
+// of the head and tail indexes, so pushing and popping never takes a lock.
+//
+// Nothing in here depends on Arduino, so it can also be built on a host.
+//
+
+#ifndef CHANNEL_H
+#define CHANNEL_H  1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "lua.hpp"
+
+
+// Largest encoded value that fits in one slot.
+#define CHANNEL_SLOT_SIZE       96
+
+// Most channels that may exist at one time.
+#define CHANNEL_MAX_CHANNELS    8
+
+#define CHANNEL_NAME_SIZE       16
+
+
+struct ChannelSlot {
+    uint16_t len;
+    uint8_t data[CHANNEL_SLOT_SIZE];
+};
+
+
+class Channel
+{
+public:
+    // Allocates the slots. Capacity is rounded up to a power of two.
+    bool init( const char *name, uint32_t capacity );
+
+    const char *name() const { return _name; }
+    uint32_t capacity() const { return _mask + 1; }
+
+    // Record the core that pushes to (or pops from) the channel, the first time each is
+    // called. Returns false if that side already belongs to the other core.
+    bool claimProducer( int core );
+    bool claimConsumer( int core );
+
+    // Number of values waiting. (Only exact when called by the producer or consumer.)
+    uint32_t count() const;
+
+    //
+    // Producer side
+    //
+
+    // Returns the slot to encode the next value into, or NULL if the channel is full.
+    ChannelSlot *reserve();
+
+    // Makes the reserved slot visible to the consumer.
+    void commit();
+
+    //
+    // Consumer side
+    //
+
+    // Returns the oldest value, or NULL if the channel is empty.
+    const ChannelSlot *front() const;
+
+    // Returns the newest value, or NULL if the channel is empty.
+    const ChannelSlot *back() const;
+
+    // Discards the oldest value.
+    void release();
+
+private:
+    char _name[CHANNEL_NAME_SIZE];
+
+    ChannelSlot *_slots;
+    uint32_t _mask;
+
+    // Free-running indexes. Head is only written by the producer, tail only by the consumer.
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+
+    // Cores of each side, or -1 until used.
+    std::atomic<int> _producer;
+    std::atomic<int> _consumer;
+};
+
+
+// Find the channel with the given name, creating it if needed.
+// Returns NULL if it doesn't exist and can't be created.
+Channel *openChannel( const char *name, uint32_t capacity );
+
+
+// Serialize the Lua value at the given stack index into a slot.
+// Numbers, booleans, strings, and tables of those are supported.
+// Returns NULL on success, or an error message.
+const char *channelEncode( lua_State *L, int idx, ChannelSlot *slot );
+
+// Push the value held in a slot onto the Lua stack.
+void channelDecode( lua_State *L, const ChannelSlot *slot );
+
+#endif
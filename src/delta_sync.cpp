@@ -0,0 +1,261 @@
+// delta_sync.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+#if defined (ARDUINO_ARCH_RP2040)
+#include <SDFS.h>
+#else
+#include <SD.h>
+#endif
+
+#include "lua_support.h"
+#include "crc32.h"
+#include "delta_sync.h"
+
+
+
+enum DeltaState {
+    DELTA_OP,
+    DELTA_ARGS,
+    DELTA_DATA
+};
+
+
+// The old version of the module.
+static File oldFile;
+static uint32_t oldSize;
+
+static uint8_t blockBuffer[DELTA_BLOCK_SIZE];
+
+static DeltaOutputFn outputFn;
+
+static DeltaState state;
+static uint8_t op;
+static uint8_t args[4];
+static size_t argsLen;
+static size_t argsWanted;
+static uint32_t literalLeft;
+
+
+static bool readBlock( uint32_t block, size_t *len );
+static bool runOp();
+
+
+
+uint32_t deltaOpen( const char *modname )
+{
+    char fname[96];
+    snprintf( fname, sizeof(fname), "/%s.lua", modname );
+
+    lockFilesystem();
+
+#if defined (ARDUINO_ARCH_RP2040)
+    oldFile = SDFS.open( fname, "r" );
+#else
+    oldFile = SD.open( fname, FILE_READ );
+#endif
+
+    oldSize = oldFile ? oldFile.size() : 0;
+
+    unlockFilesystem();
+
+    return oldSize;
+}
+
+
+uint32_t deltaBlockCount()
+{
+    return oldSize / DELTA_BLOCK_SIZE;
+}
+
+
+bool deltaBlockSignature( uint32_t block, uint32_t *weak, uint32_t *strong )
+{
+    size_t len;
+    if( readBlock( block, &len ) == false )
+    {
+        return false;
+    }
+
+    *weak = deltaWeakSum( blockBuffer, len );
+    *strong = crc32Update( 0, blockBuffer, len );
+
+    return true;
+}
+
+
+void deltaBegin( DeltaOutputFn fn )
+{
+    outputFn = fn;
+
+    state = DELTA_OP;
+}
+
+
+bool deltaDecode( const uint8_t *data, size_t len )
+{
+    while( len > 0 )
+    {
+        switch( state )
+        {
+            case DELTA_OP:
+                op = *data++;
+                len--;
+
+                argsLen = 0;
+                if( op == DELTA_COPY )
+                {
+                    argsWanted = 4;
+                }
+                else if( op == DELTA_LITERAL )
+                {
+                    argsWanted = 2;
+                }
+                else
+                {
+                    return false;
+                }
+
+                state = DELTA_ARGS;
+                break;
+
+            case DELTA_ARGS:
+                args[argsLen++] = *data++;
+                len--;
+
+                if( argsLen == argsWanted && runOp() == false )
+                {
+                    return false;
+                }
+                break;
+
+            case DELTA_DATA:
+            {
+                // Literal data goes straight through.
+                size_t n = ( len < literalLeft ) ? len : literalLeft;
+                if( outputFn( data, n ) == false )
+                {
+                    return false;
+                }
+
+                data += n;
+                len -= n;
+                literalLeft -= n;
+
+                if( literalLeft == 0 )
+                {
+                    state = DELTA_OP;
+                }
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool deltaEnd()
+{
+    return state == DELTA_OP;
+}
+
+
+void deltaClose()
+{
+    lockFilesystem();
+
+    if( oldFile )
+    {
+        oldFile.close();
+    }
+
+    unlockFilesystem();
+
+    oldSize = 0;
+}
+
+
+uint32_t deltaWeakSum( const uint8_t *data, size_t len )
+{
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    for( size_t i = 0; i < len; i++ )
+    {
+        a += data[i];
+        b += ( len - i ) * data[i];
+    }
+
+    return ( a & 0xFFFF ) | ( ( b & 0xFFFF ) << 16 );
+}
+
+
+//==================================================================================
+
+static bool runOp()
+{
+    const uint32_t arg0 = args[0] | ( args[1] << 8 );
+
+    if( op == DELTA_LITERAL )
+    {
+        literalLeft = arg0;
+        state = ( literalLeft > 0 ) ? DELTA_DATA : DELTA_OP;
+        return true;
+    }
+
+    // Copy
+    const uint32_t count = args[2] | ( args[3] << 8 );
+    if( arg0 + count > deltaBlockCount() )
+    {
+        return false;
+    }
+
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        size_t len;
+        if( readBlock( arg0 + i, &len ) == false || outputFn( blockBuffer, len ) == false )
+        {
+            return false;
+        }
+    }
+
+    state = DELTA_OP;
+    return true;
+}
+
+
+static bool readBlock( uint32_t block, size_t *len )
+{
+    if( block >= deltaBlockCount() )
+    {
+        return false;
+    }
+
+    lockFilesystem();
+
+    bool ok = oldFile.seek( block * DELTA_BLOCK_SIZE );
+    if( ok )
+    {
+        *len = oldFile.read( blockBuffer, DELTA_BLOCK_SIZE );
+        ok = ( *len == DELTA_BLOCK_SIZE );
+    }
+
+    unlockFilesystem();
+
+    return ok;
+}
@@ -0,0 +1,74 @@
+// delta_sync.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Rebuilding a module from its old file plus the changes, for the shell's '%' command
+// (tools/lua_send.py --sync).
+//
+// The board lists a signature for each DELTA_BLOCK_SIZE block of the old file: a rolling
+// checksum and a CRC-32. The host finds the blocks that are unchanged in the new file, and sends
+// the new file as instructions:
+//
+//     'C' block(2) count(2)        copy count blocks of the old file, starting at block
+//     'L' len(2)  data(len)        literal data
+//
+// (little-endian), which are decoded here into the new file.
+//
+
+#ifndef DELTA_SYNC_H
+#define DELTA_SYNC_H  1
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define DELTA_BLOCK_SIZE    256
+
+#define DELTA_COPY          'C'
+#define DELTA_LITERAL       'L'
+
+
+// Gets the rebuilt file's data. Returns false to stop.
+typedef bool (*DeltaOutputFn)( const void *data, size_t len );
+
+
+// Open the module's current file. Returns its size, or 0 if there isn't one.
+uint32_t deltaOpen( const char *modname );
+
+// Number of whole blocks in the open file, which are the ones that can be copied.
+uint32_t deltaBlockCount();
+
+// Signature of a block. Returns false if it can't be read.
+bool deltaBlockSignature( uint32_t block, uint32_t *weak, uint32_t *strong );
+
+// Start decoding instructions.
+void deltaBegin( DeltaOutputFn fn );
+
+// Decode more instructions. Returns false if they are bad, a block can't be read, or the
+// output function failed.
+bool deltaDecode( const uint8_t *data, size_t len );
+
+// Returns false if the instructions ended part way through one.
+bool deltaEnd();
+
+// Close the old file (which must be done before it is replaced).
+void deltaClose();
+
+// The rolling checksum (as in rsync) of a block.
+uint32_t deltaWeakSum( const uint8_t *data, size_t len );
+
+#endif
@@ -0,0 +1,249 @@
+// download_file.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+#if defined (ARDUINO_ARCH_RP2040)
+#include <SDFS.h>
+#else
+#include <SD.h>
+#endif
+
+#include "lua_support.h"
+#include "download_file.h"
+
+
+
+static File file;
+
+static char tempName[96];
+static char fileName[96];
+static char backupName[96];
+
+static uint8_t buffer[DOWNLOAD_BUFFER_SIZE];
+static size_t bufferLen;
+
+
+static bool flushBuffer();
+static bool fileExists( const char *fname );
+static void removeFile( const char *fname );
+static bool renameFile( const char *from, const char *to );
+
+
+
+bool downloadFileOpen( const char *modname )
+{
+    snprintf( tempName, sizeof(tempName), "/%s.tmp", modname );
+    snprintf( fileName, sizeof(fileName), "/%s.lua", modname );
+    snprintf( backupName, sizeof(backupName), "/%s.bak", modname );
+
+    bufferLen = 0;
+
+    lockFilesystem();
+
+#if defined (ARDUINO_ARCH_RP2040)
+    file = SDFS.open( tempName, "w" );
+#else
+    SD.remove( tempName );
+    file = SD.open( tempName, FILE_WRITE );
+#endif
+
+    unlockFilesystem();
+
+    return file ? true : false;
+}
+
+
+bool downloadFileWrite( const void *data, size_t len )
+{
+    const uint8_t *p = (const uint8_t*)data;
+
+    while( len > 0 )
+    {
+        size_t n = sizeof(buffer) - bufferLen;
+        if( n > len )
+        {
+            n = len;
+        }
+
+        memcpy( buffer + bufferLen, p, n );
+        bufferLen += n;
+        p += n;
+        len -= n;
+
+        // Write whole sectors.
+        if( bufferLen == sizeof(buffer) && flushBuffer() == false )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+DownloadCommit downloadFileCommit()
+{
+    if( flushBuffer() == false )
+    {
+        return DownloadCommit::WriteFailed;
+    }
+
+    lockFilesystem();
+
+    file.close();
+
+    // Rename won't replace a file, so the old one is moved aside as the .bak first, and put
+    // back if the new one can't take its place. Nothing is removed until the new module is
+    // in place, so a failure (or the power going) leaves it as the .tmp file.
+    const bool replacing = fileExists( fileName );
+    if( replacing )
+    {
+        removeFile( backupName );
+        if( renameFile( fileName, backupName ) == false )
+        {
+            unlockFilesystem();
+            return DownloadCommit::RenameFailed;
+        }
+    }
+
+    if( renameFile( tempName, fileName ) == false )
+    {
+        if( replacing )
+        {
+            renameFile( backupName, fileName );
+        }
+
+        unlockFilesystem();
+        return DownloadCommit::RenameFailed;
+    }
+
+    if( replacing )
+    {
+        removeFile( backupName );
+    }
+
+    unlockFilesystem();
+
+    return DownloadCommit::Done;
+}
+
+
+void downloadFileAbort()
+{
+    lockFilesystem();
+
+    if( file )
+    {
+        file.close();
+    }
+
+    removeFile( tempName );
+
+    unlockFilesystem();
+}
+
+
+//==================================================================================
+
+static bool flushBuffer()
+{
+    if( bufferLen == 0 )
+    {
+        return true;
+    }
+
+    lockFilesystem();
+
+    size_t n = file.write( buffer, bufferLen );
+
+    unlockFilesystem();
+
+    bool ok = ( n == bufferLen );
+    bufferLen = 0;
+
+    return ok;
+}
+
+
+static bool fileExists( const char *fname )
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    return SDFS.exists( fname );
+#else
+    return SD.exists( fname );
+#endif
+}
+
+
+static void removeFile( const char *fname )
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    if( SDFS.exists( fname ) )
+    {
+        SDFS.remove( fname );
+    }
+#else
+    if( SD.exists( fname ) )
+    {
+        SD.remove( fname );
+    }
+#endif
+}
+
+
+/**
+ * Rename a file. The target must not exist.
+ * The filesystem must be locked, and the download's file closed (its buffer is used).
+ */
+static bool renameFile( const char *from, const char *to )
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    return SDFS.rename( from, to );
+#else
+    // The SD library has no rename, so the file is copied and the original removed.
+    File in = SD.open( from );
+    if( ! in )
+    {
+        return false;
+    }
+
+    File out = SD.open( to, FILE_WRITE );
+    if( ! out )
+    {
+        in.close();
+        return false;
+    }
+
+    bool ok = true;
+    int n;
+    while( ok && (n = in.read( buffer, sizeof(buffer) )) > 0 )
+    {
+        ok = ( out.write( buffer, n ) == (size_t)n );
+    }
+
+    in.close();
+    out.close();
+
+    if( ok == false )
+    {
+        SD.remove( to );
+        return false;
+    }
+
+    return SD.remove( from );
+#endif
+}
@@ -0,0 +1,56 @@
+// download_file.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Writing a downloaded module to the SD card as it arrives.
+//
+// The data goes to '/<module>.tmp' through a sector-sized buffer, and only replaces
+// '/<module>.lua' once the download is complete, so a failed download leaves the old module
+// as it was. None of it is kept in Lua memory.
+//
+// There is one download at a time. The filesystem is locked only while each piece is written,
+// not for the whole download.
+//
+
+#ifndef DOWNLOAD_FILE_H
+#define DOWNLOAD_FILE_H  1
+
+#include <stddef.h>
+
+
+#define DOWNLOAD_BUFFER_SIZE    512
+
+
+// Start writing the temp file for the module. Returns false if it can't be created.
+bool downloadFileOpen( const char *modname );
+
+// Returns false if the data could not be written.
+bool downloadFileWrite( const void *data, size_t len );
+
+enum class DownloadCommit {
+    Done,
+    WriteFailed,        // The temp file couldn't be finished, the old module is untouched
+    RenameFailed        // The new module is kept as the temp file, the old one put back
+};
+
+// Finish the temp file and rename it over the module's file.
+DownloadCommit downloadFileCommit();
+
+// Give up, removing the temp file. Not for after the commit, which has closed it.
+void downloadFileAbort();
+
+#endif
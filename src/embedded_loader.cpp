@@ -0,0 +1,48 @@
+// embedded_loader.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "embedded_modules.h"
+
+
+
+const EmbeddedModule *findEmbeddedModule( const char *name )
+{
+    for( const EmbeddedModule *m = embeddedModules; m->name != NULL; m++ )
+    {
+        if( strcmp( m->name, name ) == 0 )
+        {
+            return m;
+        }
+    }
+
+    return NULL;
+}
+
+
+int loadEmbeddedModule( lua_State *L, const char *name )
+{
+    const EmbeddedModule *m = findEmbeddedModule( name );
+    if( m == NULL )
+    {
+        return -1;
+    }
+
+    // Lua reads the bytecode straight out of flash.
+    return luaL_loadbufferx( L, (const char*)m->code, m->size, name, "b" );
+}
@@ -0,0 +1,15 @@
+// embedded_modules.cpp
+
+//
+// Generated by tools/embed_lua.py. Do not edit.
+//
+// luac: luac
+// Instruction=?  lua_Integer=?  lua_Number=?  stripped=False
+//
+
+#include "embedded_modules.h"
+
+
+const EmbeddedModule embeddedModules[] = {
+    { NULL, NULL, 0 }
+};
@@ -0,0 +1,50 @@
+// embedded_modules.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Lua modules built into the firmware.
+//
+// tools/embed_lua.py compiles chosen scripts to bytecode and writes them out as const arrays in
+// embedded_modules.cpp, so they live in flash and are loaded from there without a copy.
+//
+
+#ifndef EMBEDDED_MODULES_H
+#define EMBEDDED_MODULES_H  1
+
+#include <stddef.h>
+
+#include "lua.hpp"
+
+
+struct EmbeddedModule {
+    const char *name;
+    const unsigned char *code;
+    size_t size;
+};
+
+
+// The table written by tools/embed_lua.py, ending with a NULL name.
+extern const EmbeddedModule embeddedModules[];
+
+
+const EmbeddedModule *findEmbeddedModule( const char *name );
+
+// Load the named module. Returns -1 if there isn't one (with nothing pushed), otherwise the
+// load status, with either the function or an error message on the stack.
+int loadEmbeddedModule( lua_State *L, const char *name );
+
+#endif
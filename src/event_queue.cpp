@@ -0,0 +1,235 @@
+// event_queue.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#if defined (ARDUINO_ARCH_RP2040)
+#include <pico/critical_section.h>
+#include <pico/time.h>
+#endif
+
+#include "event_queue.h"
+
+
+
+// The queue may be posted to by an interrupt handler on either core, so the lock must both
+// mask interrupts and keep out the other core.
+#if defined (ARDUINO_ARCH_RP2040)
+static critical_section_t queueLock;
+#define LOCK_QUEUE()        critical_section_enter_blocking( &queueLock )
+#define UNLOCK_QUEUE()      critical_section_exit( &queueLock )
+#else
+#define LOCK_QUEUE()        noInterrupts()
+#define UNLOCK_QUEUE()      interrupts()
+#endif
+
+
+static Event queue[EVENT_QUEUE_SIZE];
+
+// Free-running indexes, only changed with the queue locked.
+static uint32_t head = 0;
+static uint32_t tail = 0;
+
+static volatile unsigned long dropped = 0;
+
+
+static const char * const eventNames[NUM_EVENT_TYPES] = {
+    "pin",
+    "timer",
+    "user",
+};
+
+
+#if defined (ARDUINO_ARCH_RP2040)
+static repeating_timer_t timers[MAX_EVENT_TIMERS];
+static bool timerRunning[MAX_EVENT_TIMERS];
+
+static void pinChanged( void *param );
+static bool timerExpired( repeating_timer_t *rt );
+#endif
+
+
+
+void initEvents()
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    critical_section_init( &queueLock );
+#endif
+}
+
+
+bool postEvent( EventType type, uint8_t source, int32_t value )
+{
+    const uint32_t now = micros();
+    bool posted = false;
+
+    LOCK_QUEUE();
+
+    if( head - tail < EVENT_QUEUE_SIZE )
+    {
+        Event *ev = &queue[head % EVENT_QUEUE_SIZE];
+        ev->type = type;
+        ev->source = source;
+        ev->value = value;
+        ev->time = now;
+
+        head++;
+        posted = true;
+    }
+    else
+    {
+        dropped++;
+    }
+
+    UNLOCK_QUEUE();
+
+    return posted;
+}
+
+
+int takeEvents( Event *events, int max )
+{
+    int n = 0;
+
+    LOCK_QUEUE();
+
+    while( n < max && tail != head )
+    {
+        events[n++] = queue[tail % EVENT_QUEUE_SIZE];
+        tail++;
+    }
+
+    UNLOCK_QUEUE();
+
+    return n;
+}
+
+
+unsigned long droppedEvents()
+{
+    return dropped;
+}
+
+
+const char *eventName( uint8_t type )
+{
+    return (type < NUM_EVENT_TYPES) ? eventNames[type] : "unknown";
+}
+
+
+//==================================================================================
+// Event sources
+//==================================================================================
+
+#if defined (ARDUINO_ARCH_RP2040)
+
+bool watchPin( int pin, int mode )
+{
+    if( pin < 0 || pin > 255 )
+    {
+        return false;
+    }
+
+    attachInterruptParam( digitalPinToInterrupt( pin ), pinChanged, mode, (void*)(intptr_t)pin );
+    return true;
+}
+
+
+void unwatchPin( int pin )
+{
+    detachInterrupt( digitalPinToInterrupt( pin ) );
+}
+
+
+bool startEventTimer( int id, unsigned long ms )
+{
+    if( id < 0 || id >= MAX_EVENT_TIMERS || ms == 0 )
+    {
+        return false;
+    }
+
+    stopEventTimer( id );
+
+    timerRunning[id] = add_repeating_timer_ms( ms, timerExpired, (void*)(intptr_t)id, &timers[id] );
+    return timerRunning[id];
+}
+
+
+void stopEventTimer( int id )
+{
+    if( id < 0 || id >= MAX_EVENT_TIMERS )
+    {
+        return;
+    }
+
+    if( timerRunning[id] )
+    {
+        cancel_repeating_timer( &timers[id] );
+        timerRunning[id] = false;
+    }
+}
+
+
+// Interrupt handler
+static void pinChanged( void *param )
+{
+    int pin = (int)(intptr_t)param;
+    postEvent( EVENT_PIN, pin, digitalRead( pin ) );
+}
+
+
+// Interrupt handler
+static bool timerExpired( repeating_timer_t *rt )
+{
+    postEvent( EVENT_TIMER, (int)(intptr_t)rt->user_data, 0 );
+
+    // Keep repeating
+    return true;
+}
+
+#else
+
+// Pin and timer events are only supported on the RP2040.
+
+bool watchPin( int pin, int mode )
+{
+    (void)pin;
+    (void)mode;
+    return false;
+}
+
+
+void unwatchPin( int pin )
+{
+    (void)pin;
+}
+
+
+bool startEventTimer( int id, unsigned long ms )
+{
+    (void)id;
+    (void)ms;
+    return false;
+}
+
+
+void stopEventTimer( int id )
+{
+    (void)id;
+}
+
+#endif
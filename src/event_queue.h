@@ -0,0 +1,80 @@
+// event_queue.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Events posted from C++ (including interrupt handlers) for the Lua event_handler() function.
+//
+// The queue is a fixed ring of small fixed size events, so posting never allocates and is safe
+// from an interrupt handler or from either core. The core 0 run loop takes the events off in
+// batches and passes them on to Lua.
+//
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H  1
+
+#include <stdint.h>
+
+
+// Most events that may be waiting at once. (Must be a power of two.)
+#define EVENT_QUEUE_SIZE    64
+
+// Number of event timers.
+#define MAX_EVENT_TIMERS    4
+
+
+enum EventType {
+    EVENT_PIN,          // source is the pin, value is the pin level
+    EVENT_TIMER,        // source is the timer id
+    EVENT_USER,         // Posted by a script, source and value are up to it
+
+    NUM_EVENT_TYPES
+};
+
+
+struct Event {
+    uint8_t type;
+    uint8_t source;
+    int32_t value;
+    uint32_t time;      // micros() when the event was posted
+};
+
+
+// Must be called before any events are posted.
+void initEvents();
+
+// Add an event to the queue. Returns false (and counts the event as dropped) if the queue is full.
+// Safe to call from an interrupt handler or either core.
+bool postEvent( EventType type, uint8_t source, int32_t value );
+
+// Remove up to 'max' of the oldest events from the queue. Returns the number removed.
+int takeEvents( Event *events, int max );
+
+unsigned long droppedEvents();
+
+// The name the event is passed to Lua with.
+const char *eventName( uint8_t type );
+
+
+// Post a pin event when the pin changes. Mode is RISING, FALLING, or CHANGE.
+bool watchPin( int pin, int mode );
+void unwatchPin( int pin );
+
+// Post a timer event every 'ms' milliseconds.
+bool startEventTimer( int id, unsigned long ms );
+void stopEventTimer( int id );
+
+#endif
@@ -21,10 +21,15 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_RGBLED.h"
 
 
+LUA_CLASS( EVNRGBLED, CLASS_RGBLED );
+
+
 static int new_object( lua_State *L );
 
 #define EVN_CLASS           EVNRGBLED
@@ -32,187 +37,44 @@ static int new_object( lua_State *L );
 #define LUA_CLASS_NAME      "RGBLED"
 
 
-
-static int begin( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    lua_pushboolean( L, obj->begin() );
-    return 1;
-}
-
-
-static int setInvert( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    bool enable = methodArgBool( L, 1 );
-    obj->setInvert( enable );
-    return 0;
-}
-
-
-static int getInvert( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    lua_pushinteger( L, obj->getInvert() );
-    return 1;
-}
-
-
-static int setLEDCount( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    int led_count = methodArgInt( L, 1 );
-    obj->setLEDCount( led_count );
-    return 0;
-}
-
-
-static int getLEDCount( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    lua_pushinteger( L, obj->getLEDCount() );
-    return 1;
-}
-
-
-static int writeOne( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    int led = methodArgInt( L, 1 );
-    int r = methodArgInt( L, 2, 0 );
-    int g = methodArgInt( L, 3, 0 );
-    int b = methodArgInt( L, 4, 0 );
-    bool show = methodArgBool( L, 5, true );
-    obj->writeOne( led, r, g, b, show );
-    return 0;
-}
-
-
-static int clearOne( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    int led = methodArgInt( L, 1 );
-    bool show = methodArgBool( L, 2, true );
-    obj->clearOne( led, show );
-    return 0;
-}
-
-
-static int writeLine( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    int start_led = methodArgInt( L, 1 );
-    int end_led = methodArgInt( L, 2 );
-    int r = methodArgInt( L, 3, 0 );
-    int g = methodArgInt( L, 4, 0 );
-    int b = methodArgInt( L, 5, 0 );
-    bool show = methodArgBool( L, 6, true );
-    obj->writeLine( start_led, end_led, r, g, b, show );
-    return 0;
-}
-
-
-static int clearLine( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    int start_led = methodArgInt( L, 1 );
-    int end_led = methodArgInt( L, 2 );
-    bool show = methodArgBool( L, 3, true );
-    obj->clearLine( start_led, end_led, show );
-    return 0;
-}
-
-
-static int writeAll( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    int r = methodArgInt( L, 1, 0 );
-    int g = methodArgInt( L, 2, 0 );
-    int b = methodArgInt( L, 3, 0 );
-    bool show = methodArgBool( L, 4, true );
-    obj->writeAll( r, g, b, show );
-    return 0;
-}
-
-
-static int clearAll( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    bool show = methodArgBool( L, 1, true );
-    obj->clearAll( show );
-    return 0;
-}
-
-
-static int update( lua_State *L )
-{
-    EVNRGBLED *obj = (EVNRGBLED*)luaL_checkudata( L, 1, "EVNRGBLED" );
-    obj->update();
-    return 0;
-}
-
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "setInvert", setInvert },
-    { "getInvert", getInvert },
-    { "setLEDCount", setLEDCount },
-    { "getLEDCount", getLEDCount },
-    { "writeOne", writeOne },
-    { "clearOne", clearOne },
-    { "writeLine", writeLine },
-    { "clearLine", clearLine },
-    { "writeAll", writeAll },
-    { "clearAll", clearAll },
-    { "update", update },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNRGBLED, begin, bool() ),
+    RO_METHOD( "setInvert", EVNRGBLED, setInvert, void( bool ) ),
+    RO_METHOD( "getInvert", EVNRGBLED, getInvert, int() ),
+    RO_METHOD( "setLEDCount", EVNRGBLED, setLEDCount, void( int ) ),
+    RO_METHOD( "getLEDCount", EVNRGBLED, getLEDCount, int() ),
+    RO_METHOD( "writeOne", EVNRGBLED, writeOne, void( int, int, int, int, bool ), 0, 0, 0, true ),
+    RO_METHOD( "clearOne", EVNRGBLED, clearOne, void( int, bool ), true ),
+    RO_METHOD( "writeLine", EVNRGBLED, writeLine, void( int, int, int, int, int, bool ), 0, 0, 0, true ),
+    RO_METHOD( "clearLine", EVNRGBLED, clearLine, void( int, int, bool ), true ),
+    RO_METHOD( "writeAll", EVNRGBLED, writeAll, void( int, int, int, bool ), 0, 0, 0, true ),
+    RO_METHOD( "clearAll", EVNRGBLED, clearAll, void( bool ), true ),
+    RO_METHOD( "update", EVNRGBLED, update, void() ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_RGBLED_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_RGBLED( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, EVN_CLASS_NAME );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, LUA_CLASS_NAME );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-
-    lua_settable( L, -3 );
 }
 
 
@@ -15,7 +15,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-struct lua_State;
+#include "rotable.h"
 
 
 void init_evn_RGBLED( lua_State *L );
+
+// The class table (evn.LUA_CLASS_NAME)
+extern const RoEntry evn_RGBLED_class[];
@@ -21,10 +21,15 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_colour_sensor.h"
 
 
+LUA_CLASS( EVNColourSensor, CLASS_COLOUR_SENSOR );
+
+
 static int new_object( lua_State *L );
 
 #define EVN_CLASS           EVNColourSensor
@@ -32,293 +37,61 @@ static int new_object( lua_State *L );
 #define LUA_CLASS_NAME      "ColourSensor"
 
 
-
-static int begin( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    lua_pushboolean( L, obj->begin() );
-    return 1;
-}
-
-
-static int setGain( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    EVNColourSensor::gain gain = (EVNColourSensor::gain)methodArgInt( L, 1 );
-    obj->setGain( gain );
-    return 0;
-}
-
-
-static int setIntegrationCycles( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    int integration_cycles = methodArgInt( L, 1 );
-    obj->setIntegrationCycles( integration_cycles );
-    return 0;
-}
-
-
-static int setRedRange( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    int low = methodArgInt( L, 1 );
-    int high = methodArgInt( L, 2 );
-    obj->setRedRange( low, high );
-    return 0;
-}
-
-
-static int setGreenRange( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    int low = methodArgInt( L, 1 );
-    int high = methodArgInt( L, 2 );
-    obj->setGreenRange( low, high );
-    return 0;
-}
-
-
-static int setBlueRange( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    int low = methodArgInt( L, 1 );
-    int high = methodArgInt( L, 2 );
-    obj->setBlueRange( low, high );
-    return 0;
-}
-
-
-static int setClearRange( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    int low = methodArgInt( L, 1 );
-    int high = methodArgInt( L, 2 );
-    obj->setClearRange( low, high );
-    return 0;
-}
-
-
-static int read( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushinteger( L, obj->read( blocking ) );
-    return 1;
-}
-
-
-static int readRed( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushinteger( L, obj->readRed( blocking ) );
-    return 1;
-}
-
-
-static int readGreen( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushinteger( L, obj->readGreen( blocking ) );
-    return 1;
-}
-
-
-static int readBlue( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushinteger( L, obj->readBlue( blocking ) );
-    return 1;
-}
-
-
-static int readClear( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushinteger( L, obj->readClear( blocking ) );
-    return 1;
-}
-
-
-static int readRedNorm( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readRedNorm( blocking ) );
-    return 1;
-}
-
-
-static int readGreenNorm( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readGreenNorm( blocking ) );
-    return 1;
-}
-
-
-static int readBlueNorm( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readBlueNorm( blocking ) );
-    return 1;
-}
-
-
-static int readClearNorm( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readClearNorm( blocking ) );
-    return 1;
-}
-
-
-static int readClearPCT( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readClearPCT( blocking ) );
-    return 1;
-}
-
-
-static int readRedPCT( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readRedPCT( blocking ) );
-    return 1;
-}
-
-
-static int readGreenPCT( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readGreenPCT( blocking ) );
-    return 1;
-}
-
-
-static int readBluePCT( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readBluePCT( blocking ) );
-    return 1;
-}
-
-
-static int readHueHSV( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readHueHSV( blocking ) );
-    return 1;
-}
-
-
-static int readSaturationHSV( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readSaturationHSV( blocking ) );
-    return 1;
-}
-
-
-static int readValueHSV( lua_State *L )
-{
-    EVNColourSensor *obj = (EVNColourSensor*)luaL_checkudata( L, 1, "EVNColourSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readValueHSV( blocking ) );
-    return 1;
-}
-
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "setGain", setGain },
-    { "setIntegrationCycles", setIntegrationCycles },
-    { "setRedRange", setRedRange },
-    { "setGreenRange", setGreenRange },
-    { "setBlueRange", setBlueRange },
-    { "setClearRange", setClearRange },
-    { "read", read },
-    { "readRed", readRed },
-    { "readGreen", readGreen },
-    { "readBlue", readBlue },
-    { "readClear", readClear },
-    { "readRedNorm", readRedNorm },
-    { "readGreenNorm", readGreenNorm },
-    { "readBlueNorm", readBlueNorm },
-    { "readClearNorm", readClearNorm },
-    { "readClearPCT", readClearPCT },
-    { "readRedPCT", readRedPCT },
-    { "readGreenPCT", readGreenPCT },
-    { "readBluePCT", readBluePCT },
-    { "readHueHSV", readHueHSV },
-    { "readSaturationHSV", readSaturationHSV },
-    { "readValueHSV", readValueHSV },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNColourSensor, begin, bool() ),
+    RO_METHOD( "setGain", EVNColourSensor, setGain, void( EVNColourSensor::gain ) ),
+    RO_METHOD( "setIntegrationCycles", EVNColourSensor, setIntegrationCycles, void( int ) ),
+    RO_METHOD( "setRedRange", EVNColourSensor, setRedRange, void( int, int ) ),
+    RO_METHOD( "setGreenRange", EVNColourSensor, setGreenRange, void( int, int ) ),
+    RO_METHOD( "setBlueRange", EVNColourSensor, setBlueRange, void( int, int ) ),
+    RO_METHOD( "setClearRange", EVNColourSensor, setClearRange, void( int, int ) ),
+    RO_METHOD( "read", EVNColourSensor, read, int( bool ), true ),
+    RO_METHOD( "readRed", EVNColourSensor, readRed, int( bool ), true ),
+    RO_METHOD( "readGreen", EVNColourSensor, readGreen, int( bool ), true ),
+    RO_METHOD( "readBlue", EVNColourSensor, readBlue, int( bool ), true ),
+    RO_METHOD( "readClear", EVNColourSensor, readClear, int( bool ), true ),
+    RO_METHOD( "readRedNorm", EVNColourSensor, readRedNorm, float( bool ), true ),
+    RO_METHOD( "readGreenNorm", EVNColourSensor, readGreenNorm, float( bool ), true ),
+    RO_METHOD( "readBlueNorm", EVNColourSensor, readBlueNorm, float( bool ), true ),
+    RO_METHOD( "readClearNorm", EVNColourSensor, readClearNorm, float( bool ), true ),
+    RO_METHOD( "readClearPCT", EVNColourSensor, readClearPCT, float( bool ), true ),
+    RO_METHOD( "readRedPCT", EVNColourSensor, readRedPCT, float( bool ), true ),
+    RO_METHOD( "readGreenPCT", EVNColourSensor, readGreenPCT, float( bool ), true ),
+    RO_METHOD( "readBluePCT", EVNColourSensor, readBluePCT, float( bool ), true ),
+    RO_METHOD( "readHueHSV", EVNColourSensor, readHueHSV, float( bool ), true ),
+    RO_METHOD( "readSaturationHSV", EVNColourSensor, readSaturationHSV, float( bool ), true ),
+    RO_METHOD( "readValueHSV", EVNColourSensor, readValueHSV, float( bool ), true ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_colour_sensor_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    // Class constants
+    RO_INT( "X1", (int)EVNColourSensor::gain::X1 ),
+    RO_INT( "X4", (int)EVNColourSensor::gain::X4 ),
+    RO_INT( "X16", (int)EVNColourSensor::gain::X16 ),
+    RO_INT( "X64", (int)EVNColourSensor::gain::X64 ),
+
+    RO_END
 };
 
 
 void init_evn_colour_sensor( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, EVN_CLASS_NAME );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, LUA_CLASS_NAME );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-    addIntegerConstant( L, "X1", (int)EVNColourSensor::gain::X1 );
-    addIntegerConstant( L, "X4", (int)EVNColourSensor::gain::X4);
-    addIntegerConstant( L, "X16", (int)EVNColourSensor::gain::X16 );
-    addIntegerConstant( L, "X64", (int)EVNColourSensor::gain::X64 );
-
-    lua_settable( L, -3 );
 }
 
 
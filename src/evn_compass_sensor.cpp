@@ -21,10 +21,15 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_compass_sensor.h"
 
 
+LUA_CLASS( EVNCompassSensor, CLASS_COMPASS_SENSOR );
+
+
 static int new_object( lua_State *L );
 
 #define EVN_CLASS           EVNCompassSensor
@@ -32,344 +37,99 @@ static int new_object( lua_State *L );
 #define LUA_CLASS_NAME      "CompassSensor"
 
 
-
-static int begin( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    lua_pushboolean( L, obj->begin() );
-    return 1;
-}
-
-
-static int isQMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    lua_pushboolean( L, obj->isQMC() );
-    return 1;
-}
-
-
-static int isHMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    lua_pushboolean( L, obj->isHMC() );
-    return 1;
-}
-
-
-static int setCalibration( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    float hard_x = methodArgFloat( L, 1, 0 );
-    float hard_y = methodArgFloat( L, 2, 0 );
-    float hard_z = methodArgFloat( L, 3, 0 );
-    float soft_x_0 = methodArgFloat( L, 4, 1 );
-    float soft_x_1 = methodArgFloat( L, 5, 0 );
-    float soft_x_2 = methodArgFloat( L, 6, 0 );
-    float soft_y_0 = methodArgFloat( L, 7, 0 );
-    float soft_y_1 = methodArgFloat( L, 8, 1 );
-    float soft_y_2 = methodArgFloat( L, 9, 0 );
-    float soft_z_0 = methodArgFloat( L, 10, 0 );
-    float soft_z_1 = methodArgFloat( L, 11, 0 );
-    float soft_z_2 = methodArgFloat( L, 12, 1 );
-    obj->setCalibration( hard_x, hard_y, hard_z, soft_x_0, soft_x_1, soft_x_2, soft_y_0, soft_y_1, soft_y_2, soft_z_0, soft_z_1, soft_z_2 );
-    return 0;
-}
-
-
-static int setModeHMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::hmc_mode mode = (EVNCompassSensor::hmc_mode)methodArgInt( L, 1 );
-    obj->setModeHMC( mode );
-    return 0;
-}
-
-
-static int setModeQMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::qmc_mode mode = (EVNCompassSensor::qmc_mode)methodArgInt( L, 1 );
-    obj->setModeQMC( mode );
-    return 0;
-}
-
-
-static int setDataRateHMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::hmc_data_rate data_rate = (EVNCompassSensor::hmc_data_rate)methodArgInt( L, 1 );
-    obj->setDataRateHMC( data_rate );
-    return 0;
-}
-
-
-static int setDataRateQMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::qmc_data_rate data_rate = (EVNCompassSensor::qmc_data_rate)methodArgInt( L, 1 );
-    obj->setDataRateQMC( data_rate );
-    return 0;
-}
-
-
-static int setRangeHMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::hmc_range range = (EVNCompassSensor::hmc_range)methodArgInt( L, 1 );
-    obj->setRangeHMC( range );
-    return 0;
-}
-
-
-static int setRangeQMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::qmc_range range = (EVNCompassSensor::qmc_range)methodArgInt( L, 1 );
-    obj->setRangeQMC( range );
-    return 0;
-}
-
-
-static int setSamplesHMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::hmc_samples samples = (EVNCompassSensor::hmc_samples)methodArgInt( L, 1 );
-    obj->setSamplesHMC( samples );
-    return 0;
-}
-
-
-static int setSamplesQMC( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    EVNCompassSensor::qmc_samples samples = (EVNCompassSensor::qmc_samples)methodArgInt( L, 1 );
-    obj->setSamplesQMC( samples );
-    return 0;
-}
-
-
-static int isCalibrated( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    lua_pushboolean( L, obj->isCalibrated() );
-    return 1;
-}
-
-
-static int readRawX( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readRawX( blocking ) );
-    return 1;
-}
-
-
-static int readRawY( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readRawY( blocking ) );
-    return 1;
-}
-
-
-static int readRawZ( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readRawZ( blocking ) );
-    return 1;
-}
-
-
-static int readCalX( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readCalX( blocking ) );
-    return 1;
-}
-
-
-static int readCalY( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readCalY( blocking ) );
-    return 1;
-}
-
-
-static int readCalZ( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->readCalZ( blocking ) );
-    return 1;
-}
-
-
-static int read( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushnumber( L, obj->read( blocking ) );
-    return 1;
-}
-
-
-static int setNorth( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    obj->setNorth();
-    return 0;
-}
-
-
-static int setHeading( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    int heading = methodArgInt( L, 1 );
-    obj->setHeading( heading );
-    return 0;
-}
-
-
-static int setTopAxis( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    int axis = methodArgInt( L, 1 );
-    obj->setTopAxis( axis );
-    return 0;
-}
-
-
-static int setFrontAxis( lua_State *L )
-{
-    EVNCompassSensor *obj = (EVNCompassSensor*)luaL_checkudata( L, 1, "EVNCompassSensor" );
-    int axis = methodArgInt( L, 1 );
-    obj->setFrontAxis( axis );
-    return 0;
-}
-
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "isQMC", isQMC },
-    { "isHMC", isHMC },
-    { "setCalibration", setCalibration },
-    { "setModeHMC", setModeHMC },
-    { "setModeQMC", setModeQMC },
-    { "setDataRateHMC", setDataRateHMC },
-    { "setDataRateQMC", setDataRateQMC },
-    { "setRangeHMC", setRangeHMC },
-    { "setRangeQMC", setRangeQMC },
-    { "setSamplesHMC", setSamplesHMC },
-    { "setSamplesQMC", setSamplesQMC },
-    { "isCalibrated", isCalibrated },
-    { "readRawX", readRawX },
-    { "readRawY", readRawY },
-    { "readRawZ", readRawZ },
-    { "readCalX", readCalX },
-    { "readCalY", readCalY },
-    { "readCalZ", readCalZ },
-    { "read", read },
-    { "setNorth", setNorth },
-    { "setHeading", setHeading },
-    { "setTopAxis", setTopAxis },
-    { "setFrontAxis", setFrontAxis },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNCompassSensor, begin, bool() ),
+    RO_METHOD( "isQMC", EVNCompassSensor, isQMC, bool() ),
+    RO_METHOD( "isHMC", EVNCompassSensor, isHMC, bool() ),
+    RO_METHOD( "setCalibration", EVNCompassSensor, setCalibration, void( float, float, float, float, float, float, float, float, float, float, float, float ), 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1 ),
+    RO_METHOD( "setModeHMC", EVNCompassSensor, setModeHMC, void( EVNCompassSensor::hmc_mode ) ),
+    RO_METHOD( "setModeQMC", EVNCompassSensor, setModeQMC, void( EVNCompassSensor::qmc_mode ) ),
+    RO_METHOD( "setDataRateHMC", EVNCompassSensor, setDataRateHMC, void( EVNCompassSensor::hmc_data_rate ) ),
+    RO_METHOD( "setDataRateQMC", EVNCompassSensor, setDataRateQMC, void( EVNCompassSensor::qmc_data_rate ) ),
+    RO_METHOD( "setRangeHMC", EVNCompassSensor, setRangeHMC, void( EVNCompassSensor::hmc_range ) ),
+    RO_METHOD( "setRangeQMC", EVNCompassSensor, setRangeQMC, void( EVNCompassSensor::qmc_range ) ),
+    RO_METHOD( "setSamplesHMC", EVNCompassSensor, setSamplesHMC, void( EVNCompassSensor::hmc_samples ) ),
+    RO_METHOD( "setSamplesQMC", EVNCompassSensor, setSamplesQMC, void( EVNCompassSensor::qmc_samples ) ),
+    RO_METHOD( "isCalibrated", EVNCompassSensor, isCalibrated, bool() ),
+    RO_METHOD( "readRawX", EVNCompassSensor, readRawX, float( bool ), true ),
+    RO_METHOD( "readRawY", EVNCompassSensor, readRawY, float( bool ), true ),
+    RO_METHOD( "readRawZ", EVNCompassSensor, readRawZ, float( bool ), true ),
+    RO_METHOD( "readCalX", EVNCompassSensor, readCalX, float( bool ), true ),
+    RO_METHOD( "readCalY", EVNCompassSensor, readCalY, float( bool ), true ),
+    RO_METHOD( "readCalZ", EVNCompassSensor, readCalZ, float( bool ), true ),
+    RO_METHOD( "read", EVNCompassSensor, read, float( bool ), true ),
+    RO_METHOD( "setNorth", EVNCompassSensor, setNorth, void() ),
+    RO_METHOD( "setHeading", EVNCompassSensor, setHeading, void( int ) ),
+    RO_METHOD( "setTopAxis", EVNCompassSensor, setTopAxis, void( int ) ),
+    RO_METHOD( "setFrontAxis", EVNCompassSensor, setFrontAxis, void( int ) ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_compass_sensor_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    // Class constants
+    RO_INT( "HMC_CONTINUOUS", (int)EVNCompassSensor::hmc_mode::CONTINUOUS ),
+    RO_INT( "HMC_STANDBY", (int)EVNCompassSensor::hmc_mode::STANDBY ),
+
+    RO_INT( "HMC_HZ_75", (int)EVNCompassSensor::hmc_data_rate::HZ_75 ),
+    RO_INT( "HMC_HZ_30", (int)EVNCompassSensor::hmc_data_rate::HZ_30 ),
+    RO_INT( "HMC_HZ_15", (int)EVNCompassSensor::hmc_data_rate::HZ_15 ),
+    RO_INT( "HMC_HZ_7_5", (int)EVNCompassSensor::hmc_data_rate::HZ_7_5 ),
+    RO_INT( "HMC_HZ_3", (int)EVNCompassSensor::hmc_data_rate::HZ_3 ),
+    RO_INT( "HMC_HZ_1_5", (int)EVNCompassSensor::hmc_data_rate::HZ_1_5 ),
+    RO_INT( "HMC_HZ_0_75", (int)EVNCompassSensor::hmc_data_rate::HZ_0_75 ),
+
+    RO_INT( "HMC_GA_8_1", (int)EVNCompassSensor::hmc_range::GA_8_1 ),
+    RO_INT( "HMC_GA_5_6", (int)EVNCompassSensor::hmc_range::GA_5_6 ),
+    RO_INT( "HMC_GA_4_7", (int)EVNCompassSensor::hmc_range::GA_4_7 ),
+    RO_INT( "HMC_GA_4", (int)EVNCompassSensor::hmc_range::GA_4 ),
+    RO_INT( "HMC_GA_2_5", (int)EVNCompassSensor::hmc_range::GA_2_5 ),
+    RO_INT( "HMC_GA_1_9", (int)EVNCompassSensor::hmc_range::GA_1_9 ),
+    RO_INT( "HMC_GA_1_3", (int)EVNCompassSensor::hmc_range::GA_1_3 ),
+    RO_INT( "HMC_GA_0_88", (int)EVNCompassSensor::hmc_range::GA_0_88 ),
+
+    RO_INT( "HMC_X1", (int)EVNCompassSensor::hmc_samples::X1 ),
+    RO_INT( "HMC_X2", (int)EVNCompassSensor::hmc_samples::X2 ),
+    RO_INT( "HMC_X4", (int)EVNCompassSensor::hmc_samples::X4 ),
+    RO_INT( "HMC_X8", (int)EVNCompassSensor::hmc_samples::X8 ),
+
+
+    RO_INT( "QMC_CONTINUOUS", (int)EVNCompassSensor::qmc_mode::CONTINUOUS ),
+    RO_INT( "QMC_STANDBY", (int)EVNCompassSensor::qmc_mode::STANDBY ),
+
+    RO_INT( "QMC_HZ_10", (int)EVNCompassSensor::qmc_data_rate::HZ_10 ),
+    RO_INT( "QMC_HZ_50", (int)EVNCompassSensor::qmc_data_rate::HZ_50 ),
+    RO_INT( "QMC_HZ_100", (int)EVNCompassSensor::qmc_data_rate::HZ_100 ),
+    RO_INT( "QMC_HZ_200", (int)EVNCompassSensor::qmc_data_rate::HZ_200 ),
+
+    RO_INT( "QMC_GA_8", (int)EVNCompassSensor::qmc_range::GA_8 ),
+    RO_INT( "QMC_GA_2", (int)EVNCompassSensor::qmc_range::GA_2 ),
+
+    RO_INT( "QMC_X64", (int)EVNCompassSensor::qmc_samples::X64 ),
+    RO_INT( "QMC_X128", (int)EVNCompassSensor::qmc_samples::X128 ),
+    RO_INT( "QMC_X256", (int)EVNCompassSensor::qmc_samples::X256 ),
+    RO_INT( "QMC_X512", (int)EVNCompassSensor::qmc_samples::X512 ),
+
+    RO_END
 };
 
 
 void init_evn_compass_sensor( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, EVN_CLASS_NAME );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, LUA_CLASS_NAME );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-    addIntegerConstant( L, "HMC_CONTINUOUS", (int)EVNCompassSensor::hmc_mode::CONTINUOUS );
-    addIntegerConstant( L, "HMC_STANDBY", (int)EVNCompassSensor::hmc_mode::STANDBY );
-
-    addIntegerConstant( L, "HMC_HZ_75", (int)EVNCompassSensor::hmc_data_rate::HZ_75 );
-    addIntegerConstant( L, "HMC_HZ_30", (int)EVNCompassSensor::hmc_data_rate::HZ_30 );
-    addIntegerConstant( L, "HMC_HZ_15", (int)EVNCompassSensor::hmc_data_rate::HZ_15 );
-    addIntegerConstant( L, "HMC_HZ_7_5", (int)EVNCompassSensor::hmc_data_rate::HZ_7_5 );
-    addIntegerConstant( L, "HMC_HZ_3", (int)EVNCompassSensor::hmc_data_rate::HZ_3 );
-    addIntegerConstant( L, "HMC_HZ_1_5", (int)EVNCompassSensor::hmc_data_rate::HZ_1_5 );
-    addIntegerConstant( L, "HMC_HZ_0_75", (int)EVNCompassSensor::hmc_data_rate::HZ_0_75 );
-
-    addIntegerConstant( L, "HMC_GA_8_1", (int)EVNCompassSensor::hmc_range::GA_8_1 );
-    addIntegerConstant( L, "HMC_GA_5_6", (int)EVNCompassSensor::hmc_range::GA_5_6 );
-    addIntegerConstant( L, "HMC_GA_4_7", (int)EVNCompassSensor::hmc_range::GA_4_7 );
-    addIntegerConstant( L, "HMC_GA_4", (int)EVNCompassSensor::hmc_range::GA_4 );
-    addIntegerConstant( L, "HMC_GA_2_5", (int)EVNCompassSensor::hmc_range::GA_2_5 );
-    addIntegerConstant( L, "HMC_GA_1_9", (int)EVNCompassSensor::hmc_range::GA_1_9 );
-    addIntegerConstant( L, "HMC_GA_1_3", (int)EVNCompassSensor::hmc_range::GA_1_3 );
-    addIntegerConstant( L, "HMC_GA_0_88", (int)EVNCompassSensor::hmc_range::GA_0_88 );
-
-    addIntegerConstant( L, "HMC_X1", (int)EVNCompassSensor::hmc_samples::X1 );
-    addIntegerConstant( L, "HMC_X2", (int)EVNCompassSensor::hmc_samples::X2 );
-    addIntegerConstant( L, "HMC_X4", (int)EVNCompassSensor::hmc_samples::X4 );
-    addIntegerConstant( L, "HMC_X8", (int)EVNCompassSensor::hmc_samples::X8 );
-
-
-    addIntegerConstant( L, "QMC_CONTINUOUS", (int)EVNCompassSensor::qmc_mode::CONTINUOUS );
-    addIntegerConstant( L, "QMC_STANDBY", (int)EVNCompassSensor::qmc_mode::STANDBY );
-
-    addIntegerConstant( L, "QMC_HZ_10", (int)EVNCompassSensor::qmc_data_rate::HZ_10 );
-    addIntegerConstant( L, "QMC_HZ_50", (int)EVNCompassSensor::qmc_data_rate::HZ_50 );
-    addIntegerConstant( L, "QMC_HZ_100", (int)EVNCompassSensor::qmc_data_rate::HZ_100 );
-    addIntegerConstant( L, "QMC_HZ_200", (int)EVNCompassSensor::qmc_data_rate::HZ_200 );
-
-    addIntegerConstant( L, "QMC_GA_8", (int)EVNCompassSensor::qmc_range::GA_8 );
-    addIntegerConstant( L, "QMC_GA_2", (int)EVNCompassSensor::qmc_range::GA_2 );
-
-    addIntegerConstant( L, "QMC_X64", (int)EVNCompassSensor::qmc_samples::X64 );
-    addIntegerConstant( L, "QMC_X128", (int)EVNCompassSensor::qmc_samples::X128 );
-    addIntegerConstant( L, "QMC_X256", (int)EVNCompassSensor::qmc_samples::X256 );
-    addIntegerConstant( L, "QMC_X512", (int)EVNCompassSensor::qmc_samples::X512 );
-
-
-    lua_settable( L, -3 );
 }
 
 
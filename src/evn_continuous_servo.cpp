@@ -21,10 +21,15 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_continuous_servo.h"
 
 
+LUA_CLASS( EVNContinuousServo, CLASS_CONTINUOUS_SERVO );
+
+
 static int new_object( lua_State *L );
 
 #define EVN_CLASS           EVNContinuousServo
@@ -32,84 +37,35 @@ static int new_object( lua_State *L );
 #define LUA_CLASS_NAME      "ContinuousServo"
 
 
-
-static int begin( lua_State *L )
-{
-    EVNContinuousServo *obj = (EVNContinuousServo*)luaL_checkudata( L, 1, "EVNContinuousServo" );
-    obj->begin();
-    return 0;
-}
-
-
-static int write( lua_State *L )
-{
-    EVNContinuousServo *obj = (EVNContinuousServo*)luaL_checkudata( L, 1, "EVNContinuousServo" );
-    float duty_cycle_pct = methodArgFloat( L, 1 );
-    obj->write( duty_cycle_pct );
-    return 0;
-}
-
-
-static int writeMicroseconds( lua_State *L )
-{
-    EVNContinuousServo *obj = (EVNContinuousServo*)luaL_checkudata( L, 1, "EVNContinuousServo" );
-    int pulse_us = methodArgInt( L, 1 );
-    obj->writeMicroseconds( pulse_us );
-    return 0;
-}
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "write", write },
-    { "writeMicroseconds", writeMicroseconds },
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNContinuousServo, begin, void() ),
+    RO_METHOD( "write", EVNContinuousServo, write, void( float ) ),
+    RO_METHOD( "writeMicroseconds", EVNContinuousServo, writeMicroseconds, void( int ) ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_continuous_servo_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_continuous_servo( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, EVN_CLASS_NAME );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, LUA_CLASS_NAME );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-
-    lua_settable( L, -3 );
 }
 
 
@@ -21,58 +21,21 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_display.h"
 
 
-static int new_object( lua_State *L );
-
-
-
-static int begin( lua_State *L )
-{
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
-    lua_pushboolean( L, obj->begin() );
-    return 1;
-}
+LUA_CLASS( EVNDisplay, CLASS_DISPLAY );
 
 
-static int splashEVN( lua_State *L )
-{
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
-    obj->splashEVN();
-    return 0;
-}
-
-
-static int rotate( lua_State *L )
-{
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
-    obj->rotate();
-    return 0;
-}
-
-
-static int clear( lua_State *L )
-{
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
-    obj->clear();
-    return 0;
-}
-
-
-static int clearLine( lua_State *L )
-{
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
-    int row = methodArgInt( L, 1 );
-    obj->clearLine( row );
-    return 0;
-}
+static int new_object( lua_State *L );
 
 
 static int writeData( lua_State *L )
 {
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
+    EVNDisplay *obj = (EVNDisplay*)checkObject( L, 1, CLASS_DISPLAY );
     int row = methodArgInt( L, 1 );
     const char *data = methodArgString( L, 2 );
     obj->writeData( row, data );
@@ -82,7 +45,7 @@ static int writeData( lua_State *L )
 
 static int writeLabel( lua_State *L )
 {
-    EVNDisplay *obj = (EVNDisplay*)luaL_checkudata( L, 1, "EVNDisplay" );
+    EVNDisplay *obj = (EVNDisplay*)checkObject( L, 1, CLASS_DISPLAY );
     int row = methodArgInt( L, 1 );
     const char *label = methodArgString( L, 2 );
     obj->writeLabel( row, label );
@@ -90,64 +53,40 @@ static int writeLabel( lua_State *L )
 }
 
 
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "splashEVN", splashEVN },
-    { "rotate", rotate },
-    { "clear", clear },
-    { "clearLine", clearLine },
-    { "writeData", writeData },
-    { "writeLabel", writeLabel },
-    { "print", writeLabel },        // alias
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNDisplay, begin, bool() ),
+    RO_METHOD( "splashEVN", EVNDisplay, splashEVN, void() ),
+    RO_METHOD( "rotate", EVNDisplay, rotate, void() ),
+    RO_METHOD( "clear", EVNDisplay, clear, void() ),
+    RO_METHOD( "clearLine", EVNDisplay, clearLine, void( int ) ),
+    RO_FUNC( "writeData", writeData ),
+    RO_FUNC( "writeLabel", writeLabel ),
+    RO_FUNC( "print", writeLabel ),        // alias
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_display_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_display( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, "EVNDisplay" );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, "Display" );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-
-    lua_settable( L, -3 );
 }
 
 
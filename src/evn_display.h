@@ -15,7 +15,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-struct lua_State;
+#include "rotable.h"
 
 
 void init_evn_display( lua_State *L );
+
+// The class table (evn.Display)
+extern const RoEntry evn_display_class[];
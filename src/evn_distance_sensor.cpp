@@ -21,131 +21,51 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_distance_sensor.h"
 
 
-static int new_object( lua_State *L );
-
-
-
-static int begin( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    lua_pushboolean( L, obj->begin() );
-    return 1;
-}
-
-
-static int setSignalRateLimit( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    float limit = methodArgFloat( L, 1 );
-    obj->setSignalRateLimit( limit );
-    return 0;
-}
+LUA_CLASS( EVNDistanceSensor, CLASS_DISTANCE_SENSOR );
 
 
-static int setPulsePeriodPreRange( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    int period = methodArgInt( L, 1 );
-    obj->setPulsePeriodPreRange( period );
-    return 0;
-}
-
-
-static int setPulsePeriodFinalRange( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    int period = methodArgInt( L, 1 );
-    obj->setPulsePeriodFinalRange( period );
-    return 0;
-}
-
-
-static int setTimingBudget( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    int timing_budget_ms = methodArgInt( L, 1 );
-    obj->setTimingBudget( timing_budget_ms );
-    return 0;
-}
-
-
-static int getTimingBudget( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    lua_pushinteger( L, obj->getTimingBudget() );
-    return 1;
-}
-
-
-static int read( lua_State *L )
-{
-    EVNDistanceSensor *obj = (EVNDistanceSensor*)luaL_checkudata( L, 1, "EVNDistanceSensor" );
-    bool blocking = methodArgBool( L, 1, true );
-    lua_pushinteger( L, obj->read( blocking ) );
-    return 1;
-}
-
+static int new_object( lua_State *L );
 
 
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "setSignalRateLimit", setSignalRateLimit },
-    { "setPulsePeriodPreRange", setPulsePeriodPreRange },
-    { "setPulsePeriodFinalRange", setPulsePeriodFinalRange },
-    { "setTimingBudget", setTimingBudget },
-    { "getTimingBudget", getTimingBudget },
-    { "read", read },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNDistanceSensor, begin, bool() ),
+    RO_METHOD( "setSignalRateLimit", EVNDistanceSensor, setSignalRateLimit, void( float ) ),
+    RO_METHOD( "setPulsePeriodPreRange", EVNDistanceSensor, setPulsePeriodPreRange, void( int ) ),
+    RO_METHOD( "setPulsePeriodFinalRange", EVNDistanceSensor, setPulsePeriodFinalRange, void( int ) ),
+    RO_METHOD( "setTimingBudget", EVNDistanceSensor, setTimingBudget, void( int ) ),
+    RO_METHOD( "getTimingBudget", EVNDistanceSensor, getTimingBudget, int() ),
+    RO_METHOD( "read", EVNDistanceSensor, read, int( bool ), true ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_distance_sensor_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_distance_sensor( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, "EVNDistanceSensor" );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, "DistanceSensor" );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-
-    lua_settable( L, -3 );
 }
 
 
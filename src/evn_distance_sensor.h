@@ -15,7 +15,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-struct lua_State;
+#include "rotable.h"
 
 
 void init_evn_distance_sensor( lua_State *L );
+
+// The class table (evn.DistanceSensor)
+extern const RoEntry evn_distance_sensor_class[];
@@ -21,394 +21,204 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
+#include "lua_tasks.h"
 
 #include "evn_drivebase.h"
 
 
+LUA_CLASS( EVNDrivebase, CLASS_DRIVEBASE );
+
+
 static int new_object( lua_State *L );
 
+static bool motionDone( void *obj );
+static int motionFinished( lua_State *L, int status, lua_KContext ctx );
+
 #define EVN_CLASS           EVNDrivebase
 #define EVN_CLASS_NAME      "EVNDrivebase"
 #define LUA_CLASS_NAME      "Drivebase"
 
 
+//
+// The Await variants start the motion without waiting, then suspend the calling task until
+// the drivebase completes it. (Called from anywhere but a task, they raise an error before
+// starting the motion.)
+//
 
-static int begin( lua_State *L )
+static int straightAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    obj->begin();
-    return 0;
-}
-
-
-static int drivePct( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed_outer_pct = methodArgFloat( L, 1 );
-    float turn_rate_pct = methodArgFloat( L, 2 );
-    obj->drivePct( speed_outer_pct, turn_rate_pct );
-    return 0;
-}
-
+    checkTask( L );
 
-static int drive( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed = methodArgFloat( L, 1 );
-    float turn_rate = methodArgFloat( L, 2 );
-    obj->drive( speed, turn_rate );
-    return 0;
-}
-
-
-static int driveTurnRate( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed = methodArgFloat( L, 1 );
-    float turn_rate = methodArgFloat( L, 2 );
-    obj->driveTurnRate( speed, turn_rate );
-    return 0;
-}
-
-
-static int driveRadius( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed = methodArgFloat( L, 1 );
-    float radius = methodArgFloat( L, 2 );
-    obj->driveRadius( speed, radius );
-    return 0;
-}
-
-
-static int straight( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float speed = methodArgFloat( L, 1 );
     float distance = methodArgFloat( L, 2 );
     int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->straight( speed, distance, stop_action, wait );
-    return 0;
+    obj->straight( speed, distance, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int curve( lua_State *L )
+static int curveAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    checkTask( L );
+
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float speed = methodArgFloat( L, 1 );
     float radius = methodArgFloat( L, 2 );
     float angle = methodArgFloat( L, 3 );
     int stop_action = methodArgInt( L, 4, STOP_BRAKE );
-    bool wait = methodArgBool( L, 5, true );
-    obj->curve( speed, radius, angle, stop_action, wait );
-    return 0;
+    obj->curve( speed, radius, angle, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int curveRadius( lua_State *L )
+static int curveRadiusAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    checkTask( L );
+
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float speed = methodArgFloat( L, 1 );
     float radius = methodArgFloat( L, 2 );
     float angle = methodArgFloat( L, 3 );
     int stop_action = methodArgInt( L, 4, STOP_BRAKE );
-    bool wait = methodArgBool( L, 5, true );
-    obj->curveRadius( speed, radius, angle, stop_action, wait );
-    return 0;
+    obj->curveRadius( speed, radius, angle, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int curveTurnRate( lua_State *L )
+static int curveTurnRateAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    checkTask( L );
+
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float speed = methodArgFloat( L, 1 );
     float turn_rate = methodArgFloat( L, 2 );
     float angle = methodArgFloat( L, 3 );
     int stop_action = methodArgInt( L, 4, STOP_BRAKE );
-    bool wait = methodArgBool( L, 5, true );
-    obj->curveTurnRate( speed, turn_rate, angle, stop_action, wait );
-    return 0;
+    obj->curveTurnRate( speed, turn_rate, angle, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int turn( lua_State *L )
+static int turnAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    checkTask( L );
+
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float turn_rate = methodArgFloat( L, 1 );
     float degrees = methodArgFloat( L, 2 );
     int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->turn( turn_rate, degrees, stop_action, wait );
-    return 0;
+    obj->turn( turn_rate, degrees, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int turnDegrees( lua_State *L )
+static int turnDegreesAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    checkTask( L );
+
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float turn_rate = methodArgFloat( L, 1 );
     float degrees = methodArgFloat( L, 2 );
     int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->turnDegrees( turn_rate, degrees, stop_action, wait );
-    return 0;
+    obj->turnDegrees( turn_rate, degrees, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int turnHeading( lua_State *L )
+static int turnHeadingAwait( lua_State *L )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
+    checkTask( L );
+
+    EVNDrivebase *obj = (EVNDrivebase*)checkObject( L, 1, CLASS_DRIVEBASE );
     float turn_rate = methodArgFloat( L, 1 );
     float heading = methodArgFloat( L, 2 );
     int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->turnHeading( turn_rate, heading, stop_action, wait );
-    return 0;
-}
-
-
-static int driveToXY( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed = methodArgFloat( L, 1 );
-    float turn_rate = methodArgFloat( L, 2 );
-    float x = methodArgFloat( L, 3 );
-    float y = methodArgFloat( L, 4 );
-    int stop_action = methodArgInt( L, 5, STOP_BRAKE );
-    bool restore_initial_heading = methodArgBool( L, 6, true );
-    obj->driveToXY( speed, turn_rate, x, y, stop_action, restore_initial_heading );
-    return 0;
-}
-
-
-static int stop( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    obj->stop();
-    return 0;
-}
-
-
-static int coast( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    obj->coast();
-    return 0;
-}
-
-
-static int hold( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    obj->hold();
-    return 0;
-}
-
-
-static int completed( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    lua_pushboolean( L, obj->completed() );
-    return 1;
-}
-
-
-static int setSpeedPID( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float kp = methodArgFloat( L, 1 );
-    float ki = methodArgFloat( L, 2 );
-    float kd = methodArgFloat( L, 3 );
-    obj->setSpeedPID( kp, ki, kd );
-    return 0;
+    obj->turnHeading( turn_rate, heading, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int setTurnRatePID( lua_State *L )
+static bool motionDone( void *obj )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float kp = methodArgFloat( L, 1 );
-    float ki = methodArgFloat( L, 2 );
-    float kd = methodArgFloat( L, 3 );
-    obj->setTurnRatePID( kp, ki, kd );
-    return 0;
+    return ((EVNDrivebase*)obj)->completed();
 }
 
 
-static int setSpeedAccel( lua_State *L )
+static int motionFinished( lua_State *L, int status, lua_KContext ctx )
 {
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed_accel = methodArgFloat( L, 1 );
-    obj->setSpeedAccel( speed_accel );
+    (void)L;
+    (void)status;
+    (void)ctx;
     return 0;
 }
 
 
-static int setSpeedDecel( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float speed_decel = methodArgFloat( L, 1 );
-    obj->setSpeedDecel( speed_decel );
-    return 0;
-}
-
-
-static int setTurnRateAccel( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float turn_rate_accel = methodArgFloat( L, 1 );
-    obj->setTurnRateAccel( turn_rate_accel );
-    return 0;
-}
-
-
-static int setTurnRateDecel( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float turn_rate_decel = methodArgFloat( L, 1 );
-    obj->setTurnRateDecel( turn_rate_decel );
-    return 0;
-}
-
-
-static int getDistance( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    lua_pushnumber( L, obj->getDistance() );
-    return 1;
-}
-
-
-static int getAngle( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    lua_pushnumber( L, obj->getAngle() );
-    return 1;
-}
-
-
-static int getHeading( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    lua_pushnumber( L, obj->getHeading() );
-    return 1;
-}
-
-
-static int getX( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    lua_pushnumber( L, obj->getX() );
-    return 1;
-}
-
-
-static int getY( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    lua_pushnumber( L, obj->getY() );
-    return 1;
-}
-
-
-static int resetXY( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    obj->resetXY();
-    return 0;
-}
-
-
-static int getDistanceToPoint( lua_State *L )
-{
-    EVNDrivebase *obj = (EVNDrivebase*)luaL_checkudata( L, 1, "EVNDrivebase" );
-    float x = methodArgFloat( L, 1 );
-    float y = methodArgFloat( L, 2 );
-    lua_pushnumber( L, obj->getDistanceToPoint( x, y ) );
-    return 1;
-}
-
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "drivePct", drivePct },
-    { "drive", drive },
-    { "driveTurnRate", driveTurnRate },
-    { "driveRadius", driveRadius },
-    { "straight", straight },
-    { "curve", curve },
-    { "curveRadius", curveRadius },
-    { "curveTurnRate", curveTurnRate },
-    { "turn", turn },
-    { "turnDegrees", turnDegrees },
-    { "turnHeading", turnHeading },
-    { "driveToXY", driveToXY },
-    { "stop", stop },
-    { "coast", coast },
-    { "hold", hold },
-    { "completed", completed },
-    { "setSpeedPID", setSpeedPID },
-    { "setTurnRatePID", setTurnRatePID },
-    { "setSpeedAccel", setSpeedAccel },
-    { "setSpeedDecel", setSpeedDecel },
-    { "setTurnRateAccel", setTurnRateAccel },
-    { "setTurnRateDecel", setTurnRateDecel },
-    { "getDistance", getDistance },
-    { "getAngle", getAngle },
-    { "getHeading", getHeading },
-    { "getX", getX },
-    { "getY", getY },
-    { "resetXY", resetXY },
-    { "getDistanceToPoint", getDistanceToPoint },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNDrivebase, begin, void() ),
+    RO_METHOD( "drivePct", EVNDrivebase, drivePct, void( float, float ) ),
+    RO_METHOD( "drive", EVNDrivebase, drive, void( float, float ) ),
+    RO_METHOD( "driveTurnRate", EVNDrivebase, driveTurnRate, void( float, float ) ),
+    RO_METHOD( "driveRadius", EVNDrivebase, driveRadius, void( float, float ) ),
+    RO_METHOD( "straight", EVNDrivebase, straight, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "curve", EVNDrivebase, curve, void( float, float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "curveRadius", EVNDrivebase, curveRadius, void( float, float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "curveTurnRate", EVNDrivebase, curveTurnRate, void( float, float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "turn", EVNDrivebase, turn, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "turnDegrees", EVNDrivebase, turnDegrees, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "turnHeading", EVNDrivebase, turnHeading, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_FUNC( "straightAwait", straightAwait ),
+    RO_FUNC( "curveAwait", curveAwait ),
+    RO_FUNC( "curveRadiusAwait", curveRadiusAwait ),
+    RO_FUNC( "curveTurnRateAwait", curveTurnRateAwait ),
+    RO_FUNC( "turnAwait", turnAwait ),
+    RO_FUNC( "turnDegreesAwait", turnDegreesAwait ),
+    RO_FUNC( "turnHeadingAwait", turnHeadingAwait ),
+    RO_METHOD( "driveToXY", EVNDrivebase, driveToXY, void( float, float, float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "stop", EVNDrivebase, stop, void() ),
+    RO_METHOD( "coast", EVNDrivebase, coast, void() ),
+    RO_METHOD( "hold", EVNDrivebase, hold, void() ),
+    RO_METHOD( "completed", EVNDrivebase, completed, bool() ),
+    RO_METHOD( "setSpeedPID", EVNDrivebase, setSpeedPID, void( float, float, float ) ),
+    RO_METHOD( "setTurnRatePID", EVNDrivebase, setTurnRatePID, void( float, float, float ) ),
+    RO_METHOD( "setSpeedAccel", EVNDrivebase, setSpeedAccel, void( float ) ),
+    RO_METHOD( "setSpeedDecel", EVNDrivebase, setSpeedDecel, void( float ) ),
+    RO_METHOD( "setTurnRateAccel", EVNDrivebase, setTurnRateAccel, void( float ) ),
+    RO_METHOD( "setTurnRateDecel", EVNDrivebase, setTurnRateDecel, void( float ) ),
+    RO_METHOD( "getDistance", EVNDrivebase, getDistance, float() ),
+    RO_METHOD( "getAngle", EVNDrivebase, getAngle, float() ),
+    RO_METHOD( "getHeading", EVNDrivebase, getHeading, float() ),
+    RO_METHOD( "getX", EVNDrivebase, getX, float() ),
+    RO_METHOD( "getY", EVNDrivebase, getY, float() ),
+    RO_METHOD( "resetXY", EVNDrivebase, resetXY, void() ),
+    RO_METHOD( "getDistanceToPoint", EVNDrivebase, getDistanceToPoint, float( float, float ) ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_drivebase_class[] = {
+    RO_FUNC( "new", new_object ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_drivebase( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, EVN_CLASS_NAME );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, LUA_CLASS_NAME );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-
-    lua_settable( L, -3 );
 }
 
 
@@ -416,8 +226,8 @@ static int new_object( lua_State *L )
 {
     float wheel_dia = functionArgFloat( L, 1 );
     float axle_track = functionArgFloat( L, 2 );
-    EVNMotor *motor_left = (EVNMotor*)luaL_checkudata( L, 3, "EVNMotor" );
-    EVNMotor *motor_right = (EVNMotor*)luaL_checkudata( L, 4, "EVNMotor" );
+    EVNMotor *motor_left = (EVNMotor*)checkObject( L, 3, CLASS_MOTOR );
+    EVNMotor *motor_right = (EVNMotor*)checkObject( L, 4, CLASS_MOTOR );
 
     void *rp = lua_newuserdata( L, sizeof(EVN_CLASS) );
     // ud --
@@ -21,286 +21,162 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
+#include "lua_tasks.h"
 
 #include "evn_motor.h"
 
 
-
-static int new_object( lua_State *L );
-
-
-
-static int begin( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    obj->begin();
-    return 0;
-}
-
-
-static int getPosition( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    lua_pushnumber( L, obj->getPosition() );
-    return 1;
-}
-
-
-static int getHeading( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    lua_pushnumber( L, obj->getHeading() );
-    return 1;
-}
-
-
-static int resetPosition( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    obj->resetPosition();
-    return 0;
-}
+LUA_CLASS( EVNMotor, CLASS_MOTOR );
 
 
-static int getSpeed( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    lua_pushnumber( L, obj->getSpeed() );
-    return 1;
-}
+static int new_object( lua_State *L );
 
+static bool motionDone( void *obj );
+static int motionFinished( lua_State *L, int status, lua_KContext ctx );
 
-static int runPWM( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    float duty_cycle_pct = methodArgFloat( L, 1 );
-    obj->runPWM( duty_cycle_pct );
-    return 0;
-}
 
+//
+// The Await variants start the motion without waiting, then suspend the calling task until
+// the motor completes or stalls. They return true if the motion completed.
+// (Called from anywhere but a task, they raise an error before starting the motion.)
+//
 
-static int runSpeed( lua_State *L )
+static int runPositionAwait( lua_State *L )
 {
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    float dps = methodArgFloat( L, 1 );
-    obj->runSpeed( dps );
-    return 0;
-}
+    checkTask( L );
 
-
-static int runPosition( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
+    EVNMotor *obj = (EVNMotor*)checkObject( L, 1, CLASS_MOTOR );
     float dps = methodArgFloat( L, 1 );
     float position = methodArgFloat( L, 2 );
-    static int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->runPosition( dps, position, stop_action, wait );
-    return 0;
+    int stop_action = methodArgInt( L, 3, STOP_BRAKE );
+    obj->runPosition( dps, position, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int runAngle( lua_State *L )
+static int runAngleAwait( lua_State *L )
 {
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
+    checkTask( L );
+
+    EVNMotor *obj = (EVNMotor*)checkObject( L, 1, CLASS_MOTOR );
     float dps = methodArgFloat( L, 1 );
     float degrees = methodArgFloat( L, 2 );
-    static int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->runAngle( dps, degrees, stop_action, wait );
-    return 0;
+    int stop_action = methodArgInt( L, 3, STOP_BRAKE );
+    obj->runAngle( dps, degrees, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int runHeading( lua_State *L )
+static int runHeadingAwait( lua_State *L )
 {
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
+    checkTask( L );
+
+    EVNMotor *obj = (EVNMotor*)checkObject( L, 1, CLASS_MOTOR );
     float dps = methodArgFloat( L, 1 );
     float heading = methodArgFloat( L, 2 );
     int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->runHeading( dps, heading, stop_action, wait );
-    return 0;
+    obj->runHeading( dps, heading, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-static int runTime( lua_State *L )
+static int runTimeAwait( lua_State *L )
 {
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
+    checkTask( L );
+
+    EVNMotor *obj = (EVNMotor*)checkObject( L, 1, CLASS_MOTOR );
     float dps = methodArgFloat( L, 1 );
     lua_Number time_ms = methodArgNumber( L, 2 );
     int stop_action = methodArgInt( L, 3, STOP_BRAKE );
-    bool wait = methodArgBool( L, 4, true );
-    obj->runTime( dps, time_ms, stop_action, wait );
-    return 0;
+    obj->runTime( dps, time_ms, stop_action, false );
+    return taskAwait( L, motionDone, obj, motionFinished );
 }
 
 
-int stop( lua_State *L )
+static bool motionDone( void *obj )
 {
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    obj->stop();
-    return 0;
+    EVNMotor *motor = (EVNMotor*)obj;
+    return motor->completed() || motor->stalled();
 }
 
 
-static int coast( lua_State *L )
+static int motionFinished( lua_State *L, int status, lua_KContext ctx )
 {
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    obj->coast();
-    return 0;
-}
-
-
-static int hold( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    obj->hold();
-    return 0;
-}
+    (void)status;
+    (void)ctx;
 
-
-static int completed( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
+    // The motor is still at stack index 1.
+    EVNMotor *obj = (EVNMotor*)lua_touserdata( L, 1 );
     lua_pushboolean( L, obj->completed() );
     return 1;
 }
 
 
-static int stalled( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    lua_pushboolean( L, obj->stalled() );
-    return 1;
-}
-
-
-static int setPID( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    float p = methodArgFloat( L, 1 );
-    float i = methodArgFloat( L, 2 );
-    float d = methodArgFloat( L, 3 );
-    obj->setPID( p, i, d );
-    return 0;
-}
-
-
-static int setAccel( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    float accel_dps_sq = methodArgFloat( L, 1 );
-    obj->setAccel( accel_dps_sq );
-    return 0;
-}
-
-
-static int setDecel( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    float decel_dps_sq = methodArgFloat( L, 1 );
-    obj->setDecel( decel_dps_sq );
-    return 0;
-}
-
-
-static int setMaxRPM( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    float max_rpm = methodArgFloat( L, 1 );
-    obj->setMaxRPM( max_rpm );
-    return 0;
-}
-
-
-static int setPPR( lua_State *L )
-{
-    EVNMotor *obj = (EVNMotor*)luaL_checkudata( L, 1, "EVNMotor" );
-    lua_Number ppr = methodArgNumber( L, 1 );
-    obj->setPPR( ppr );
-    return 0;
-}
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "getPosition", getPosition },
-    { "getHeading", getHeading },
-    { "resetPosition", resetPosition },
-    { "getSpeed", getSpeed },
-    { "runPWM", runPWM },
-    { "runSpeed", runSpeed },
-    { "runPosition", runPosition },
-    { "runAngle", runAngle },
-    { "runHeading", runHeading },
-    { "runTime", runTime },
-    { "stop", stop },
-    { "coast", coast },
-    { "hold", hold },
-    { "completed", completed },
-    { "stalled", stalled },
-    { "setPID", setPID },
-    { "setAccel", setAccel },
-    { "setDecel", setDecel },
-    { "setMaxRPM", setMaxRPM },
-    { "setPPR", setPPR },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNMotor, begin, void() ),
+    RO_METHOD( "getPosition", EVNMotor, getPosition, float() ),
+    RO_METHOD( "getHeading", EVNMotor, getHeading, float() ),
+    RO_METHOD( "resetPosition", EVNMotor, resetPosition, void() ),
+    RO_METHOD( "getSpeed", EVNMotor, getSpeed, float() ),
+    RO_METHOD( "runPWM", EVNMotor, runPWM, void( float ) ),
+    RO_METHOD( "runSpeed", EVNMotor, runSpeed, void( float ) ),
+    RO_METHOD( "runPosition", EVNMotor, runPosition, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "runAngle", EVNMotor, runAngle, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "runHeading", EVNMotor, runHeading, void( float, float, int, bool ), STOP_BRAKE, true ),
+    RO_METHOD( "runTime", EVNMotor, runTime, void( float, lua_Number, int, bool ), STOP_BRAKE, true ),
+    RO_FUNC( "runPositionAwait", runPositionAwait ),
+    RO_FUNC( "runAngleAwait", runAngleAwait ),
+    RO_FUNC( "runHeadingAwait", runHeadingAwait ),
+    RO_FUNC( "runTimeAwait", runTimeAwait ),
+    RO_METHOD( "stop", EVNMotor, stop, void() ),
+    RO_METHOD( "coast", EVNMotor, coast, void() ),
+    RO_METHOD( "hold", EVNMotor, hold, void() ),
+    RO_METHOD( "completed", EVNMotor, completed, bool() ),
+    RO_METHOD( "stalled", EVNMotor, stalled, bool() ),
+    RO_METHOD( "setPID", EVNMotor, setPID, void( float, float, float ) ),
+    RO_METHOD( "setAccel", EVNMotor, setAccel, void( float ) ),
+    RO_METHOD( "setDecel", EVNMotor, setDecel, void( float ) ),
+    RO_METHOD( "setMaxRPM", EVNMotor, setMaxRPM, void( float ) ),
+    RO_METHOD( "setPPR", EVNMotor, setPPR, void( lua_Number ) ),
+
+    RO_END
 };
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_motor_class[] = {
+    RO_FUNC( "new", new_object ),
+
+    // Class constants
+    RO_INT( "STOP_BRAKE", STOP_BRAKE ),
+    RO_INT( "STOP_COAST", STOP_COAST ),
+    RO_INT( "STOP_HOLD", STOP_HOLD ),
+
+    RO_INT( "EV3_LARGE", EV3_LARGE ),
+    RO_INT( "EV3_MED", EV3_MED ),
+    RO_INT( "NXT_LARGE", NXT_LARGE ),
+    RO_INT( "CUSTOM_MOTOR", CUSTOM_MOTOR ),
+
+    RO_INT( "DIRECT", DIRECT ),
+    RO_INT( "REVERSE", REVERSE ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_motor( lua_State *L )
 {
-    //
-    // Motor Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, "EVNMotor" );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-    //
-    // Motor class
-    //
-
-    // The object table
-    lua_pushstring( L, "Motor" );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-    addIntegerConstant( L, "STOP_BRAKE", STOP_BRAKE );
-    addIntegerConstant( L, "STOP_COAST", STOP_COAST );
-    addIntegerConstant( L, "STOP_HOLD", STOP_HOLD );
-
-    addIntegerConstant( L, "EV3_LARGE", EV3_LARGE );
-    addIntegerConstant( L, "EV3_MED", EV3_MED );
-    addIntegerConstant( L, "NXT_LARGE", NXT_LARGE );
-    addIntegerConstant( L, "CUSTOM_MOTOR", CUSTOM_MOTOR );
-
-    addIntegerConstant( L, "DIRECT", DIRECT );
-    addIntegerConstant( L, "REVERSE", REVERSE );
-
-    lua_settable( L, -3 );
 }
 
 
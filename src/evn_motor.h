@@ -15,7 +15,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-struct lua_State;
+#include "rotable.h"
 
 
 void init_evn_motor( lua_State *L );
+
+// The class table (evn.Motor)
+extern const RoEntry evn_motor_class[];
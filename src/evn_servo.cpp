@@ -21,114 +21,53 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_servo.h"
 
 
-static int new_object( lua_State *L );
-
-
-
-static int begin( lua_State *L )
-{
-    EVNServo *obj = (EVNServo*)luaL_checkudata( L, 1, "EVNServo" );
-    obj->begin();
-    return 0;
-}
-
-
-static int write( lua_State *L )
-{
-    EVNServo *obj = (EVNServo*)luaL_checkudata( L, 1, "EVNServo" );
-    float position = methodArgFloat( L, 1 );
-    int wait_time_ms = methodArgInt( L, 2, 0 );
-    float dps = methodArgFloat( L, 3, 0 );
-    obj->write( position, wait_time_ms, dps );
-    return 0;
-}
-
-
-static int writeMicroseconds( lua_State *L )
-{
-    EVNServo *obj = (EVNServo*)luaL_checkudata( L, 1, "EVNServo" );
-    int pulse_us = methodArgInt( L, 1 );
-    int wait_time_ms = methodArgInt( L, 2, 0 );
-    obj->writeMicroseconds( pulse_us, wait_time_ms );
-    return 0;
-}
-
-
-static int getRange( lua_State *L )
-{
-    EVNServo *obj = (EVNServo*)luaL_checkudata( L, 1, "EVNServo" );
-    lua_pushinteger( L, obj->getRange() );
-    return 1;
-}
+LUA_CLASS( EVNServo, CLASS_SERVO );
 
 
-static int getMaxDPS( lua_State *L )
-{
-    EVNServo *obj = (EVNServo*)luaL_checkudata( L, 1, "EVNServo" );
-    lua_pushnumber( L, obj->getMaxDPS() );
-    return 1;
-}
+static int new_object( lua_State *L );
 
 
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "write", write },
-    { "writeMicroseconds", writeMicroseconds },
-    { "getRange", getRange },
-    { "getMaxDPS", getMaxDPS },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNServo, begin, void() ),
+    RO_METHOD( "write", EVNServo, write, void( float, int, float ), 0, 0 ),
+    RO_METHOD( "writeMicroseconds", EVNServo, writeMicroseconds, void( int, int ), 0 ),
+    RO_METHOD( "getRange", EVNServo, getRange, int() ),
+    RO_METHOD( "getMaxDPS", EVNServo, getMaxDPS, float() ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_servo_class[] = {
+    RO_FUNC( "new", new_object ),
+
+    // Class constants
+    RO_INT( "DIRECT", DIRECT ),
+    RO_INT( "REVERSE", REVERSE ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_servo( lua_State *L )
 {
-    //
-    // Servo Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, "EVNServo" );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Servo class
-    //
-
-    // The object table
-    lua_pushstring( L, "Servo" );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-    addIntegerConstant( L, "DIRECT", DIRECT );
-    addIntegerConstant( L, "REVERSE", REVERSE );
-
-    lua_settable( L, -3 );
 }
 
 
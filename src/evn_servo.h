@@ -15,7 +15,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-struct lua_State;
+#include "rotable.h"
 
 
 void init_evn_servo( lua_State *L );
+
+// The class table (evn.Servo)
+extern const RoEntry evn_servo_class[];
@@ -21,10 +21,15 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
+#include "lua_bind.h"
 
 #include "evn_sevensegment_led.h"
 
 
+LUA_CLASS( EVNSevenSegmentLED, CLASS_SEVENSEGMENT_LED );
+
+
 static int new_object( lua_State *L );
 
 #define EVN_CLASS           EVNSevenSegmentLED
@@ -32,100 +37,9 @@ static int new_object( lua_State *L );
 #define LUA_CLASS_NAME      "SevenSegmentLED"
 
 
-
-static int begin( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    lua_pushboolean( L, obj->begin() );
-    return 1;
-}
-
-
-static int setDisplayMode( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    EVN_HT16K33::mode mode = (EVN_HT16K33::mode)methodArgInt( L, 1 );
-    obj->setDisplayMode( mode );
-    return 0;
-}
-
-
-static int setBrightness( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    int brightness = methodArgInt( L, 1 );
-    obj->setBrightness( brightness );
-    return 0;
-}
-
-
-static int getBrightness( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    lua_pushinteger( L, obj->getBrightness() );
-    return 1;
-}
-
-
-static int getMode( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    lua_pushinteger( L, obj->getMode() );
-    return 1;
-}
-
-
-static int writeRaw( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    int led = methodArgInt( L, 1 );
-    bool on = methodArgBool( L, 2 );
-    bool show = methodArgBool( L, 3, true );
-    obj->writeRaw( led, on, show );
-    return 0;
-}
-
-
-static int clearAll( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    bool show = methodArgBool( L, 1, true );
-    obj->clearAll( show );
-    return 0;
-}
-
-
-static int writeAll( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    bool show = methodArgBool( L, 1, true );
-    obj->writeAll( show );
-    return 0;
-}
-
-
-static int update( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    obj->update();
-    return 0;
-}
-
-
-static int writeDigit( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    int position = methodArgInt( L, 1 );
-    int digit = methodArgInt( L, 2 );
-    bool show = methodArgBool( L, 3, true );
-    obj->writeDigit( position, digit, show );
-    return 0;
-}
-
-
 static int writeLetter( lua_State *L )
 {
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
+    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)checkObject( L, 1, CLASS_SEVENSEGMENT_LED );
     int position = methodArgInt( L, 1 );
     const char *letter = methodArgString( L, 2 );
     bool show = methodArgBool( L, 3, true );
@@ -134,138 +48,56 @@ static int writeLetter( lua_State *L )
 }
 
 
-static int clearPosition( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    int position = methodArgInt( L, 1 );
-    bool clear_point = methodArgBool( L, 2, true );
-    bool show = methodArgBool( L, 3, true );
-    obj->clearPosition( position, clear_point, show );
-    return 0;
-}
-
-
-static int writePoint( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    int position = methodArgInt( L, 1 );
-    bool on = methodArgBool( L, 2, true );
-    bool show = methodArgBool( L, 3, true );
-    obj->writePoint( position, on, show );
-    return 0;
-}
-
-
-static int clearPoint( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    int position = methodArgInt( L, 1 );
-    bool show = methodArgBool( L, 2, true );
-    obj->clearPoint( position, show );
-    return 0;
-}
-
-
-static int writeColon( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    bool on = methodArgBool( L, 1, true );
-    bool show = methodArgBool( L, 2, true );
-    obj->writeColon( on, show );
-    return 0;
-}
-
-
-static int clearColon( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    bool show = methodArgBool( L, 1, true );
-    obj->clearColon( show );
-    return 0;
-}
-
-
-static int writeNumber( lua_State *L )
-{
-    EVNSevenSegmentLED *obj = (EVNSevenSegmentLED*)luaL_checkudata( L, 1, "EVNSevenSegmentLED" );
-    lua_Number number = methodArgNumber( L, 1 );
-    bool show = methodArgBool( L, 2, true );
-    obj->writeNumber( number, show );
-    return 0;
-}
-
-
-
 //==============================================================================================================
 
 // Object methods
-static const luaL_Reg methods[] = {
-    { "begin", begin },
-    { "setDisplayMode", setDisplayMode },
-    { "setBrightness", setBrightness },
-    { "getBrightness", getBrightness },
-    { "getMode", getMode },
-    { "writeRaw", writeRaw },
-    { "clearAll", clearAll },
-    { "writeAll", writeAll },
-    { "update", update },
-    { "writeDigit", writeDigit },
-    { "writeLetter", writeLetter },
-    { "clearPosition", clearPosition },
-    { "writePoint", writePoint },
-    { "clearPoint", clearPoint },
-    { "writeColon", writeColon },
-    { "clearColon", clearColon },
-    { "writeNumber", writeNumber },
-
-    { NULL, NULL }
+static const RoEntry methods[] = {
+    RO_METHOD( "begin", EVNSevenSegmentLED, begin, bool() ),
+    RO_METHOD( "setDisplayMode", EVNSevenSegmentLED, setDisplayMode, void( EVN_HT16K33::mode ) ),
+    RO_METHOD( "setBrightness", EVNSevenSegmentLED, setBrightness, void( int ) ),
+    RO_METHOD( "getBrightness", EVNSevenSegmentLED, getBrightness, int() ),
+    RO_METHOD( "getMode", EVNSevenSegmentLED, getMode, int() ),
+    RO_METHOD( "writeRaw", EVNSevenSegmentLED, writeRaw, void( int, bool, bool ), true ),
+    RO_METHOD( "clearAll", EVNSevenSegmentLED, clearAll, void( bool ), true ),
+    RO_METHOD( "writeAll", EVNSevenSegmentLED, writeAll, void( bool ), true ),
+    RO_METHOD( "update", EVNSevenSegmentLED, update, void() ),
+    RO_METHOD( "writeDigit", EVNSevenSegmentLED, writeDigit, void( int, int, bool ), true ),
+    RO_FUNC( "writeLetter", writeLetter ),
+    RO_METHOD( "clearPosition", EVNSevenSegmentLED, clearPosition, void( int, bool, bool ), true, true ),
+    RO_METHOD( "writePoint", EVNSevenSegmentLED, writePoint, void( int, bool, bool ), true, true ),
+    RO_METHOD( "clearPoint", EVNSevenSegmentLED, clearPoint, void( int, bool ), true ),
+    RO_METHOD( "writeColon", EVNSevenSegmentLED, writeColon, void( bool, bool ), true, true ),
+    RO_METHOD( "clearColon", EVNSevenSegmentLED, clearColon, void( bool ), true ),
+    RO_METHOD( "writeNumber", EVNSevenSegmentLED, writeNumber, void( lua_Number, bool ), true ),
+
+    RO_END
 };
 
 
-// Class methods
-static const luaL_Reg funcs[] = {
-    { "new", new_object },
+// Class functions and constants
+const RoEntry evn_sevensegment_led_class[] = {
+    RO_FUNC( "new", new_object ),
+
+    // Class constants
+    RO_INT( "OFF", EVN_HT16K33::OFF ),
+    RO_INT( "ON", EVN_HT16K33::ON ),
+    RO_INT( "BLINK_HZ_2", EVN_HT16K33::BLINK_HZ_2 ),
+    RO_INT( "BLINK_HZ_1", EVN_HT16K33::BLINK_HZ_1 ),
+    RO_INT( "BLINK_HZ_0_5", EVN_HT16K33::BLINK_HZ_0_5 ),
 
-    { NULL, NULL }
+    RO_END
 };
 
 
 void init_evn_sevensegment_led( lua_State *L )
 {
-    //
-    // Objects
-    //
-
     // Create metatable
     luaL_newmetatable( L, EVN_CLASS_NAME );
 
-    // metatable.__index = metatable
-    lua_pushvalue( L, -1 );        // dup mt
-    lua_setfield( L, -2, "__index" );
-
-    luaL_setfuncs( L, methods, 0 );
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, methods );
 
     lua_pop( L, 1 );
-
-
-    //
-    // Class
-    //
-
-    // The object table
-    lua_pushstring( L, LUA_CLASS_NAME );
-
-    lua_newtable( L );
-    luaL_setfuncs( L, funcs, 0 );
-
-    // Class constants
-    addIntegerConstant( L, "OFF", EVN_HT16K33::OFF );
-    addIntegerConstant( L, "ON", EVN_HT16K33::ON );
-    addIntegerConstant( L, "BLINK_HZ_2", EVN_HT16K33::BLINK_HZ_2 );
-    addIntegerConstant( L, "BLINK_HZ_1", EVN_HT16K33::BLINK_HZ_1 );
-    addIntegerConstant( L, "BLINK_HZ_0_5", EVN_HT16K33::BLINK_HZ_0_5 );
-
-    lua_settable( L, -3 );
 }
 
 
@@ -0,0 +1,69 @@
+// file_reader.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#include "lua_support.h"
+#include "file_reader.h"
+
+
+// The state of one loadFileChunk(). It's on the caller's stack, so loads on the two cores
+// (or a load started by a finalizer during another) don't share a buffer.
+struct FileReader {
+    File *file;
+    char buffer[FILE_READER_BUFFER_SIZE];
+};
+
+
+static const char *readChunk( lua_State *L, void *ud, size_t *size );
+
+
+
+int loadFileChunk( lua_State *L, File &file, const char *chunkname, const char *mode )
+{
+    FileReader reader;
+    reader.file = &file;
+
+    return lua_load( L, readChunk, &reader, chunkname, mode );
+}
+
+
+//==================================================================================
+
+// lua_Reader for lua_load()
+static const char *readChunk( lua_State *L, void *ud, size_t *size )
+{
+    (void)L;
+
+    FileReader *reader = (FileReader*)ud;
+
+    // Only the read needs the lock, not the compiling between reads, so the other core can
+    // get at the SD card while a large module compiles.
+    lockFilesystem();
+    int len = reader->file->read( (uint8_t*)reader->buffer, sizeof(reader->buffer) );
+    unlockFilesystem();
+
+    if( len <= 0 )
+    {
+        // End of the file (or a read error, which will show up as a compile error).
+        *size = 0;
+        return NULL;
+    }
+
+    *size = len;
+    return reader->buffer;
+}
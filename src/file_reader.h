@@ -0,0 +1,45 @@
+// file_reader.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Loading Lua chunks straight from a file.
+//
+// The file is handed to lua_load() a piece at a time through a small buffer, so loading
+// a script never needs a copy of the whole file in memory. The filesystem is locked for
+// each read, not for the whole load.
+//
+
+#ifndef FILE_READER_H
+#define FILE_READER_H  1
+
+#if defined (ARDUINO_ARCH_RP2040)
+#include <SDFS.h>
+#else
+#include <SD.h>
+#endif
+
+#include "lua.hpp"
+
+
+#define FILE_READER_BUFFER_SIZE     512
+
+
+// Load a chunk from the file, starting at its current position. Returns the lua_load() status,
+// with either the function or an error message on the stack.
+int loadFileChunk( lua_State *L, File &file, const char *chunkname, const char *mode );
+
+#endif
@@ -0,0 +1,290 @@
+// frame_receiver.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#include "output_buffer.h"
+#include "crc32.h"
+#include "frame_receiver.h"
+
+
+
+enum RxState {
+    RX_SYNC,
+    RX_HEADER,
+    RX_PAYLOAD,
+    RX_CRC
+};
+
+#define HEADER_SIZE     4       // type, seq, len(2)
+
+
+static RxState rxState = RX_SYNC;
+
+// The frame being received, header then payload.
+static uint8_t frame[HEADER_SIZE + FRAME_MAX_PAYLOAD];
+static size_t frameLen;
+static size_t payloadLen;
+
+static uint8_t crcBytes[4];
+static size_t crcLen;
+
+static FrameDataFn dataFn;
+static void *dataUd;
+static uint8_t allowed;
+
+static bool begun;
+static uint8_t expectedSeq;
+static bool nakSent;
+
+static uint8_t beginFlags;
+static uint32_t beginSize;
+static uint32_t endSize;
+static uint32_t endCrc;
+
+static const char *error;
+
+
+static FrameStatus processFrame();
+static FrameStatus badFrame();
+static FrameStatus fail( const char *why );
+static void reply( uint8_t code, uint8_t seq );
+static uint32_t get32( const uint8_t *p );
+
+
+
+void frameReceiverBegin( FrameDataFn fn, void *ud, uint8_t allowedFlags )
+{
+    dataFn = fn;
+    dataUd = ud;
+    allowed = allowedFlags;
+
+    rxState = RX_SYNC;
+    begun = false;
+    expectedSeq = 0;
+    nakSent = false;
+
+    beginFlags = 0;
+    beginSize = 0;
+    endSize = 0;
+    endCrc = 0;
+
+    error = NULL;
+}
+
+
+FrameStatus frameReceiverByte( uint8_t c )
+{
+    switch( rxState )
+    {
+        case RX_SYNC:
+            // Anything between frames (such as line noise) is skipped.
+            if( c == FRAME_SYNC )
+            {
+                frameLen = 0;
+                rxState = RX_HEADER;
+            }
+            break;
+
+        case RX_HEADER:
+            frame[frameLen++] = c;
+            if( frameLen == HEADER_SIZE )
+            {
+                payloadLen = frame[2] | ( frame[3] << 8 );
+                if( payloadLen > FRAME_MAX_PAYLOAD )
+                {
+                    return badFrame();
+                }
+
+                crcLen = 0;
+                rxState = ( payloadLen > 0 ) ? RX_PAYLOAD : RX_CRC;
+            }
+            break;
+
+        case RX_PAYLOAD:
+            frame[frameLen++] = c;
+            if( frameLen == HEADER_SIZE + payloadLen )
+            {
+                rxState = RX_CRC;
+            }
+            break;
+
+        case RX_CRC:
+            crcBytes[crcLen++] = c;
+            if( crcLen == 4 )
+            {
+                rxState = RX_SYNC;
+
+                if( get32( crcBytes ) != crc32Update( 0, frame, frameLen ) )
+                {
+                    return badFrame();
+                }
+
+                return processFrame();
+            }
+            break;
+    }
+
+    return FRAME_MORE;
+}
+
+
+uint8_t frameReceiverFlags()
+{
+    return beginFlags;
+}
+
+
+uint32_t frameReceiverSize()
+{
+    return beginSize;
+}
+
+
+void frameReceiverEnd( uint32_t *size, uint32_t *crc )
+{
+    *size = endSize;
+    *crc = endCrc;
+}
+
+
+const char *frameReceiverError()
+{
+    return error ? error : "";
+}
+
+
+//==================================================================================
+
+static FrameStatus processFrame()
+{
+    const uint8_t type = frame[0];
+    const uint8_t seq = frame[1];
+    const uint8_t *payload = frame + HEADER_SIZE;
+
+    if( seq != expectedSeq )
+    {
+        if( (uint8_t)( expectedSeq - seq ) <= 128 )
+        {
+            // A resend of a frame we already have, so our ACK was lost. Acknowledge again
+            // so the sender moves on.
+            reply( FRAME_ACK, expectedSeq - 1 );
+        }
+        else
+        {
+            // The one we want was lost.
+            badFrame();
+        }
+        return FRAME_MORE;
+    }
+
+    if( begun == false && type != FRAME_BEGIN )
+    {
+        return fail( "No begin frame" );
+    }
+
+    switch( type )
+    {
+        case FRAME_BEGIN:
+            if( payloadLen < 5 )
+            {
+                return fail( "Bad begin frame" );
+            }
+
+            beginFlags = payload[0];
+            beginSize = get32( payload + 1 );
+
+            if( beginFlags & ~allowed )
+            {
+                return fail( "Unsupported download options" );
+            }
+
+            begun = true;
+            break;
+
+        case FRAME_DATA:
+            if( dataFn( dataUd, payload, payloadLen ) == false )
+            {
+                return fail( "Unable to save the data" );
+            }
+            break;
+
+        case FRAME_END:
+            if( payloadLen < 8 )
+            {
+                return fail( "Bad end frame" );
+            }
+
+            endSize = get32( payload );
+            endCrc = get32( payload + 4 );
+
+            reply( FRAME_ACK, seq );
+            return FRAME_COMPLETE;
+
+        default:
+            return fail( "Unknown frame type" );
+    }
+
+    expectedSeq++;
+    nakSent = false;
+
+    reply( FRAME_ACK, seq );
+
+    return FRAME_MORE;
+}
+
+
+static FrameStatus badFrame()
+{
+    rxState = RX_SYNC;
+
+    if( nakSent == false )
+    {
+        reply( FRAME_NAK, expectedSeq );
+        nakSent = true;
+    }
+
+    return FRAME_MORE;
+}
+
+
+static FrameStatus fail( const char *why )
+{
+    error = why;
+    rxState = RX_SYNC;
+
+    reply( FRAME_CAN, expectedSeq );
+
+    return FRAME_FAILED;
+}
+
+
+static void reply( uint8_t code, uint8_t seq )
+{
+    uint8_t msg[3] = { code, seq, (uint8_t)~seq };
+
+    // After any text before it, and sent now rather than from the run loop, since the sender
+    // is waiting on it.
+    outputWriteWait( msg, 3 );
+    flushOutput();
+}
+
+
+static uint32_t get32( const uint8_t *p )
+{
+    return (uint32_t)p[0] | ( (uint32_t)p[1] << 8 ) | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
@@ -0,0 +1,95 @@
+// frame_receiver.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Receiver for the framed download protocol, used by the shell's '$' command and sent by
+// tools/lua_send.py.
+//
+// Each frame is:
+//
+//     0xA5  type  seq  len(2)  payload(len)  crc(4)
+//
+// with little-endian len and crc, where the crc is the CRC-32 of type through the end of the
+// payload. A download is a BEGIN frame (seq 0), DATA frames, and an END frame, with the seq
+// counting up by one for each frame (wrapping at 256). The BEGIN frame's flags say how the
+// data is encoded.
+//
+// The sender keeps a window of frames in flight (go-back-N). Each frame received in order is
+// acknowledged with ACK seq. (Each reply is the code, the seq, and the seq inverted, so a byte
+// lost on the way back can't be mistaken for a reply.) A damaged or out of order frame gets NAK seq, where seq is the
+// frame wanted next; the sender goes back and resends from there. (The NAK is sent once, after
+// that the sender's timeout covers a lost resend.) If the download can't continue the
+// receiver sends CAN, and the shell prints why.
+//
+
+#ifndef FRAME_RECEIVER_H
+#define FRAME_RECEIVER_H  1
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define FRAME_SYNC          0xA5
+
+#define FRAME_ACK           0x06
+#define FRAME_NAK           0x15
+#define FRAME_CAN           0x18
+
+#define FRAME_MAX_PAYLOAD   256
+
+
+enum FrameType {
+    FRAME_BEGIN = 'B',      // flags(1) size(4)
+    FRAME_DATA = 'D',       // data
+    FRAME_END = 'E'         // size(4) crc(4), of all the data after any decoding
+};
+
+// BEGIN frame flags
+#define FRAME_FLAG_LZSS     0x01        // The data is LZSS compressed (see lzss.h)
+#define FRAME_FLAG_DELTA    0x02        // The data is sync instructions (see delta_sync.h)
+
+
+enum FrameStatus {
+    FRAME_MORE,
+    FRAME_COMPLETE,
+    FRAME_FAILED
+};
+
+
+// Called with the payload of each DATA frame, in order. Return false if the data can't be
+// used, which fails the download.
+typedef bool (*FrameDataFn)( void *ud, const uint8_t *data, size_t len );
+
+
+// Get ready for a new download. BEGIN frames with flags other than those in
+// allowedFlags are refused.
+void frameReceiverBegin( FrameDataFn fn, void *ud, uint8_t allowedFlags );
+
+// Handle one received byte.
+FrameStatus frameReceiverByte( uint8_t c );
+
+// From the BEGIN frame.
+uint8_t frameReceiverFlags();
+uint32_t frameReceiverSize();
+
+// From the END frame, once the download is complete.
+void frameReceiverEnd( uint32_t *size, uint32_t *crc );
+
+// Why the download failed.
+const char *frameReceiverError();
+
+#endif
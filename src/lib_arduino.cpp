@@ -19,6 +19,7 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
 #include "lib_arduino.h"
 
 
@@ -29,20 +30,20 @@
 
 static int funcMillis( lua_State *L )
 {
-    // The return type is an unsigned long.
-    // Since Lua does not have unsigned integers, we return a Lua Number, which is a double
-    // as that can represent an unsigned 32-bit value.
-    lua_pushnumber( L, millis() );
+    // The return type is an unsigned long. This is pushed as an integer rather than a number,
+    // as a float lua_Number can't hold every 32-bit value. With 32-bit Lua integers it becomes
+    // negative after it passes 2^31, but differences between two times are still correct.
+    lua_pushinteger( L, (lua_Integer)millis() );
     return 1;
 }
 
 
 static int funcMicros( lua_State *L )
 {
-    // The return type is an unsigned long.
-    // Since Lua does not have unsigned integers, we return a Lua Number, which is a double
-    // as that can represent an unsigned 32-bit value.
-    lua_pushnumber( L, micros() );
+    // The return type is an unsigned long. This is pushed as an integer rather than a number,
+    // as a float lua_Number can't hold every 32-bit value. With 32-bit Lua integers it becomes
+    // negative after it passes 2^31, but differences between two times are still correct.
+    lua_pushinteger( L, (lua_Integer)micros() );
     return 1;
 }
 
@@ -159,14 +160,19 @@ static int funcAnalogReference( lua_State *L )
 }
 #endif
 
+// The analogWrite() resolution, as set by analogWriteResolution().
+static int analogWriteBits = 8;
+
+
 static int funcAnalogWrite( lua_State *L )
 {
     int pin = luaL_checkinteger( L, 1 );
-    int value = luaL_checkinteger( L, 2 );
+    lua_Integer value = luaL_checkinteger( L, 2 );
 
-    if( value < 1 || value > 32 )
+    const unsigned long maxValue = ( analogWriteBits >= 32 ) ? 0xFFFFFFFFUL : ( 1UL << analogWriteBits ) - 1;
+    if( value < 0 || (unsigned long)value > maxValue )
     {
-        return luaL_error( L, "Invalid analog write value of %d. Must be 0-255", value );
+        return luaL_error( L, "Invalid analog write value of %I. Must be 0-%I", value, (lua_Integer)maxValue );
     }
 
     analogWrite( pin, value );
@@ -186,6 +192,7 @@ static int funcAnalogWriteResolution( lua_State *L )
     }
 
     analogWriteResolution( bits );
+    analogWriteBits = bits;
 
     return 0;
 }
@@ -211,87 +218,88 @@ static int funcAnalogWriteResolution( lua_State *L )
 
 //------------------------------------------------------------------
 
-static const luaL_Reg funcs[] = {
+static const RoEntry funcs[] = {
     // Time
-    { "millis", funcMillis },
-    { "micros", funcMicros },
-    { "delay", funcDelay },
-    { "delayMicroseconds", funcDelayMicroseconds },
+    RO_FUNC( "millis", funcMillis ),
+    RO_FUNC( "micros", funcMicros ),
+    RO_FUNC( "delay", funcDelay ),
+    RO_FUNC( "delayMicroseconds", funcDelayMicroseconds ),
 
     // Digital Pins
-    { "pinMode", funcPinMode },
-    { "digitalWrite", funcDigitalWrite },
-    { "digitalRead", funcDigitalRead },
+    RO_FUNC( "pinMode", funcPinMode ),
+    RO_FUNC( "digitalWrite", funcDigitalWrite ),
+    RO_FUNC( "digitalRead", funcDigitalRead ),
 
     // Analog Pins
-    { "analogRead", funcAnalogRead },
-    { "analogReadResolution", funcAnalogReadResolution },
-    { "analogWritw", funcAnalogWrite },
-    // { "analogReference", funcAnalogReference },      Not in ESP32 or RP2040
+    RO_FUNC( "analogRead", funcAnalogRead ),
+    RO_FUNC( "analogReadResolution", funcAnalogReadResolution ),
+    RO_FUNC( "analogWrite", funcAnalogWrite ),
+    // RO_FUNC( "analogReference", funcAnalogReference ),      Not in ESP32 or RP2040
 #if defined (ARDUINO_ARCH_RP2040)
-    { "analogWriteResolution", funcAnalogWriteResolution },
+    RO_FUNC( "analogWriteResolution", funcAnalogWriteResolution ),
 #endif
 
-    { NULL, NULL }
-};
-
-
-// This will be called by the Lua process to initialize the library.
-int luaopen_arduino( lua_State *L )
-{
-    luaL_newlib( L, funcs );
-
-    addIntegerConstant( L, "HIGH", HIGH );
-    addIntegerConstant( L, "LOW", LOW );
+    // Constants
+    RO_INT( "HIGH", HIGH ),
+    RO_INT( "LOW", LOW ),
 
-    addIntegerConstant( L, "INPUT", INPUT );
-    addIntegerConstant( L, "INPUT_PULLUP", INPUT_PULLUP );
-    addIntegerConstant( L, "OUTPUT", OUTPUT );
+    RO_INT( "INPUT", INPUT ),
+    RO_INT( "INPUT_PULLUP", INPUT_PULLUP ),
+    RO_INT( "OUTPUT", OUTPUT ),
 
-    addIntegerConstant( L, "LED_BUILTIN", LED_BUILTIN );
+    RO_INT( "LED_BUILTIN", LED_BUILTIN ),
 
 #if defined (ARDUINO_ARCH_RP2040)
-    addIntegerConstant( L, "A0", A0 );
-    addIntegerConstant( L, "A1", A1 );
-    addIntegerConstant( L, "A2", A2 );
-    addIntegerConstant( L, "A3", A3 );
+    RO_INT( "A0", A0 ),
+    RO_INT( "A1", A1 ),
+    RO_INT( "A2", A2 ),
+    RO_INT( "A3", A3 ),
 #elif defined (ESP32)
-    addIntegerConstant( L, "A0", A0 );
-    addIntegerConstant( L, "A1", A1 );
-    addIntegerConstant( L, "A2", A2 );
-    addIntegerConstant( L, "A3", A3 );
-    addIntegerConstant( L, "A4", A4 );
-    addIntegerConstant( L, "A5", A5 );
-    addIntegerConstant( L, "A6", A6 );
-    addIntegerConstant( L, "A7", A7 );
-    addIntegerConstant( L, "A8", A8 );
-    addIntegerConstant( L, "A9", A9 );
-    addIntegerConstant( L, "A10", A10 );
-    addIntegerConstant( L, "A11", A11 );
-    addIntegerConstant( L, "A12", A12 );
-    addIntegerConstant( L, "A13", A13 );
+    RO_INT( "A0", A0 ),
+    RO_INT( "A1", A1 ),
+    RO_INT( "A2", A2 ),
+    RO_INT( "A3", A3 ),
+    RO_INT( "A4", A4 ),
+    RO_INT( "A5", A5 ),
+    RO_INT( "A6", A6 ),
+    RO_INT( "A7", A7 ),
+    RO_INT( "A8", A8 ),
+    RO_INT( "A9", A9 ),
+    RO_INT( "A10", A10 ),
+    RO_INT( "A11", A11 ),
+    RO_INT( "A12", A12 ),
+    RO_INT( "A13", A13 ),
 #else
-    addIntegerConstant( L, "A0", A0 );
-    addIntegerConstant( L, "A1", A1 );
-    addIntegerConstant( L, "A2", A2 );
-    addIntegerConstant( L, "A3", A3 );
-    addIntegerConstant( L, "A4", A4 );
-    addIntegerConstant( L, "A5", A5 );
-    addIntegerConstant( L, "A6", A6 );
-    addIntegerConstant( L, "A7", A7 );
-    addIntegerConstant( L, "A8", A8 );
-    addIntegerConstant( L, "A9", A9 );
-    addIntegerConstant( L, "A10", A10 );
-    addIntegerConstant( L, "A11", A11 );
-    addIntegerConstant( L, "A12", A12 );
-    addIntegerConstant( L, "A13", A13 );
-    addIntegerConstant( L, "A14", A14 );
+    RO_INT( "A0", A0 ),
+    RO_INT( "A1", A1 ),
+    RO_INT( "A2", A2 ),
+    RO_INT( "A3", A3 ),
+    RO_INT( "A4", A4 ),
+    RO_INT( "A5", A5 ),
+    RO_INT( "A6", A6 ),
+    RO_INT( "A7", A7 ),
+    RO_INT( "A8", A8 ),
+    RO_INT( "A9", A9 ),
+    RO_INT( "A10", A10 ),
+    RO_INT( "A11", A11 ),
+    RO_INT( "A12", A12 ),
+    RO_INT( "A13", A13 ),
+    RO_INT( "A14", A14 ),
 #endif
 
 #if ! defined (ARDUINO_ARCH_RP2040)
-    addIntegerConstant( L, "DEFAULT", DEFAULT );
-    addIntegerConstant( L, "EXTERNAL", EXTERNAL );
+    RO_INT( "DEFAULT", DEFAULT ),
+    RO_INT( "EXTERNAL", EXTERNAL ),
 #endif
 
+    RO_END
+};
+
+
+// This will be called by the Lua process to initialize the library.
+int luaopen_arduino( lua_State *L )
+{
+    pushRoTable( L, funcs );
+
     return 1;
 }
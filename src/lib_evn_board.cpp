@@ -21,6 +21,7 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
 
 #include "lib_evn_board.h"
 
@@ -311,31 +312,52 @@ static int getButtonInvert( lua_State *L )
 //===========================================================================================
 
 
-static const luaL_Reg funcs[] = {
-    { "buttonRead", buttonRead },
-    { "ledWrite", ledWrite },
-
-    { "setPort", setPort },
-    { "getPort", getPort },
-    { "getWirePort", getWirePort },
-    { "getWire1Port", getWire1Port },
-    { "printPorts", printPorts },
-
-    { "getBatteryVoltage", getBatteryVoltage },
-    { "getCell1Voltage", getCell1Voltage },
-    { "getCell2Voltage", getCell2Voltage },
-
-    { "setMode", setMode },
-    { "setLinkLED", setLinkLED },
-    { "setLinkMovement", setLinkMovement },
-    { "setButtonInvert", setButtonInvert },
-
-    { "getMode", getMode },
-    { "getLinkLED", getLinkLED },
-    { "getLinkMovement", getLinkMovement },
-    { "getButtonInvert", getButtonInvert },
-
-    { NULL, NULL }
+// The evn module
+static const RoEntry funcs[] = {
+    RO_FUNC( "buttonRead", buttonRead ),
+    RO_FUNC( "ledWrite", ledWrite ),
+
+    RO_FUNC( "setPort", setPort ),
+    RO_FUNC( "getPort", getPort ),
+    RO_FUNC( "getWirePort", getWirePort ),
+    RO_FUNC( "getWire1Port", getWire1Port ),
+    RO_FUNC( "printPorts", printPorts ),
+
+    RO_FUNC( "getBatteryVoltage", getBatteryVoltage ),
+    RO_FUNC( "getCell1Voltage", getCell1Voltage ),
+    RO_FUNC( "getCell2Voltage", getCell2Voltage ),
+
+    RO_FUNC( "setMode", setMode ),
+    RO_FUNC( "setLinkLED", setLinkLED ),
+    RO_FUNC( "setLinkMovement", setLinkMovement ),
+    RO_FUNC( "setButtonInvert", setButtonInvert ),
+
+    RO_FUNC( "getMode", getMode ),
+    RO_FUNC( "getLinkLED", getLinkLED ),
+    RO_FUNC( "getLinkMovement", getLinkMovement ),
+    RO_FUNC( "getButtonInvert", getButtonInvert ),
+
+    // Classes (set up when first used)
+    RO_CLASS( "Motor", evn_motor_class, init_evn_motor ),
+    RO_CLASS( "Servo", evn_servo_class, init_evn_servo ),
+    RO_CLASS( "ContinuousServo", evn_continuous_servo_class, init_evn_continuous_servo ),
+    RO_CLASS( "Drivebase", evn_drivebase_class, init_evn_drivebase ),
+
+    RO_CLASS( "DistanceSensor", evn_distance_sensor_class, init_evn_distance_sensor ),
+    RO_CLASS( "ColourSensor", evn_colour_sensor_class, init_evn_colour_sensor ),
+    RO_CLASS( "CompassSensor", evn_compass_sensor_class, init_evn_compass_sensor ),
+    RO_CLASS( "IMUSensor", evn_imu_sensor_class, init_evn_imu_sensor ),
+
+    RO_CLASS( "Display", evn_display_class, init_evn_display ),
+    RO_CLASS( "MatrixLED", evn_matrixled_class, init_evn_matrixled ),
+    RO_CLASS( "RGBLED", evn_RGBLED_class, init_evn_RGBLED ),
+    RO_CLASS( "SevenSegmentLED", evn_sevensegment_led_class, init_evn_sevensegment_led ),
+
+    RO_INT( "BUTTON_TOGGLE", BUTTON_TOGGLE ),
+    RO_INT( "BUTTON_PUSHBUTTON", BUTTON_PUSHBUTTON ),
+    RO_INT( "BUTTON_DISABLE", BUTTON_DISABLE ),
+
+    RO_END
 };
 
 
@@ -354,26 +376,9 @@ void lib_evn_set_board( EVNAlpha *_board )
 // This will be called by the Lua process to initialize the library.
 int luaopen_evn_board( lua_State *L )
 {
-    luaL_newlib( L, funcs );
-
-    init_evn_motor( L );
-    init_evn_servo( L );
-    init_evn_continuous_servo( L );
-    init_evn_drivebase( L );
-
-    init_evn_distance_sensor( L );
-    init_evn_colour_sensor( L );
-    init_evn_compass_sensor( L );
-    init_evn_imu_sensor( L );
-
-    init_evn_display( L );
-    init_evn_matrixled( L );
-    init_evn_RGBLED( L );
-    init_evn_sevensegment_led( L );
-
-    addIntegerConstant( L, "BUTTON_TOGGLE", BUTTON_TOGGLE );
-    addIntegerConstant( L, "BUTTON_PUSHBUTTON", BUTTON_PUSHBUTTON );
-    addIntegerConstant( L, "BUTTON_DISABLE", BUTTON_DISABLE );
+    // The module and class tables are all in flash. Each class sets up its metatable
+    // the first time it is used.
+    pushRoTable( L, funcs );
 
     return 1;
 }
@@ -18,8 +18,17 @@
 #include "lua.hpp"
 
 #include "lua_tools.h"
+#include "rotable.h"
 #include "lib_platform.h"
 #include "lua_support.h"
+#include "channel.h"
+#include "lua_tasks.h"
+#include "event_queue.h"
+#include "output_buffer.h"
+#include "loop_stats.h"
+#include "lua_pool.h"
+#include "mem_stats.h"
+#include "bytecode_cache.h"
 
 
 
@@ -37,6 +46,13 @@ static int housekeepingEnabled( lua_State *L )
 }
 
 
+static int loop1EnabledFunc( lua_State *L )
+{
+    lua_pushboolean( L, loop1Enabled );
+    return 1;
+}
+
+
 static int setExecEnabled( lua_State *L )
 {
     bool en = functionArgBool( L, 1 );
@@ -54,23 +70,680 @@ static int setHousekeepingEnabled( lua_State *L )
 
 
 
+static int setLoop1Enabled( lua_State *L )
+{
+    bool en = functionArgBool( L, 1 );
+    loop1Enabled = en;
+    return 0;
+}
+
+
+static int execPeriod( lua_State *L )
+{
+    lua_pushinteger( L, loopPeriod( EXEC_LOOP ) );
+    return 1;
+}
+
+
+static int housekeepingPeriod( lua_State *L )
+{
+    lua_pushinteger( L, loopPeriod( HOUSEKEEPING_LOOP ) );
+    return 1;
+}
+
+
+static int setPeriod( lua_State *L, LoopFunctionId id )
+{
+    int period = functionArgInt( L, 1 );
+    if( period < 0 )
+    {
+        return luaL_error( L, "Loop period cannot be negative" );
+    }
+
+    // The periodic loops run on core 0, and their deadlines are only touched there.
+    if( currentCore() != 0 )
+    {
+        return luaL_error( L, "Loop periods can only be set from core 0" );
+    }
+
+    setLoopPeriod( id, period );
+    return 0;
+}
+
+
+static int setExecPeriod( lua_State *L )
+{
+    return setPeriod( L, EXEC_LOOP );
+}
+
+
+static int setHousekeepingPeriod( lua_State *L )
+{
+    return setPeriod( L, HOUSEKEEPING_LOOP );
+}
+
+
+static int execOverruns( lua_State *L )
+{
+    lua_pushinteger( L, loopOverruns( EXEC_LOOP ) );
+    return 1;
+}
+
+
+static int housekeepingOverruns( lua_State *L )
+{
+    lua_pushinteger( L, loopOverruns( HOUSEKEEPING_LOOP ) );
+    return 1;
+}
+
+
+static int setBudget( lua_State *L, LoopFunctionId id )
+{
+    int budget = functionArgInt( L, 1 );
+    if( budget < 0 )
+    {
+        return luaL_error( L, "Loop budget cannot be negative" );
+    }
+
+    setLoopBudget( id, budget );
+    return 0;
+}
+
+
+static int setExecBudget( lua_State *L )
+{
+    return setBudget( L, EXEC_LOOP );
+}
+
+
+static int setHousekeepingBudget( lua_State *L )
+{
+    return setBudget( L, HOUSEKEEPING_LOOP );
+}
+
+
+static int setLoop1Budget( lua_State *L )
+{
+    return setBudget( L, LOOP1 );
+}
+
+
+static int execBudget( lua_State *L )
+{
+    lua_pushinteger( L, loopBudget( EXEC_LOOP ) );
+    return 1;
+}
+
+
+static int housekeepingBudget( lua_State *L )
+{
+    lua_pushinteger( L, loopBudget( HOUSEKEEPING_LOOP ) );
+    return 1;
+}
+
+
+static int loop1Budget( lua_State *L )
+{
+    lua_pushinteger( L, loopBudget( LOOP1 ) );
+    return 1;
+}
+
+
+
+static void setStatsField( lua_State *L, const char *name, lua_Integer value )
+{
+    lua_pushinteger( L, value );
+    lua_setfield( L, -2, name );
+}
+
+
+/**
+ * table loopStats()
+ *
+ * Returns a table with an entry for each phase of the run loop, each a table with the
+ * count, min, max, mean, p50, p99, and p999 times in microseconds.
+ */
+static int loopStats( lua_State *L )
+{
+    lua_createtable( L, 0, NUM_STATS_PHASES );
+
+    for( int i = 0; i < NUM_STATS_PHASES; i++ )
+    {
+        LatencySummary sum;
+        summarizeLatency( (StatsPhase)i, &sum );
+
+        lua_createtable( L, 0, 8 );
+        setStatsField( L, "count", sum.count );
+        setStatsField( L, "min", sum.min );
+        setStatsField( L, "max", sum.max );
+        setStatsField( L, "mean", sum.mean );
+        setStatsField( L, "p50", sum.p50 );
+        setStatsField( L, "p99", sum.p99 );
+        setStatsField( L, "p999", sum.p999 );
+
+        if( i == STATS_EXEC )
+        {
+            setStatsField( L, "overruns", loopOverruns( EXEC_LOOP ) );
+        }
+        else if( i == STATS_HOUSEKEEPING )
+        {
+            setStatsField( L, "overruns", loopOverruns( HOUSEKEEPING_LOOP ) );
+        }
+
+        lua_setfield( L, -2, statsPhaseName( (StatsPhase)i ) );
+    }
+
+    return 1;
+}
+
+
+static int resetLoopStatsFunc( lua_State *L )
+{
+    (void)L;
+    resetLoopStats();
+    return 0;
+}
+
+
+
+static const char * const gcModeNames[] = { "incremental", "generational", "idle", NULL };
+
+
+static int setGCModeFunc( lua_State *L )
+{
+    int mode = luaL_checkoption( L, 1, NULL, gcModeNames );
+    setGCMode( L, (GCMode)mode );
+    return 0;
+}
+
+
+static int gcModeFunc( lua_State *L )
+{
+    lua_pushstring( L, gcModeNames[gcMode( L )] );
+    return 1;
+}
+
+
+static int setIdleGCFunc( lua_State *L )
+{
+    int stepMul = functionArgInt( L, 1 );
+    int minSlack = functionArgInt( L, 2 );
+    int maxDebt = functionArgInt( L, 3 );
+    if( stepMul <= 0 || minSlack < 0 || maxDebt <= 0 )
+    {
+        return luaL_error( L, "Invalid idle GC settings" );
+    }
+
+    setIdleGC( L, stepMul, minSlack, maxDebt );
+    return 0;
+}
+
+
+/**
+ * setBytecodeCache( enabled, strip )
+ */
+static int setBytecodeCacheFunc( lua_State *L )
+{
+    bool enabled = lua_toboolean( L, 1 );
+    bool strip = lua_toboolean( L, 2 );
+
+    setBytecodeCache( enabled, strip );
+    return 0;
+}
+
+
+/**
+ * enabled, strip = bytecodeCache()
+ */
+static int bytecodeCacheFunc( lua_State *L )
+{
+    lua_pushboolean( L, bytecodeCacheEnabled() );
+    lua_pushboolean( L, bytecodeStripped() );
+    return 2;
+}
+
+
+
+/**
+ * table poolStats()
+ */
+static int poolStats( lua_State *L )
+{
+    const LuaPool *pool = luaPool( L );
+
+    lua_createtable( L, 0, 8 );
+    setStatsField( L, "arena", pool->arenaSize );
+    setStatsField( L, "arenaUsed", pool->arenaUsed );
+    setStatsField( L, "largestFree", poolLargestFree( pool ) );
+    setStatsField( L, "heapBlocks", pool->heapBlocks );
+    setStatsField( L, "largeBlocks", pool->largeBlocks );
+    setStatsField( L, "fallbacks", pool->fallbacks );
+    setStatsField( L, "failures", pool->failures );
+
+    lua_createtable( L, POOL_NUM_CLASSES, 0 );
+    for( int i = 0; i < POOL_NUM_CLASSES; i++ )
+    {
+        const PoolClass *pc = &pool->classes[i];
+
+        lua_createtable( L, 0, 3 );
+        setStatsField( L, "size", poolClassSize( i ) );
+        setStatsField( L, "pages", pc->pages );
+        setStatsField( L, "inUse", pc->inUse );
+        lua_rawseti( L, -2, i + 1 );
+    }
+    lua_setfield( L, -2, "classes" );
+
+    return 1;
+}
+
+
+
+/**
+ * table memStats()
+ */
+static int memStats( lua_State *L )
+{
+    const MemStats *ms = luaMemStats( L );
+
+    lua_createtable( L, 0, 4 );
+    setStatsField( L, "live", ms->live );
+    setStatsField( L, "peak", ms->peak );
+
+    // Allocation counts, keyed by the largest size in each class.
+    lua_createtable( L, 0, MEM_NUM_CLASSES );
+    for( int i = 0; i < POOL_NUM_CLASSES; i++ )
+    {
+        lua_pushinteger( L, ms->allocs[i] );
+        lua_rawseti( L, -2, poolClassSize( i ) );
+    }
+    setStatsField( L, "large", ms->allocs[POOL_NUM_CLASSES] );
+    lua_setfield( L, -2, "allocs" );
+
+    lua_createtable( L, 0, ms->numModules );
+    for( int i = 0; i < ms->numModules; i++ )
+    {
+        setStatsField( L, ms->modules[i].name, ms->modules[i].bytes );
+    }
+    lua_setfield( L, -2, "modules" );
+
+    return 1;
+}
+
+
+static int resetMemStats( lua_State *L )
+{
+    memReset( luaMemStats( L ) );
+    return 0;
+}
+
+
+
+//------------------------------------------------------------------
+// Events
+//------------------------------------------------------------------
+
+static int watchPinFunc( lua_State *L )
+{
+    int pin = functionArgInt( L, 1 );
+    int mode = functionArgInt( L, 2 );
+    lua_pushboolean( L, watchPin( pin, mode ) );
+    return 1;
+}
+
+
+static int unwatchPinFunc( lua_State *L )
+{
+    int pin = functionArgInt( L, 1 );
+    unwatchPin( pin );
+    return 0;
+}
+
+
+static int startTimer( lua_State *L )
+{
+    int id = functionArgInt( L, 1 );
+    int ms = functionArgInt( L, 2 );
+    if( ms <= 0 )
+    {
+        return luaL_error( L, "Timer period must be positive" );
+    }
+
+    lua_pushboolean( L, startEventTimer( id, ms ) );
+    return 1;
+}
+
+
+static int stopTimer( lua_State *L )
+{
+    int id = functionArgInt( L, 1 );
+    stopEventTimer( id );
+    return 0;
+}
+
+
+static int postEventFunc( lua_State *L )
+{
+    int source = functionArgInt( L, 1 );
+    int value = functionArgInt( L, 2, 0 );
+    lua_pushboolean( L, postEvent( EVENT_USER, source, value ) );
+    return 1;
+}
+
+
+static int droppedEventsFunc( lua_State *L )
+{
+    lua_pushinteger( L, droppedEvents() );
+    return 1;
+}
+
+
+
 //------------------------------------------------------------------
+// Output buffer
+//------------------------------------------------------------------
+
+static const char * const outputPolicyNames[] = { "drop-oldest", "drop-newest", "block", NULL };
+
+
+/**
+ * setOutputBuffer( size [, policy] )
+ */
+static int setOutputBufferFunc( lua_State *L )
+{
+    lua_Integer size = luaL_checkinteger( L, 1 );
+    if( size < 0 || size > OUTPUT_BUFFER_MAX )
+    {
+        return luaL_error( L, "Output buffer size must be 0-%d", OUTPUT_BUFFER_MAX );
+    }
+
+    // Nothing is changed unless the whole call succeeds.
+    OutputPolicy policy = outputPolicy();
+    if( ! lua_isnoneornil( L, 2 ) )
+    {
+        policy = (OutputPolicy)luaL_checkoption( L, 2, NULL, outputPolicyNames );
+    }
+
+    if( ! setOutputBuffer( size ) )
+    {
+        return luaL_error( L, "Not enough memory for the output buffer" );
+    }
+
+    setOutputPolicy( policy );
+    return 0;
+}
+
+
+/**
+ * size, policy, pending = outputBuffer()
+ */
+static int outputBufferFunc( lua_State *L )
+{
+    lua_pushinteger( L, outputBufferSize() );
+    lua_pushstring( L, outputPolicyNames[outputPolicy()] );
+    lua_pushinteger( L, outputPending() );
+    return 3;
+}
+
 
-static const luaL_Reg funcs[] = {
-    { "execEnabled", execEnabled },
-    { "housekeepingEnabled", housekeepingEnabled },
+static int droppedOutputFunc( lua_State *L )
+{
+    lua_pushinteger( L, droppedOutput() );
+    return 1;
+}
 
-    { "setExecEnabled", setExecEnabled },
-    { "setHousekeepingEnabled", setHousekeepingEnabled },
 
-    { NULL, NULL }
+static int flushOutputFunc( lua_State *L )
+{
+    (void)L;
+    flushOutput();
+    return 0;
+}
+
+
+
+//------------------------------------------------------------------
+// Channels
+//------------------------------------------------------------------
+
+#define CHANNEL_CLASS_NAME      "LuaChannel"
+
+
+static int channelNew( lua_State *L )
+{
+    const char *name = functionArgString( L, 1 );
+    int capacity = functionArgInt( L, 2, 0 );
+    if( capacity < 0 )
+    {
+        return luaL_error( L, "Channel capacity cannot be negative" );
+    }
+
+    Channel *ch = openChannel( name, capacity );
+    if( ch == NULL )
+    {
+        if( capacity == 0 )
+        {
+            return luaL_error( L, "No channel '%s', a capacity is needed to create it", name );
+        }
+
+        return luaL_error( L, "Unable to create channel '%s'", name );
+    }
+
+    Channel **p = (Channel**)lua_newuserdata( L, sizeof(Channel*) );
+    *p = ch;
+
+    luaL_getmetatable( L, CHANNEL_CLASS_NAME );
+    lua_setmetatable( L, -2 );
+
+    return 1;
+}
+
+
+/**
+ * The channel a push is called on, checking this core may push to it.
+ */
+static Channel *checkProducer( lua_State *L )
+{
+    Channel *ch = *(Channel**)checkObject( L, 1, CLASS_CHANNEL );
+    if( ! ch->claimProducer( currentCore() ) )
+    {
+        luaL_error( L, "Channel '%s' is pushed to by the other core (only one core may push)", ch->name() );
+    }
+    return ch;
+}
+
+
+/**
+ * The channel a pop or peek is called on, checking this core may pop from it.
+ */
+static Channel *checkConsumer( lua_State *L )
+{
+    Channel *ch = *(Channel**)checkObject( L, 1, CLASS_CHANNEL );
+    if( ! ch->claimConsumer( currentCore() ) )
+    {
+        luaL_error( L, "Channel '%s' is popped by the other core (only one core may pop)", ch->name() );
+    }
+    return ch;
+}
+
+
+static int channelPush( lua_State *L )
+{
+    Channel *ch = checkProducer( L );
+    luaL_checkany( L, 2 );
+
+    ChannelSlot *slot = ch->reserve();
+    if( slot == NULL )
+    {
+        // Full
+        lua_pushboolean( L, false );
+        return 1;
+    }
+
+    const char *err = channelEncode( L, 2, slot );
+    if( err )
+    {
+        return luaL_error( L, "%s", err );
+    }
+
+    ch->commit();
+
+    lua_pushboolean( L, true );
+    return 1;
+}
+
+
+static int channelPop( lua_State *L )
+{
+    Channel *ch = checkConsumer( L );
+
+    const ChannelSlot *slot = ch->front();
+    if( slot == NULL )
+    {
+        lua_pushnil( L );
+        return 1;
+    }
+
+    channelDecode( L, slot );
+    ch->release();
+
+    return 1;
+}
+
+
+static int channelPeekLatest( lua_State *L )
+{
+    Channel *ch = checkConsumer( L );
+
+    const ChannelSlot *slot = ch->back();
+    if( slot == NULL )
+    {
+        lua_pushnil( L );
+        return 1;
+    }
+
+    channelDecode( L, slot );
+
+    return 1;
+}
+
+
+static int channelCount( lua_State *L )
+{
+    Channel *ch = *(Channel**)checkObject( L, 1, CLASS_CHANNEL );
+    lua_pushinteger( L, ch->count() );
+    return 1;
+}
+
+
+static int channelCapacity( lua_State *L )
+{
+    Channel *ch = *(Channel**)checkObject( L, 1, CLASS_CHANNEL );
+    lua_pushinteger( L, ch->capacity() );
+    return 1;
+}
+
+
+static int channelName( lua_State *L )
+{
+    Channel *ch = *(Channel**)checkObject( L, 1, CLASS_CHANNEL );
+    lua_pushstring( L, ch->name() );
+    return 1;
+}
+
+
+// Channel object methods
+static const RoEntry channelMethods[] = {
+    RO_FUNC( "push", channelPush ),
+    RO_FUNC( "pop", channelPop ),
+    RO_FUNC( "peekLatest", channelPeekLatest ),
+    RO_FUNC( "count", channelCount ),
+    RO_FUNC( "capacity", channelCapacity ),
+    RO_FUNC( "name", channelName ),
+
+    RO_END
+};
+
+
+
+//------------------------------------------------------------------
+
+static const RoEntry funcs[] = {
+    RO_FUNC( "execEnabled", execEnabled ),
+    RO_FUNC( "housekeepingEnabled", housekeepingEnabled ),
+    RO_FUNC( "loop1Enabled", loop1EnabledFunc ),
+
+    RO_FUNC( "setExecEnabled", setExecEnabled ),
+    RO_FUNC( "setHousekeepingEnabled", setHousekeepingEnabled ),
+    RO_FUNC( "setLoop1Enabled", setLoop1Enabled ),
+
+    RO_FUNC( "execPeriod", execPeriod ),
+    RO_FUNC( "housekeepingPeriod", housekeepingPeriod ),
+
+    RO_FUNC( "setExecPeriod", setExecPeriod ),
+    RO_FUNC( "setHousekeepingPeriod", setHousekeepingPeriod ),
+
+    RO_FUNC( "execOverruns", execOverruns ),
+    RO_FUNC( "housekeepingOverruns", housekeepingOverruns ),
+
+    RO_FUNC( "setExecBudget", setExecBudget ),
+    RO_FUNC( "setHousekeepingBudget", setHousekeepingBudget ),
+    RO_FUNC( "setLoop1Budget", setLoop1Budget ),
+
+    RO_FUNC( "execBudget", execBudget ),
+    RO_FUNC( "housekeepingBudget", housekeepingBudget ),
+    RO_FUNC( "loop1Budget", loop1Budget ),
+
+    RO_FUNC( "loopStats", loopStats ),
+    RO_FUNC( "resetLoopStats", resetLoopStatsFunc ),
+
+    RO_FUNC( "poolStats", poolStats ),
+    RO_FUNC( "memStats", memStats ),
+    RO_FUNC( "resetMemStats", resetMemStats ),
+
+    RO_FUNC( "setGCMode", setGCModeFunc ),
+    RO_FUNC( "gcMode", gcModeFunc ),
+    RO_FUNC( "setIdleGC", setIdleGCFunc ),
+
+    RO_FUNC( "setBytecodeCache", setBytecodeCacheFunc ),
+    RO_FUNC( "bytecodeCache", bytecodeCacheFunc ),
+
+    RO_FUNC( "watchPin", watchPinFunc ),
+    RO_FUNC( "unwatchPin", unwatchPinFunc ),
+    RO_FUNC( "startTimer", startTimer ),
+    RO_FUNC( "stopTimer", stopTimer ),
+    RO_FUNC( "postEvent", postEventFunc ),
+    RO_FUNC( "droppedEvents", droppedEventsFunc ),
+
+    RO_FUNC( "setOutputBuffer", setOutputBufferFunc ),
+    RO_FUNC( "outputBuffer", outputBufferFunc ),
+    RO_FUNC( "droppedOutput", droppedOutputFunc ),
+    RO_FUNC( "flushOutput", flushOutputFunc ),
+
+    RO_FUNC( "channel", channelNew ),
+
+    RO_FUNC( "spawn", luaTaskSpawn ),
+    RO_FUNC( "sleep", luaTaskSleep ),
+    RO_FUNC( "waitUntil", luaTaskWaitUntil ),
+    RO_FUNC( "taskCount", luaTaskCount ),
+    RO_FUNC( "setTaskBudget", luaTaskSetBudget ),
+    RO_FUNC( "taskBudget", luaTaskBudget ),
+
+    RO_END
 };
 
 
 // This will be called by the Lua process to initialize the library.
 int luaopen_platform( lua_State *L )
 {
-    luaL_newlib( L, funcs );
+    // Channel object metatable
+    luaL_newmetatable( L, CHANNEL_CLASS_NAME );
+
+    // Methods are looked up in the const methods table.
+    setRoIndex( L, channelMethods );
+
+    lua_pop( L, 1 );
+
+    pushRoTable( L, funcs );
 
     return 1;
 }
@@ -0,0 +1,183 @@
+// loop_stats.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#include "loop_stats.h"
+
+
+
+// Values below this get a bucket each, above it there are four buckets per power of two.
+#define LINEAR_BUCKETS      8
+
+// Enough buckets for any 32-bit value.
+#define NUM_BUCKETS         (LINEAR_BUCKETS + (32 - 3) * 4)
+
+
+struct Histogram {
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+};
+
+
+// Each phase is only recorded from one core. (The loop1 phase is recorded on core 1, and
+// may be slightly torn when read from core 0, which is harmless for statistics.)
+static Histogram histograms[NUM_STATS_PHASES];
+
+
+static const char * const phaseNames[NUM_STATS_PHASES] = {
+    "pass",
+    "shell",
+    "events",
+    "exec",
+    "housekeeping",
+    "tasks",
+    "loop1",
+    "gc",
+};
+
+
+static int bucketIndex( uint32_t us );
+static uint32_t bucketHigh( int idx );
+static uint32_t percentile( const Histogram *h, uint32_t perThousand );
+
+
+
+void recordLatency( StatsPhase phase, uint32_t us )
+{
+    Histogram *h = &histograms[phase];
+
+    h->buckets[bucketIndex( us )]++;
+
+    if( h->count == 0 || us < h->min )
+    {
+        h->min = us;
+    }
+
+    if( us > h->max )
+    {
+        h->max = us;
+    }
+
+    h->count++;
+    h->sum += us;
+}
+
+
+unsigned long lapLatency( StatsPhase phase, unsigned long start )
+{
+    const unsigned long now = micros();
+    recordLatency( phase, now - start );
+    return now;
+}
+
+
+void summarizeLatency( StatsPhase phase, LatencySummary *summary )
+{
+    const Histogram *h = &histograms[phase];
+
+    summary->count = h->count;
+
+    if( h->count == 0 )
+    {
+        summary->min = summary->max = summary->mean = 0;
+        summary->p50 = summary->p99 = summary->p999 = 0;
+        return;
+    }
+
+    summary->min = h->min;
+    summary->max = h->max;
+    summary->mean = h->sum / h->count;
+    summary->p50 = percentile( h, 500 );
+    summary->p99 = percentile( h, 990 );
+    summary->p999 = percentile( h, 999 );
+}
+
+
+void resetLoopStats()
+{
+    memset( histograms, 0, sizeof(histograms) );
+}
+
+
+const char *statsPhaseName( StatsPhase phase )
+{
+    return phaseNames[phase];
+}
+
+
+//==================================================================================
+
+static int bucketIndex( uint32_t us )
+{
+    if( us < LINEAR_BUCKETS )
+    {
+        return us;
+    }
+
+    // The power of two, and the next two bits below it pick one of four sub-buckets.
+    const int e = 31 - __builtin_clz( us );
+    return LINEAR_BUCKETS + (e - 3) * 4 + ((us >> (e - 2)) & 3);
+}
+
+
+// The largest value that goes into the bucket.
+static uint32_t bucketHigh( int idx )
+{
+    if( idx < LINEAR_BUCKETS )
+    {
+        return idx;
+    }
+
+    const int e = (idx - LINEAR_BUCKETS) / 4 + 3;
+    const uint32_t sub = (idx - LINEAR_BUCKETS) % 4;
+    const uint32_t low = (4 + sub) << (e - 2);
+
+    return low + ((1UL << (e - 2)) - 1);
+}
+
+
+// The value that 'perThousand' / 1000 of the recorded values are at or below.
+static uint32_t percentile( const Histogram *h, uint32_t perThousand )
+{
+    const uint64_t target = ((uint64_t)h->count * perThousand + 999) / 1000;
+    uint64_t seen = 0;
+
+    for( int i = 0; i < NUM_BUCKETS; i++ )
+    {
+        seen += h->buckets[i];
+        if( seen >= target )
+        {
+            // Report the top of the bucket, but never outside what was actually seen.
+            uint32_t v = bucketHigh( i );
+            if( v > h->max )
+            {
+                v = h->max;
+            }
+            if( v < h->min )
+            {
+                v = h->min;
+            }
+            return v;
+        }
+    }
+
+    return h->max;
+}
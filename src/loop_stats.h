@@ -0,0 +1,69 @@
+// loop_stats.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Timing statistics for each phase of the run loop.
+//
+// Each phase has a fixed size histogram of microsecond durations. The buckets are
+// logarithmic, with four buckets per power of two, so any percentile read from them is
+// within 25% of the true value while recording a time is only a few instructions.
+//
+
+#ifndef LOOP_STATS_H
+#define LOOP_STATS_H  1
+
+#include <stdint.h>
+
+
+enum StatsPhase {
+    STATS_PASS,             // The whole core 0 run loop pass
+    STATS_SHELL,
+    STATS_EVENTS,
+    STATS_EXEC,
+    STATS_HOUSEKEEPING,
+    STATS_TASKS,
+    STATS_LOOP1,
+    STATS_GC,               // Idle-time garbage collection steps (core 0)
+
+    NUM_STATS_PHASES
+};
+
+
+struct LatencySummary {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t mean;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t p999;
+};
+
+
+// Add one duration (in microseconds) to the phase's histogram.
+void recordLatency( StatsPhase phase, uint32_t us );
+
+// Record the time from 'start' to now for the phase, and return now.
+unsigned long lapLatency( StatsPhase phase, unsigned long start );
+
+void summarizeLatency( StatsPhase phase, LatencySummary *summary );
+
+void resetLoopStats();
+
+const char *statsPhaseName( StatsPhase phase );
+
+#endif
@@ -0,0 +1,218 @@
+// lua_bind.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Lua bindings for class methods, generated at compile time.
+//
+// Each entry names the method and the signature it is called with from Lua:
+//
+//     RO_METHOD( "runPosition", EVNMotor, runPosition, void( float, float, int, bool ), STOP_BRAKE, true )
+//
+// The function checks that 'self' is an EVNMotor, reads each argument from the Lua stack as
+// the signature's parameter type, calls obj->runPosition() with them, and pushes the result
+// as the signature's result type (a bool, an integer, or a number; void pushes nothing).
+// Trailing arguments can be given defaults, used when the script leaves them off. (Defaults
+// are template arguments, so they must be integers or bools. Integers are fine for float
+// parameters too.)
+//
+// The method is called as an expression, not through a member pointer, so overloads and
+// parameter conversions are resolved as they would be in a hand-written wrapper, and the
+// signature is the one the wrapper would have used. It needn't match the declaration in the
+// EVN library exactly.
+//
+// Each class used needs LUA_CLASS( EVNMotor, CLASS_MOTOR ) in the file, to say which
+// LuaClassId it is checked as. Parameters that are pointers to a LUA_CLASS class are read as
+// objects of that class.
+//
+// Methods that need more than this, such as overloads picked by the number of arguments,
+// are still written by hand.
+//
+
+#ifndef LUA_BIND_H
+#define LUA_BIND_H  1
+
+#include <stddef.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "lua.hpp"
+
+#include "lua_tools.h"
+
+
+// Which LuaClassId objects of type C are.
+template<typename C> struct LuaClass;
+
+#define LUA_CLASS( type, id ) \
+    template<> struct LuaClass<type> { static constexpr LuaClassId classId = id; }
+
+
+// A method entry for a RoEntry methods table.
+#define RO_METHOD( name, type, method, signature, ... ) \
+    RO_FUNC( name, ([]( lua_State *L ) -> int { \
+        return lua_bind::callMethod<type, signature, ##__VA_ARGS__>( L, \
+            []( type *obj, auto... args ) { return obj->method( args... ); } ); \
+    }) )
+
+
+
+namespace lua_bind {
+
+template<typename S> struct Signature;
+
+template<typename R, typename... A>
+struct Signature<R ( A... )> {
+    typedef R Result;
+    static constexpr size_t numArgs = sizeof...(A);
+    template<size_t I> using Arg = typename std::tuple_element<I, std::tuple<A...>>::type;
+};
+
+
+template<typename T, typename = void> struct IsLuaClass : std::false_type {};
+template<typename T> struct IsLuaClass<T, decltype( (void)LuaClass<T>::classId )> : std::true_type {};
+
+
+// Read the argument at idx as a T.
+template<typename T>
+T getArg( lua_State *L, int idx )
+{
+    typedef typename std::remove_cv<typename std::remove_reference<T>::type>::type V;
+
+    if constexpr( std::is_same<V, bool>::value )
+    {
+        // Numbers are accepted as well, as some scripts pass 0 and 1 for flags.
+        if( lua_type( L, idx ) == LUA_TNUMBER )
+        {
+            return lua_tonumber( L, idx ) != 0;
+        }
+        luaL_checktype( L, idx, LUA_TBOOLEAN );
+        return lua_toboolean( L, idx );
+    }
+    else if constexpr( std::is_integral<V>::value || std::is_enum<V>::value )
+    {
+        return (V)luaL_checkinteger( L, idx );
+    }
+    else if constexpr( std::is_floating_point<V>::value )
+    {
+        return (V)luaL_checknumber( L, idx );
+    }
+    else if constexpr( std::is_same<V, const char*>::value )
+    {
+        return luaL_checkstring( L, idx );
+    }
+    else if constexpr( std::is_pointer<V>::value && IsLuaClass<typename std::remove_pointer<V>::type>::value )
+    {
+        return (V)checkObject( L, idx, LuaClass<typename std::remove_pointer<V>::type>::classId );
+    }
+    else
+    {
+        static_assert( sizeof(V) == 0, "No Lua binding for this parameter type" );
+    }
+}
+
+
+// Push a result of the method as an R.
+template<typename R, typename V>
+int pushResult( lua_State *L, V value )
+{
+    if constexpr( std::is_same<R, bool>::value )
+    {
+        lua_pushboolean( L, value );
+    }
+    else if constexpr( std::is_integral<R>::value || std::is_enum<R>::value )
+    {
+        lua_pushinteger( L, (lua_Integer)value );
+    }
+    else if constexpr( std::is_floating_point<R>::value )
+    {
+        lua_pushnumber( L, (lua_Number)value );
+    }
+    else
+    {
+        static_assert( sizeof(R) == 0, "No Lua binding for this result type" );
+    }
+
+    return 1;
+}
+
+
+template<size_t I, auto First, auto... Rest>
+constexpr auto nthDefault()
+{
+    if constexpr( I == 0 )
+    {
+        return First;
+    }
+    else
+    {
+        return nthDefault<I - 1, Rest...>();
+    }
+}
+
+
+// Method argument I (0 based), which is at stack index I + 2, after 'self'.
+template<typename Traits, size_t I, auto... Defaults>
+typename Traits::template Arg<I> methodArg( lua_State *L )
+{
+    typedef typename Traits::template Arg<I> T;
+    constexpr size_t firstDefault = Traits::numArgs - sizeof...(Defaults);
+
+    if constexpr( I >= firstDefault )
+    {
+        if( lua_isnone( L, I + 2 ) )
+        {
+            return (T)nthDefault<I - firstDefault, Defaults...>();
+        }
+    }
+
+    return getArg<T>( L, I + 2 );
+}
+
+
+template<typename C, typename Sig, auto... Defaults, typename Call, size_t... I>
+int callWithArgs( lua_State *L, Call call, std::index_sequence<I...> )
+{
+    typedef typename Sig::Result R;
+
+    C *obj = (C*)checkObject( L, 1, LuaClass<C>::classId );
+
+    if constexpr( std::is_void<R>::value )
+    {
+        call( obj, methodArg<Sig, I, Defaults...>( L )... );
+        return 0;
+    }
+    else
+    {
+        return pushResult<R>( L, call( obj, methodArg<Sig, I, Defaults...>( L )... ) );
+    }
+}
+
+
+// Call the method through call( obj, args... ), with the arguments of signature S.
+template<typename C, typename S, auto... Defaults, typename Call>
+int callMethod( lua_State *L, Call call )
+{
+    typedef Signature<S> Sig;
+    static_assert( sizeof...(Defaults) <= Sig::numArgs, "More defaults than arguments" );
+
+    return callWithArgs<C, Sig, Defaults...>( L, call, std::make_index_sequence<Sig::numArgs>() );
+}
+
+}   // namespace lua_bind
+
+#endif
@@ -0,0 +1,905 @@
+// lua_pool.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua_pool.h"
+
+
+#define ALIGN           8
+
+// Sizes below this are all in the first TLSF range, in steps of ALIGN.
+#define FL_SHIFT        (POOL_SL_BITS + 3)
+
+#define BLOCK_FREE      1
+
+
+// A block of the TLSF heap. The header is followed by the payload.
+struct PoolHeapBlock {
+    PoolHeapBlock *prevPhys;    // The block before this one in the arena, NULL for the first
+    size_t size;                // Payload bytes, with BLOCK_FREE set while the block is free
+
+    // Only in free blocks, in what is otherwise the payload.
+    PoolHeapBlock *nextFree;
+    PoolHeapBlock *prevFree;
+};
+
+#define BLOCK_HEADER    offsetof(PoolHeapBlock, nextFree)
+#define BLOCK_MIN       (sizeof(PoolHeapBlock) - BLOCK_HEADER)
+
+
+struct PoolBlock {
+    PoolBlock *next;
+};
+
+
+// A page of small blocks. Pages are heap blocks whose payload starts on a POOL_PAGE_SIZE
+// boundary (counted from the start of the arena), so the page a block belongs to can be
+// found from the block's address.
+struct PoolPage {
+    PoolPage *next;             // In its class's list of pages with free blocks
+    PoolPage *prev;
+
+    PoolBlock *freeList;
+    uint8_t *carve;             // Start of the part of the page not handed out yet
+    uint32_t inUse;
+};
+
+#define PAGE_HEADER     ((sizeof(PoolPage) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+// The payload of a page's heap block. It stops short of the next page boundary by the size of
+// a block header, so that pages can sit next to each other.
+#define PAGE_PAYLOAD    (POOL_PAGE_SIZE - BLOCK_HEADER)
+
+// The most free blocks of just a page's size to look at for one on a page boundary.
+#define PAGE_HOLE_TRIES 4
+
+
+
+static const uint16_t classSizes[POOL_NUM_CLASSES] = {
+    16, 24, 32, 40, 48, 64, 96, 128
+};
+
+// Size class for each size in 8 byte units, (size + 7) / 8.
+const uint8_t poolClassForUnits[POOL_MAX_SMALL / 8 + 1] = {
+    0,                  // 0
+    0, 0,               // 8, 16
+    1,                  // 24
+    2,                  // 32
+    3,                  // 40
+    4,                  // 48
+    5, 5,               // 56, 64
+    6, 6, 6, 6,         // 72 - 96
+    7, 7, 7, 7          // 104 - 128
+};
+
+
+static inline int sizeClass( size_t size )
+{
+    return poolSizeClass( size );
+}
+
+
+static inline bool inArena( const LuaPool *pool, const void *ptr )
+{
+    return (const uint8_t*)ptr >= pool->arena && (const uint8_t*)ptr < pool->arena + pool->arenaSize;
+}
+
+
+static inline size_t blockSize( const PoolHeapBlock *b )
+{
+    return b->size & ~(size_t)BLOCK_FREE;
+}
+
+static inline bool isFree( const PoolHeapBlock *b )
+{
+    return (b->size & BLOCK_FREE) != 0;
+}
+
+static inline uint8_t *payloadOf( const PoolHeapBlock *b )
+{
+    return (uint8_t*)b + BLOCK_HEADER;
+}
+
+static inline PoolHeapBlock *blockOf( const void *ptr )
+{
+    return (PoolHeapBlock*)((uint8_t*)ptr - BLOCK_HEADER);
+}
+
+static inline PoolHeapBlock *nextPhys( const PoolHeapBlock *b )
+{
+    return (PoolHeapBlock*)(payloadOf( b ) + blockSize( b ));
+}
+
+static inline PoolPage *pageOf( const LuaPool *pool, const void *ptr )
+{
+    return (PoolPage*)(pool->arena + (((const uint8_t*)ptr - pool->arena) & ~(size_t)(POOL_PAGE_SIZE - 1)));
+}
+
+static inline uint8_t *pageEnd( const PoolPage *page )
+{
+    return (uint8_t*)page + PAGE_PAYLOAD;
+}
+
+
+static void *allocSmall( LuaPool *pool, int cls );
+static void freeSmall( LuaPool *pool, void *ptr, int cls );
+static bool pageFull( const PoolPage *page, size_t size );
+static void linkPage( PoolClass *pc, PoolPage *page );
+static void unlinkPage( PoolClass *pc, PoolPage *page );
+
+static void release( LuaPool *pool, void *ptr, size_t osize, bool pooled );
+
+static PoolHeapBlock *heapAlloc( LuaPool *pool, size_t size );
+static PoolHeapBlock *heapAllocPage( LuaPool *pool );
+static bool heapResize( LuaPool *pool, PoolHeapBlock *b, size_t size );
+static void heapFree( LuaPool *pool, PoolHeapBlock *b );
+
+static size_t adjustSize( size_t size );
+static int fls( size_t x );
+static void mapping( size_t size, int *fl, int *sl );
+static PoolHeapBlock *findFree( LuaPool *pool, size_t size );
+static void insertFree( LuaPool *pool, PoolHeapBlock *b );
+static void removeFree( LuaPool *pool, PoolHeapBlock *b );
+static void split( LuaPool *pool, PoolHeapBlock *b, size_t size );
+static void freeBlock( LuaPool *pool, PoolHeapBlock *b );
+static uint8_t *pagePayload( const LuaPool *pool, const PoolHeapBlock *b );
+
+
+
+void poolInit( LuaPool *pool, size_t arenaSize )
+{
+    memset( pool, 0, sizeof(LuaPool) );
+
+    // The size ranges only go so high.
+    const size_t maxArena = (size_t)1 << (POOL_FL_COUNT + FL_SHIFT - 1);
+    if( arenaSize > maxArena )
+    {
+        arenaSize = maxArena;
+    }
+    arenaSize &= ~(size_t)(ALIGN - 1);
+
+    if( arenaSize < POOL_PAGE_SIZE + 2 * BLOCK_HEADER )
+    {
+        return;
+    }
+
+    pool->arena = (uint8_t*)malloc( arenaSize );
+    if( pool->arena == NULL )
+    {
+        return;
+    }
+    pool->arenaSize = arenaSize;
+
+    // One free block of the whole arena, and an empty in-use block at the end so that
+    // nextPhys() never runs off it.
+    PoolHeapBlock *first = (PoolHeapBlock*)pool->arena;
+    first->prevPhys = NULL;
+    first->size = arenaSize - 2 * BLOCK_HEADER;
+
+    PoolHeapBlock *last = nextPhys( first );
+    last->prevPhys = first;
+    last->size = 0;
+
+    insertFree( pool, first );
+}
+
+
+size_t poolClassSize( int cls )
+{
+    return classSizes[cls];
+}
+
+
+void *poolAlloc( LuaPool *pool, void *ptr, size_t osize, size_t nsize )
+{
+    // When ptr is NULL, osize is the type of object being allocated, not a size.
+    if( ptr == NULL )
+    {
+        osize = 0;
+    }
+
+    const bool wasPooled = ptr != NULL && inArena( pool, ptr );
+
+    if( nsize == 0 )
+    {
+        // Free
+        if( ptr )
+        {
+            release( pool, ptr, osize, wasPooled );
+        }
+        return NULL;
+    }
+
+    if( wasPooled )
+    {
+        if( osize <= POOL_MAX_SMALL )
+        {
+            if( nsize <= POOL_MAX_SMALL && sizeClass( nsize ) == sizeClass( osize ) )
+            {
+                // Still fits the same size class.
+                return ptr;
+            }
+        }
+        else if( nsize > POOL_MAX_SMALL && heapResize( pool, blockOf( ptr ), nsize ) )
+        {
+            // Large to large, resized in place.
+            return ptr;
+        }
+    }
+
+    // Allocate a new block, from the arena if there's room...
+    void *p = NULL;
+
+    if( nsize <= POOL_MAX_SMALL )
+    {
+        p = allocSmall( pool, sizeClass( nsize ) );
+    }
+    else
+    {
+        PoolHeapBlock *b = heapAlloc( pool, nsize );
+        if( b )
+        {
+            pool->heapBlocks++;
+            p = payloadOf( b );
+        }
+    }
+
+    if( p == NULL )
+    {
+        // ...otherwise from the C heap.
+        pool->fallbacks++;
+
+        if( ptr != NULL && ! wasPooled )
+        {
+            // Already there, let the C heap resize it in place if it can.
+            p = realloc( ptr, nsize );
+            if( p == NULL )
+            {
+                pool->failures++;
+            }
+            return p;
+        }
+
+        p = malloc( nsize );
+        if( p == NULL )
+        {
+            // Lua will collect garbage and try again.
+            pool->failures++;
+            return NULL;
+        }
+
+        pool->largeBlocks++;
+    }
+
+    // ...and move the old one into it.
+    if( ptr )
+    {
+        memcpy( p, ptr, (osize < nsize) ? osize : nsize );
+        release( pool, ptr, osize, wasPooled );
+    }
+
+    return p;
+}
+
+
+size_t poolLargestFree( const LuaPool *pool )
+{
+    if( pool->flBitmap == 0 )
+    {
+        return 0;
+    }
+
+    // The largest blocks are in the highest list, though not in any order within it.
+    const int fl = fls( pool->flBitmap );
+    const int sl = fls( pool->slBitmap[fl] );
+
+    size_t largest = 0;
+    for( const PoolHeapBlock *b = pool->freeLists[fl][sl]; b; b = b->nextFree )
+    {
+        if( blockSize( b ) > largest )
+        {
+            largest = blockSize( b );
+        }
+    }
+
+    return largest;
+}
+
+
+bool poolCheck( const LuaPool *pool )
+{
+    if( pool->arena == NULL )
+    {
+        return true;
+    }
+
+    // Walk the blocks in address order.
+    size_t used = 0;
+    uint32_t freeBlocks = 0;
+    const PoolHeapBlock *prev = NULL;
+    const PoolHeapBlock *b = (const PoolHeapBlock*)pool->arena;
+
+    while( blockSize( b ) != 0 )
+    {
+        if( b->prevPhys != prev || (blockSize( b ) & (ALIGN - 1)) != 0 )
+        {
+            return false;
+        }
+
+        if( isFree( b ) )
+        {
+            // Free blocks are joined to free neighbours, and are in the list for their size.
+            if( prev && isFree( prev ) )
+            {
+                return false;
+            }
+
+            int fl, sl;
+            mapping( blockSize( b ), &fl, &sl );
+
+            const PoolHeapBlock *f = pool->freeLists[fl][sl];
+            while( f && f != b )
+            {
+                f = f->nextFree;
+            }
+            if( f == NULL )
+            {
+                return false;
+            }
+            freeBlocks++;
+        }
+        else
+        {
+            used += BLOCK_HEADER + blockSize( b );
+        }
+
+        prev = b;
+        b = nextPhys( b );
+        if( ! inArena( pool, b ) )
+        {
+            return false;
+        }
+    }
+
+    if( b->prevPhys != prev || (const uint8_t*)b + BLOCK_HEADER != pool->arena + pool->arenaSize )
+    {
+        return false;
+    }
+
+    if( used != pool->arenaUsed )
+    {
+        return false;
+    }
+
+    // Every listed block is free, and the bitmaps match the lists.
+    uint32_t listed = 0;
+    for( int fl = 0; fl < POOL_FL_COUNT; fl++ )
+    {
+        for( int sl = 0; sl < POOL_SL_COUNT; sl++ )
+        {
+            const PoolHeapBlock *f = pool->freeLists[fl][sl];
+
+            const bool bit = (pool->slBitmap[fl] & (1u << sl)) != 0;
+            if( bit != (f != NULL) )
+            {
+                return false;
+            }
+
+            for( ; f; f = f->nextFree )
+            {
+                if( ! isFree( f ) )
+                {
+                    return false;
+                }
+                listed++;
+            }
+        }
+
+        if( ((pool->flBitmap & (1u << fl)) != 0) != (pool->slBitmap[fl] != 0) )
+        {
+            return false;
+        }
+    }
+
+    if( listed != freeBlocks )
+    {
+        return false;
+    }
+
+    // Pages with free blocks are in use, and really do have free blocks.
+    for( int cls = 0; cls < POOL_NUM_CLASSES; cls++ )
+    {
+        for( const PoolPage *page = pool->classes[cls].partial; page; page = page->next )
+        {
+            if( ! inArena( pool, page ) || isFree( blockOf( page ) ) || pageFull( page, classSizes[cls] ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+//==================================================================================
+
+static void *allocSmall( LuaPool *pool, int cls )
+{
+    PoolClass *pc = &pool->classes[cls];
+    const size_t size = classSizes[cls];
+
+    PoolPage *page = pc->partial;
+    if( page == NULL )
+    {
+        // Need a new page.
+        PoolHeapBlock *b = heapAllocPage( pool );
+        if( b == NULL )
+        {
+            return NULL;
+        }
+
+        page = (PoolPage*)payloadOf( b );
+        page->freeList = NULL;
+        page->carve = (uint8_t*)page + PAGE_HEADER;
+        page->inUse = 0;
+        linkPage( pc, page );
+        pc->pages++;
+    }
+
+    void *p;
+
+    PoolBlock *fb = page->freeList;
+    if( fb )
+    {
+        page->freeList = fb->next;
+        p = fb;
+    }
+    else
+    {
+        p = page->carve;
+        page->carve += size;
+    }
+
+    page->inUse++;
+    pc->inUse++;
+
+    if( pageFull( page, size ) )
+    {
+        unlinkPage( pc, page );
+    }
+
+    return p;
+}
+
+
+static void freeSmall( LuaPool *pool, void *ptr, int cls )
+{
+    PoolClass *pc = &pool->classes[cls];
+    PoolPage *page = pageOf( pool, ptr );
+
+    const bool wasFull = pageFull( page, classSizes[cls] );
+
+    PoolBlock *b = (PoolBlock*)ptr;
+    b->next = page->freeList;
+    page->freeList = b;
+    page->inUse--;
+    pc->inUse--;
+
+    if( wasFull )
+    {
+        linkPage( pc, page );
+    }
+
+    if( page->inUse == 0 && (pc->partial != page || page->next != NULL) )
+    {
+        // Give the page back, keeping one (this one, if it's the only one) for the next
+        // allocations of this size.
+        unlinkPage( pc, page );
+        heapFree( pool, blockOf( page ) );
+        pc->pages--;
+    }
+}
+
+
+static bool pageFull( const PoolPage *page, size_t size )
+{
+    return page->freeList == NULL && page->carve + size > pageEnd( page );
+}
+
+
+static void linkPage( PoolClass *pc, PoolPage *page )
+{
+    page->prev = NULL;
+    page->next = pc->partial;
+    if( pc->partial )
+    {
+        pc->partial->prev = page;
+    }
+    pc->partial = page;
+}
+
+
+static void unlinkPage( PoolClass *pc, PoolPage *page )
+{
+    if( page->prev )
+    {
+        page->prev->next = page->next;
+    }
+    else
+    {
+        pc->partial = page->next;
+    }
+
+    if( page->next )
+    {
+        page->next->prev = page->prev;
+    }
+}
+
+
+static void release( LuaPool *pool, void *ptr, size_t osize, bool pooled )
+{
+    if( ! pooled )
+    {
+        free( ptr );
+        pool->largeBlocks--;
+    }
+    else if( osize <= POOL_MAX_SMALL )
+    {
+        freeSmall( pool, ptr, sizeClass( osize ) );
+    }
+    else
+    {
+        heapFree( pool, blockOf( ptr ) );
+        pool->heapBlocks--;
+    }
+}
+
+
+//==================================================================================
+//
+// The TLSF heap
+//
+// Free blocks are listed by size, in POOL_FL_COUNT power of two ranges (the first range
+// covers everything under 1 << FL_SHIFT), each split POOL_SL_COUNT ways. A bit is set in
+// slBitmap[fl] for each list with blocks, and in flBitmap for each range with any lists.
+//
+// To allocate, the size is rounded up to the next list boundary, so that any block in the
+// list found is big enough, and the bitmaps give the first list with blocks at or above it.
+// A block that is larger than asked for is split, and freed blocks are joined to free
+// neighbours, so there are never two free blocks next to each other.
+//
+
+static PoolHeapBlock *heapAlloc( LuaPool *pool, size_t size )
+{
+    size = adjustSize( size );
+
+    PoolHeapBlock *b = findFree( pool, size );
+    if( b == NULL )
+    {
+        return NULL;
+    }
+
+    split( pool, b, size );
+    pool->arenaUsed += BLOCK_HEADER + blockSize( b );
+
+    return b;
+}
+
+
+/**
+ * A block for a page, with its payload on a page boundary.
+ */
+static PoolHeapBlock *heapAllocPage( LuaPool *pool )
+{
+    // A page that was given back leaves a hole of just the right size and alignment, so look
+    // for one of those first.
+    int fl, sl;
+    mapping( PAGE_PAYLOAD, &fl, &sl );
+
+    PoolHeapBlock *b = pool->freeLists[fl][sl];
+    for( int i = 0; b && i < PAGE_HOLE_TRIES; i++, b = b->nextFree )
+    {
+        if( pagePayload( pool, b ) )
+        {
+            break;
+        }
+    }
+
+    if( b )
+    {
+        removeFree( pool, b );
+    }
+    else
+    {
+        // Then the smallest block that might hold one, which is often the free space at the
+        // end of the pages...
+        b = findFree( pool, PAGE_PAYLOAD );
+        if( b && pagePayload( pool, b ) == NULL )
+        {
+            insertFree( pool, b );
+
+            // ...and otherwise a block big enough to hold a page wherever it starts.
+            b = findFree( pool, PAGE_PAYLOAD + POOL_PAGE_SIZE + BLOCK_HEADER + BLOCK_MIN );
+        }
+
+        if( b == NULL )
+        {
+            return NULL;
+        }
+    }
+
+    uint8_t *p = pagePayload( pool, b );
+    if( p != payloadOf( b ) )
+    {
+        // Split off the part before the page boundary as a free block. The block before it
+        // isn't free, or they would have been joined.
+        PoolHeapBlock *page = blockOf( p );
+        page->prevPhys = b;
+        page->size = blockSize( b ) - (p - payloadOf( b ));
+        nextPhys( page )->prevPhys = page;
+
+        b->size = (uint8_t*)page - payloadOf( b );
+        insertFree( pool, b );
+
+        b = page;
+    }
+
+    split( pool, b, PAGE_PAYLOAD );
+    pool->arenaUsed += BLOCK_HEADER + blockSize( b );
+
+    return b;
+}
+
+
+/**
+ * Resize a block where it is, if it can be.
+ */
+static bool heapResize( LuaPool *pool, PoolHeapBlock *b, size_t size )
+{
+    size = adjustSize( size );
+
+    const size_t current = blockSize( b );
+
+    if( size > current )
+    {
+        // Grow into the next block, if it's free and big enough.
+        PoolHeapBlock *next = nextPhys( b );
+        if( ! isFree( next ) || current + BLOCK_HEADER + blockSize( next ) < size )
+        {
+            return false;
+        }
+
+        removeFree( pool, next );
+        b->size = current + BLOCK_HEADER + blockSize( next );
+        nextPhys( b )->prevPhys = b;
+    }
+
+    split( pool, b, size );
+    pool->arenaUsed = pool->arenaUsed - current + blockSize( b );
+
+    return true;
+}
+
+
+static void heapFree( LuaPool *pool, PoolHeapBlock *b )
+{
+    pool->arenaUsed -= BLOCK_HEADER + blockSize( b );
+    freeBlock( pool, b );
+}
+
+
+/**
+ * Round a size up to the alignment, and to at least the room needed to list it when free.
+ */
+static size_t adjustSize( size_t size )
+{
+    size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    return (size < BLOCK_MIN) ? BLOCK_MIN : size;
+}
+
+
+/**
+ * The index of the highest bit set in x, which must not be zero.
+ */
+static int fls( size_t x )
+{
+    return (int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl( (unsigned long)x );
+}
+
+
+static void mapping( size_t size, int *fl, int *sl )
+{
+    if( size < (1 << FL_SHIFT) )
+    {
+        *fl = 0;
+        *sl = (int)(size >> 3);
+    }
+    else
+    {
+        const int f = fls( size );
+        *sl = (int)(size >> (f - POOL_SL_BITS)) ^ POOL_SL_COUNT;
+        *fl = f - FL_SHIFT + 1;
+    }
+}
+
+
+/**
+ * Take a free block of at least the given size off its list.
+ */
+static PoolHeapBlock *findFree( LuaPool *pool, size_t size )
+{
+    if( size >= (1 << FL_SHIFT) )
+    {
+        // Round up to the next list, where every block is big enough.
+        size += ((size_t)1 << (fls( size ) - POOL_SL_BITS)) - 1;
+    }
+
+    int fl, sl;
+    mapping( size, &fl, &sl );
+    if( fl >= POOL_FL_COUNT )
+    {
+        return NULL;
+    }
+
+    uint32_t slMap = pool->slBitmap[fl] & (~0u << sl);
+    if( slMap == 0 )
+    {
+        const uint32_t flMap = pool->flBitmap & (~0u << (fl + 1));
+        if( flMap == 0 )
+        {
+            return NULL;
+        }
+
+        fl = __builtin_ctz( flMap );
+        slMap = pool->slBitmap[fl];
+    }
+    sl = __builtin_ctz( slMap );
+
+    PoolHeapBlock *b = pool->freeLists[fl][sl];
+    removeFree( pool, b );
+
+    return b;
+}
+
+
+static void insertFree( LuaPool *pool, PoolHeapBlock *b )
+{
+    int fl, sl;
+    mapping( blockSize( b ), &fl, &sl );
+
+    b->size |= BLOCK_FREE;
+
+    PoolHeapBlock *head = pool->freeLists[fl][sl];
+    b->nextFree = head;
+    b->prevFree = NULL;
+    if( head )
+    {
+        head->prevFree = b;
+    }
+    pool->freeLists[fl][sl] = b;
+
+    pool->slBitmap[fl] |= 1u << sl;
+    pool->flBitmap |= 1u << fl;
+}
+
+
+static void removeFree( LuaPool *pool, PoolHeapBlock *b )
+{
+    int fl, sl;
+    mapping( blockSize( b ), &fl, &sl );
+
+    if( b->prevFree )
+    {
+        b->prevFree->nextFree = b->nextFree;
+    }
+    else
+    {
+        pool->freeLists[fl][sl] = b->nextFree;
+        if( b->nextFree == NULL )
+        {
+            pool->slBitmap[fl] &= ~(1u << sl);
+            if( pool->slBitmap[fl] == 0 )
+            {
+                pool->flBitmap &= ~(1u << fl);
+            }
+        }
+    }
+
+    if( b->nextFree )
+    {
+        b->nextFree->prevFree = b->prevFree;
+    }
+
+    b->size &= ~(size_t)BLOCK_FREE;
+}
+
+
+/**
+ * Cut an in-use block down to the given size, freeing the rest if it's big enough to be a block.
+ */
+static void split( LuaPool *pool, PoolHeapBlock *b, size_t size )
+{
+    const size_t current = blockSize( b );
+    if( current < size + BLOCK_HEADER + BLOCK_MIN )
+    {
+        return;
+    }
+
+    b->size = size;
+
+    PoolHeapBlock *rest = nextPhys( b );
+    rest->prevPhys = b;
+    rest->size = current - size - BLOCK_HEADER;
+    nextPhys( rest )->prevPhys = rest;
+
+    freeBlock( pool, rest );
+}
+
+
+/**
+ * List a block that is no longer in use, first joining it to any free neighbours.
+ */
+static void freeBlock( LuaPool *pool, PoolHeapBlock *b )
+{
+    PoolHeapBlock *prev = b->prevPhys;
+    if( prev && isFree( prev ) )
+    {
+        removeFree( pool, prev );
+        prev->size = blockSize( prev ) + BLOCK_HEADER + blockSize( b );
+        b = prev;
+        nextPhys( b )->prevPhys = b;
+    }
+
+    PoolHeapBlock *next = nextPhys( b );
+    if( isFree( next ) )
+    {
+        removeFree( pool, next );
+        b->size = blockSize( b ) + BLOCK_HEADER + blockSize( next );
+        nextPhys( b )->prevPhys = b;
+    }
+
+    insertFree( pool, b );
+}
+
+
+/**
+ * Where a page would start in a free block, or NULL if one doesn't fit.
+ */
+static uint8_t *pagePayload( const LuaPool *pool, const PoolHeapBlock *b )
+{
+    uint8_t *start = payloadOf( b );
+
+    const size_t offset = (start - pool->arena) & (POOL_PAGE_SIZE - 1);
+    uint8_t *p = (offset == 0) ? start : start + (POOL_PAGE_SIZE - offset);
+
+    // The part left in front of the page must be big enough to be a free block.
+    if( p != start && (size_t)(p - start) < BLOCK_HEADER + BLOCK_MIN )
+    {
+        p += POOL_PAGE_SIZE;
+    }
+
+    if( p + PAGE_PAYLOAD > start + blockSize( b ) )
+    {
+        return NULL;
+    }
+
+    return p;
+}
@@ -0,0 +1,118 @@
+// lua_pool.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Pool allocator for a Lua state.
+//
+// Most Lua allocations are small (strings, table nodes, closures, upvalues) and short lived.
+// Mixing them in with the large table and stack blocks in the C heap is what fragments it.
+// Here, everything comes from an arena that is reserved when the state is created:
+//
+// Small blocks are taken from per-size-class free lists, filled by carving up fixed size
+// pages. Blocks of any one size class are interchangeable, so the pages can't fragment.
+// No headers are needed, because Lua always tells the allocator the size of a block it frees.
+// A page that has no blocks in use is given back to the arena (unless it's the last one with
+// free blocks in its class), so a burst of one size doesn't tie up the arena for good.
+//
+// Pages and the larger blocks come from a TLSF (two level segregated fit) heap over the
+// arena. Free blocks are kept in lists by size range, found through two bitmaps, and joined
+// to their free neighbours when freed, so allocating and freeing are O(1) and the largest
+// free block stays large.
+//
+// Blocks only come from the C heap once the arena is used up.
+//
+// A pool is only ever used by one Lua state, so there is no locking.
+//
+
+#ifndef LUA_POOL_H
+#define LUA_POOL_H  1
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define POOL_NUM_CLASSES    8
+
+// Largest block size handled by the pools.
+#define POOL_MAX_SMALL      128
+
+#define POOL_PAGE_SIZE      1024
+
+// TLSF heap size ranges: each power of two size range is split into POOL_SL_COUNT lists.
+// 15 ranges covers an arena of up to 1 MB.
+#define POOL_SL_BITS        3
+#define POOL_SL_COUNT       (1 << POOL_SL_BITS)
+#define POOL_FL_COUNT       15
+
+
+struct PoolPage;
+struct PoolHeapBlock;
+
+
+struct PoolClass {
+    PoolPage *partial;          // Pages with free blocks
+
+    uint32_t pages;
+    uint32_t inUse;             // Blocks currently allocated
+};
+
+
+struct LuaPool {
+    uint8_t *arena;
+    size_t arenaSize;
+    size_t arenaUsed;           // Bytes of the arena in use, as pages and large blocks
+
+    PoolClass classes[POOL_NUM_CLASSES];
+
+    uint32_t heapBlocks;        // Large blocks currently allocated from the arena
+    uint32_t largeBlocks;       // Blocks currently allocated from the C heap
+    uint32_t fallbacks;         // Blocks that came from the C heap because the arena was full
+    uint32_t failures;          // Allocations that failed altogether
+
+    // The TLSF free lists
+    uint32_t flBitmap;
+    uint8_t slBitmap[POOL_FL_COUNT];
+    PoolHeapBlock *freeLists[POOL_FL_COUNT][POOL_SL_COUNT];
+};
+
+
+// Reserve the arena. If it can't be reserved, everything comes from the C heap.
+void poolInit( LuaPool *pool, size_t arenaSize );
+
+// lua_Alloc semantics.
+void *poolAlloc( LuaPool *pool, void *ptr, size_t osize, size_t nsize );
+
+// The block size of a size class.
+size_t poolClassSize( int cls );
+
+// The largest block that could be allocated from the arena right now.
+size_t poolLargestFree( const LuaPool *pool );
+
+// Walk the arena and check that its blocks and free lists are consistent. (For the tests.)
+bool poolCheck( const LuaPool *pool );
+
+
+// Size class for each size in 8 byte units. (Use poolSizeClass())
+extern const uint8_t poolClassForUnits[POOL_MAX_SMALL / 8 + 1];
+
+// The size class a block of the given size (no larger than POOL_MAX_SMALL) belongs to.
+static inline int poolSizeClass( size_t size )
+{
+    return poolClassForUnits[(size + 7) >> 3];
+}
+
+#endif
@@ -16,9 +16,11 @@
  */
 
 #include <Arduino.h>
+#include <limits.h>
 
 #if defined (ARDUINO_ARCH_RP2040)
 #include <SDFS.h>
+#include <pico/mutex.h>
 #else
 #include <SD.h>
 #endif
@@ -28,6 +30,15 @@
 #include "shell.h"
 #include "lua_tools.h"
 #include "lua_support.h"
+#include "lua_tasks.h"
+#include "event_queue.h"
+#include "output_buffer.h"
+#include "loop_stats.h"
+#include "lua_pool.h"
+#include "mem_stats.h"
+#include "bytecode_cache.h"
+#include "file_reader.h"
+#include "embedded_modules.h"
 
 #include "lib_platform.h"
 #include "lib_arduino.h"
@@ -40,15 +51,123 @@
 
 #define DEBUG_ENABLED   1
 
+// Set to 0 to give Lua the plain C heap allocator instead. (For comparison.)
+#define POOL_ALLOCATOR_ENABLED  1
+
+// Bytes reserved for each state's allocator. (Once it's used up, blocks come from the C heap.)
+#define POOL_ARENA_SIZE0        (96 * 1024)
+#define POOL_ARENA_SIZE1        (24 * 1024)
+
 
 bool execLoopEnabled = true;
 bool housekeepingLoopEnabled = true;
+volatile bool loop1Enabled = true;
 
 
 // Set true when the core0 Lua setup() function has been called.
 static bool setupFuncCalled = false;
 
-static struct lua_State *luaState;
+// Our error handler lives permanently at this Lua stack slot so it doesn't need to be
+// pushed for every function call.
+#define ERROR_HANDLER_INDEX     1
+
+// Most events passed to Lua on each pass of the run loop.
+#define EVENT_BATCH_SIZE        16
+
+// Number of Lua instructions between checks of the time budget.
+#define BUDGET_HOOK_COUNT       1000
+
+// Idle garbage collection defaults
+#define IDLE_GC_STEP_MUL        200         // Percent
+#define IDLE_GC_MIN_SLACK       1000        // Microseconds
+#define IDLE_GC_MAX_DEBT        32          // KB
+
+
+//
+// The loop functions are called every pass, so the lookup of each one is kept cheap: the
+// name string is held in the registry, so it isn't made again every pass, and it is a raw
+// lookup in the global table. The global table stays an ordinary table, so any assignment
+// to the global (script reload, shell, rawset(), or the script itself) is seen on the next
+// pass, and scripts are free to give _G a metatable of their own.
+//
+// Each loop may also be given a fixed period, in which case it is called when its
+// deadline comes due rather than on every pass.
+//
+// Each Lua state has its own set of these, since the references are only valid in the
+// state that made them.
+//
+struct LoopFunction {
+    const char *name;
+    int nameRef;                // Registry reference to the name string
+    bool isFunction;            // As of the last lookup
+
+    unsigned long period;       // Microseconds, zero to run on every pass
+    unsigned long deadline;     // micros() time the loop is next due
+    unsigned long overruns;     // Number of deadlines missed entirely
+
+    unsigned long budget;       // Microseconds the loop may run for, zero for no limit
+};
+
+static const char * const loopFunctionNames[NUM_LOOP_FUNCTIONS] = {
+    "exec_loop",
+    "housekeeping_loop",
+    "loop1",
+    "event_handler",
+};
+
+// Where each loop function's call times are recorded.
+static const StatsPhase loopStatsPhases[NUM_LOOP_FUNCTIONS] = {
+    STATS_EXEC,
+    STATS_HOUSEKEEPING,
+    STATS_LOOP1,
+    STATS_EVENTS,
+};
+
+
+//
+// Everything that belongs to one Lua state.
+//
+// Core 0 always has a Lua state, which runs the shell and the exec and housekeeping loops.
+// Core 1 only gets a state of its own if there is a 'main1.lua' script, and runs loop1().
+// The two states never share anything, and a state is only ever used from its own core.
+//
+struct LuaContext {
+    lua_State *L;
+    LoopFunction loops[NUM_LOOP_FUNCTIONS];
+    TaskScheduler *tasks;
+
+    // The time budget being enforced, if any. (See startBudget())
+    lua_State *budgetThread;
+    const char *budgetName;
+    unsigned long budget;
+    unsigned long budgetStart;
+
+    GCMode gcMode;
+    int gcStepMul;
+    unsigned long gcMinSlack;
+    unsigned long gcMaxDebt;
+    size_t gcLastBytes;         // Heap size after the last pass
+    size_t gcDebt;              // Bytes allocated since the last idle step
+    LuaPool pool;
+    MemStats mem;
+
+    // Metatable of each class, for checkObject(). Filled in as the classes are used.
+    const void *classMetatables[NUM_LUA_CLASSES];
+};
+
+static LuaContext context0;
+static LuaContext context1;
+
+// Set on each core while its loop functions, event handler and tasks are running. print() output
+// from them follows the output buffer's overflow policy, rather than holding up the loop.
+// Anywhere else (shell commands, setup()) it waits for room, so none is lost.
+static volatile bool inRunLoop[2];
+
+
+#if defined (ARDUINO_ARCH_RP2040)
+// Both cores may access the filesystem, which isn't safe to use concurrently.
+auto_init_recursive_mutex( filesystemMutex );
+#endif
 
 /**
  * these libs are loaded by lua.c and are readily available to any Lua
@@ -70,12 +189,35 @@ static const luaL_Reg loadedlibs[] = {
 
 
 static void debug( const char *format, ... );
+static void writeOutput( const char *p, size_t len );
+
+static lua_State *newLuaState( LuaContext *ctx, size_t arenaSize );
+static void *luaAlloc( void *ud, void *ptr, size_t osize, size_t nsize );
+static int panic( lua_State *L );
 
 static bool findFunction( lua_State *L, const char *name );
 
+static void registerLoopFunctions( lua_State *L, LuaContext *ctx );
+static void resolveLoopFunctions( lua_State *L, LuaContext *ctx );
+static bool pushLoopFunction( lua_State *L, LuaContext *ctx, LoopFunctionId id );
+static bool loopIsDue( LoopFunction *lf, bool enabled, unsigned long now );
+
 static int callFunction( lua_State *L, int numArgs, int numRets );
-static void callEvent( lua_State *L, const char *name, const void *data, int size );
+static bool callLoopFunction( lua_State *L, LuaContext *ctx, LoopFunctionId id );
+
+static LuaContext *contextOf( lua_State *L );
 
+static void idleCollect( lua_State *L, LuaContext *ctx );
+static long loopSlack( LuaContext *ctx, unsigned long now );
+static size_t heapBytes( lua_State *L );
+static void budgetHook( lua_State *L, lua_Debug *ar );
+static void hookCoroutines( lua_State *L );
+static int coroutineCreate( lua_State *L );
+static int coroutineWrap( lua_State *L );
+static bool handleEvents( lua_State *L, LuaContext *ctx );
+static void callEvent( lua_State *L, LuaContext *ctx, const Event *ev );
+
+static bool scriptExists( const char *name );
 static int loadScript( lua_State *L, const char *name );
 static int callScript( lua_State *L );
 
@@ -84,16 +226,404 @@ static int errorHandler( lua_State *L );
 
 static void registerSearcher( lua_State *L );
 static int arduinoSearcher( lua_State *L );
+static int embeddedSearcher( lua_State *L );
+static int moduleLoader( lua_State *L );
+static int closeModuleGuard( lua_State *L );
 static void registerPreloads( lua_State* const L );
 
 
 
 void setupLua()
 {
-    luaState = luaL_newstate();
+    initOutput();
+    initEvents();
+
+    struct lua_State *L = newLuaState( &context0, POOL_ARENA_SIZE0 );
+
+    // This will load and run the initial Lua source file.
+    debug( "Loading the 'main.lua' script" );
+    loadLuaFile( L, "main" );
+
+    // The init event gets called the first time we load the script only.
+    if( findFunction( L, "setup" ) )
+    {
+        debug( "Calling the Lua script 'setup' function");
+        callFunction( L, 0, 0 );
+        setupFuncCalled = true;
+    }
+
+    debug( "lua_Integer=%d  int=%d   long=%d   size_t=%d", sizeof(lua_Integer), sizeof(int), sizeof(long), sizeof(size_t) );
+    debug( "lua_Number=%d   float=%d   double=%d", sizeof(lua_Number), sizeof(float), sizeof(double) );
+
+    debug( "Lua setup 0 complete." );
+}
+
+
+void setupLua1()
+{
+    struct lua_State *L;
 
-    struct lua_State *L = luaState;
+    if( scriptExists( "main1" ) || findEmbeddedModule( "main1" ) )
+    {
+        // Core 1 gets a Lua state of its own.
+        L = newLuaState( &context1, POOL_ARENA_SIZE1 );
+
+        debug( "Loading the 'main1.lua' script" );
+        loadLuaFile( L, "main1" );
+    }
+    else
+    {
+        // No core 1 script, so setup1() comes from the core 0 state. (Core 0 is waiting for
+        // us to finish, so it is safe to borrow its state here.)
+        L = context0.L;
+    }
 
+    // The init event gets called the first time we load the script only.
+    if( findFunction( L, "setup1" ) )
+    {
+        debug( "Calling the Lua script 'setup1' function");
+        callFunction( L, 0, 0 );
+    }
+
+    debug( "Lua setup 1 complete." );
+}
+
+
+// Deal with the special case of no filesystem. (or at least, no `main.lua`)
+void checkLuaSetupFunction( lua_State *L )
+{
+  if( setupFuncCalled == false )
+  {
+      if( findFunction( L, "setup" ) )
+      {
+          debug( "Calling the Lua script 'setup' function");
+          callFunction( L, 0, 0 );
+          setupFuncCalled = true;
+      }
+  }
+}
+
+
+void runLua()
+{
+    struct lua_State *L = context0.L;
+
+    const unsigned long passStart = micros();
+
+    handleShell( L );
+
+    unsigned long t = lapLatency( STATS_SHELL, passStart );
+
+    inRunLoop[0] = true;
+
+    if( lua_gettop( L ) > 5 )
+    {
+        debug( "Stack %d, should never be this high", lua_gettop( L ) );
+    }
+
+    if( handleEvents( L, &context0 ) )
+    {
+        lapLatency( STATS_EVENTS, t );
+    }
+
+    const unsigned long now = micros();
+
+    if( loopIsDue( &context0.loops[EXEC_LOOP], execLoopEnabled, now ) )
+    {
+        if( ! callLoopFunction( L, &context0, EXEC_LOOP ) )
+        {
+            // If this function fails, stop trying to call it!
+            execLoopEnabled = false;
+        }
+    }
+
+    if( loopIsDue( &context0.loops[HOUSEKEEPING_LOOP], housekeepingLoopEnabled, now ) )
+    {
+        if( ! callLoopFunction( L, &context0, HOUSEKEEPING_LOOP ) )
+        {
+            // If this function fails, stop trying to call it!
+            housekeepingLoopEnabled = false;
+        }
+    }
+
+    t = micros();
+    if( runTasks( L, context0.tasks ) )
+    {
+        lapLatency( STATS_TASKS, t );
+    }
+
+    inRunLoop[0] = false;
+
+    idleCollect( L, &context0 );
+
+    // Send some of the buffered output (from either core).
+    drainOutput();
+
+    lapLatency( STATS_PASS, passStart );
+}
+
+
+void runLua1()
+{
+    struct lua_State *L = context1.L;
+
+    if( L == NULL )
+    {
+        // No core 1 Lua state, nothing to do.
+        return;
+    }
+
+    inRunLoop[1] = true;
+
+    if( loop1Enabled )
+    {
+        if( ! callLoopFunction( L, &context1, LOOP1 ) )
+        {
+            // If this function fails, stop trying to call it!
+            loop1Enabled = false;
+        }
+    }
+
+    runTasks( L, context1.tasks );
+
+    inRunLoop[1] = false;
+
+    idleCollect( L, &context1 );
+}
+
+
+void setLoopPeriod( LoopFunctionId id, unsigned long period )
+{
+    LoopFunction *lf = &context0.loops[id];
+
+    lf->period = period;
+    lf->deadline = micros();
+    lf->overruns = 0;
+}
+
+
+unsigned long loopPeriod( LoopFunctionId id )
+{
+    return context0.loops[id].period;
+}
+
+
+unsigned long loopOverruns( LoopFunctionId id )
+{
+    return context0.loops[id].overruns;
+}
+
+
+void setLoopBudget( LoopFunctionId id, unsigned long budget )
+{
+    // loop1 belongs to the core 1 state.
+    LuaContext *ctx = (id == LOOP1) ? &context1 : &context0;
+    ctx->loops[id].budget = budget;
+}
+
+
+unsigned long loopBudget( LoopFunctionId id )
+{
+    LuaContext *ctx = (id == LOOP1) ? &context1 : &context0;
+    return ctx->loops[id].budget;
+}
+
+
+void setGCMode( lua_State *L, GCMode mode )
+{
+    LuaContext *ctx = contextOf( L );
+
+    switch( mode )
+    {
+        case GC_INCREMENTAL:
+            lua_gc( L, LUA_GCINC, 0, 0, 0 );
+            lua_gc( L, LUA_GCRESTART );
+            break;
+
+        case GC_GENERATIONAL:
+            lua_gc( L, LUA_GCGEN, 0, 0 );
+            lua_gc( L, LUA_GCRESTART );
+            break;
+
+        case GC_IDLE:
+            // Steps are still done by the incremental collector, we just decide when.
+            lua_gc( L, LUA_GCINC, 0, 0, 0 );
+            lua_gc( L, LUA_GCSTOP );
+            ctx->gcLastBytes = heapBytes( L );
+            ctx->gcDebt = 0;
+            break;
+
+        default:
+            return;
+    }
+
+    ctx->gcMode = mode;
+}
+
+
+GCMode gcMode( lua_State *L )
+{
+    return contextOf( L )->gcMode;
+}
+
+
+const LuaPool *luaPool( lua_State *L )
+{
+    return &contextOf( L )->pool;
+}
+
+
+MemStats *luaMemStats( lua_State *L )
+{
+    return &contextOf( L )->mem;
+}
+
+
+const void **luaClassCache( lua_State *L )
+{
+    return contextOf( L )->classMetatables;
+}
+
+
+void setIdleGC( lua_State *L, int stepMul, unsigned long minSlack, unsigned long maxDebt )
+{
+    LuaContext *ctx = contextOf( L );
+
+    ctx->gcStepMul = stepMul;
+    ctx->gcMinSlack = minSlack;
+    ctx->gcMaxDebt = maxDebt;
+}
+
+
+void startBudget( lua_State *L, unsigned long budget, const char *name )
+{
+    if( budget == 0 )
+    {
+        return;
+    }
+
+    LuaContext *ctx = contextOf( L );
+
+    ctx->budgetThread = L;
+    ctx->budgetName = name;
+    ctx->budget = budget;
+    ctx->budgetStart = micros();
+
+    lua_sethook( L, budgetHook, LUA_MASKCOUNT, BUDGET_HOOK_COUNT );
+}
+
+
+void endBudget( lua_State *L )
+{
+    LuaContext *ctx = contextOf( L );
+
+    if( ctx->budget == 0 )
+    {
+        return;
+    }
+
+    lua_sethook( L, NULL, 0, 0 );
+
+    ctx->budgetThread = NULL;
+    ctx->budget = 0;
+}
+
+
+void lockFilesystem()
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    recursive_mutex_enter_blocking( &filesystemMutex );
+#endif
+}
+
+
+void unlockFilesystem()
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    recursive_mutex_exit( &filesystemMutex );
+#endif
+}
+
+
+int currentCore()
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    return rp2040.cpuid();
+#else
+    return 0;
+#endif
+}
+
+
+void loadLuaFile( lua_State *L, const char *modname )
+{
+    debug( "Loading module '%s'", modname );
+
+    MemStats *ms = &contextOf( L )->mem;
+    const int prevModule = memBeginModule( ms, modname, true );
+
+    int rc;
+    if( ! scriptExists( modname ) && findEmbeddedModule( modname ) )
+    {
+        // Not on the SD card, but built into the firmware.
+        rc = loadEmbeddedModule( L, modname );
+        if( rc != LUA_OK )
+        {
+            lua_pushfstring( L, "Embedded module error: %s\n", lua_tostring( L, -1 ) );
+            lua_remove( L, -2 );
+        }
+    }
+    else
+    {
+        rc = loadScript( L, modname );
+    }
+
+    if( rc == 0 )
+    {
+        rc = callScript( L );
+        if( rc )
+        {
+            // If callScript fails, it pushes an error string onto the stack.
+            lua_writestringerror( "%s\n", lua_tostring( L, -1 ) );
+            lua_pop( L, 1 );
+        }
+    }
+    else
+    {
+        // If loadScript fails, it pushes an error string onto the stack.
+        lua_writestringerror( "%s\n", lua_tostring( L, -1 ) );
+        lua_pop( L, 1 );
+    }
+
+    resolveLoopFunctions( L, contextOf( L ) );
+
+    memEndModule( ms, prevModule );
+}
+
+
+//=============================================================================================
+//=============================================================================================
+//=============================================================================================
+
+/**
+ * Create a Lua state, open the libraries, and set it up for use by the platform.
+ *
+ * The state gets its own allocator, with its context as the allocator's user data.
+ */
+static lua_State *newLuaState( LuaContext *ctx, size_t arenaSize )
+{
+#if POOL_ALLOCATOR_ENABLED
+    poolInit( &ctx->pool, arenaSize );
+#else
+    (void)arenaSize;
+#endif
+
+    memInit( &ctx->mem );
+
+    lua_State *L = lua_newstate( luaAlloc, ctx );
+    lua_atpanic( L, panic );
+
+    ctx->L = L;
 
     // Open most of the standard libraries.
     // We don't open 'os' or 'io'.
@@ -107,280 +637,597 @@ void setupLua()
         lua_pop( L, 1 );  // remove lib
     }
 
+    hookCoroutines( L );
+
     registerSearcher( L );
 
     registerPreloads( L );
 
-    // Clear the Lua stack
+    registerLoopFunctions( L, ctx );
+
+    ctx->gcMode = GC_INCREMENTAL;
+    ctx->gcStepMul = IDLE_GC_STEP_MUL;
+    ctx->gcMinSlack = IDLE_GC_MIN_SLACK;
+    ctx->gcMaxDebt = IDLE_GC_MAX_DEBT;
+
+    ctx->tasks = newTaskScheduler( L );
+
+    // Clear the Lua stack, and place our error handler at the bottom of it.
     lua_settop( L, 0 );
+    lua_pushcfunction( L, errorHandler );
 
-    // This will load and run the initial Lua source file.
-    debug( "Loading the 'main.lua' script" );
-    loadLuaFile( L, "main" );
+    return L;
+}
 
-    // The init event gets called the first time we load the script only.
-    if( findFunction( L, "setup" ) )
+
+/**
+ * The memory allocator used by our Lua states.
+ *
+ * Blocks come from the state's pool allocator. (See lua_pool.h)
+ * Everything is also counted in the state's memory statistics.
+ */
+static void *luaAlloc( void *ud, void *ptr, size_t osize, size_t nsize )
+{
+    LuaContext *ctx = (LuaContext*)ud;
+
+    // When ptr is NULL, osize is the type of object being allocated, not a size.
+    if( ptr == NULL )
+    {
+        osize = 0;
+    }
+
+#if POOL_ALLOCATOR_ENABLED
+    void *p = poolAlloc( &ctx->pool, ptr, osize, nsize );
+#else
+    void *p = NULL;
+    if( nsize == 0 )
+    {
+        free( ptr );
+    }
+    else
+    {
+        p = realloc( ptr, nsize );
+    }
+#endif
+
+    if( p != NULL || nsize == 0 )
+    {
+        memRecord( &ctx->mem, osize, nsize );
+    }
+
+    return p;
+}
+
+
+/**
+ * Called if an error happens outside of any protected call, just before Lua aborts.
+ */
+static int panic( lua_State *L )
+{
+    const char *msg = lua_tostring( L, -1 );
+    if( msg == NULL )
+    {
+        msg = "error object is not a string";
+    }
+
+    lua_writestringerror( "PANIC: unprotected error in call to Lua API (%s)\n", msg );
+
+    return 0;
+}
+
+
+/**
+ * Check to see if a script file exists.
+ */
+static bool scriptExists( const char *name )
+{
+    char fname[64];
+    snprintf( fname, sizeof(fname), "/%s.lua", name );
+
+    lockFilesystem();
+#if defined (ARDUINO_ARCH_RP2040)
+    bool exists = SDFS.exists( fname );
+#else
+    bool exists = SD.exists( fname );
+#endif
+    unlockFilesystem();
+
+    return exists;
+}
+
+
+/**
+ * Load a file from disk.
+ *
+ * Pushes the loaded script as a function on top of the Lua stack and returns zero if it succeeds.
+ * If this fails, it returns non-zero and leaves an error string on the Lua stack.
+ */
+static int loadScript( lua_State *L, const char *name )
+{
+    // Look for the file "<name>.lua"
+    char fname[64];
+    snprintf( fname, sizeof(fname), "/%s.lua", name );
+
+    const unsigned long start = millis();
+
+    MemStats *ms = &contextOf( L )->mem;
+    const size_t startBytes = ms->live;
+    const size_t prevPeak = memBeginPeak( ms );
+
+    // Use the compiled version of the file if it is still current.
+    SourceInfo info;
+    const bool useCache = bytecodeCacheEnabled() && sourceInfo( fname, &info );
+    if( useCache && loadBytecode( L, name, &info ) == 0 )
+    {
+        debug( "Loaded '%s' from cached bytecode in %lu ms, peak %u bytes",
+               name, millis() - start, memEndPeak( ms, prevPeak ) - startBytes );
+        return 0;
+    }
+
+    lockFilesystem();
+
+#if defined (ARDUINO_ARCH_RP2040)
+    File file = SDFS.open( fname, "r" );
+#else
+    File file = SD.open( fname );
+#endif
+    if( ! file )
+    {
+        unlockFilesystem();
+        memEndPeak( ms, prevPeak );
+        lua_pushfstring( L, "no file '%s'", fname );
+        return -1;
+    }
+
+    unlockFilesystem();
+
+    // Compile straight from the file. (It locks the filesystem for each read.)
+    int ret = loadFileChunk( L, file, name, NULL );
+
+    lockFilesystem();
+    file.close();
+    unlockFilesystem();
+
+    const size_t peak = memEndPeak( ms, prevPeak ) - startBytes;
+
+    if( ret != LUA_OK )
+    {
+        // Compile error
+        lua_pushfstring( L, "Compile error: %s\n", lua_tostring( L, -1 ) );
+        lua_remove( L, -2 );
+        return -1;
+    }
+
+    if( useCache )
+    {
+        saveBytecode( L, name, &info );
+    }
+
+    debug( "Compiled '%s' in %lu ms, peak %u bytes", name, millis() - start, peak );
+
+    return 0;
+}
+
+
+/**
+ * Call the function on the top of the Lua stack.
+ *
+ * If this fails, it returns non-zero and leaves an error string on the Lua stack.
+ */
+static int callScript( lua_State *L )
+{
+    int rc = lua_pcall( L, 0, LUA_MULTRET, 0 );
+    if( rc )
+    {
+        lua_pushfstring( L, "Run script failed: %s\n", lua_tostring( L, -1 ) );
+    }
+
+    return rc;
+}
+
+
+/**
+ * Call a function on the stack. This also expects any arguments to be there as well.
+ *
+ * stack:  [error-func] ... [func] [args...] <-- Top
+ */
+static int callFunction( lua_State *L, int numArgs, int numRets )
+{
+        // The last argument to pcall is the index of the error handler
+        int err = lua_pcall( L, numArgs, numRets, ERROR_HANDLER_INDEX );
+        if( err )
+        {
+            lua_writestringerror( "Error: %s\n", lua_tostring( L, -1 ) );
+            lua_pop( L, 1 );
+            return -1;
+        }
+
+        return 0;
+}
+
+
+
+
+/**
+ * Call one of the loop functions, if it is defined, within its time budget.
+ *
+ * @return false if the function failed
+ */
+static bool callLoopFunction( lua_State *L, LuaContext *ctx, LoopFunctionId id )
+{
+    LoopFunction *lf = &ctx->loops[id];
+
+    if( ! pushLoopFunction( L, ctx, id ) )
+    {
+        return true;
+    }
+
+    const unsigned long start = micros();
+
+    startBudget( L, lf->budget, lf->name );
+    int rc = callFunction( L, 0, 0 );
+    endBudget( L );
+
+    lapLatency( loopStatsPhases[id], start );
+
+    return rc == 0;
+}
+
+
+/**
+ * The context of a Lua state (or any of its threads) is its allocator user data.
+ */
+static LuaContext *contextOf( lua_State *L )
+{
+    void *ud;
+    lua_getallocf( L, &ud );
+    return (LuaContext*)ud;
+}
+
+
+/**
+ * Count hook that enforces the time budget set by startBudget().
+ *
+ * If the budgeted code can yield (it is a task) it is yielded, to pick up where it left
+ * off next time. Otherwise it is aborted with an error.
+ */
+static void budgetHook( lua_State *L, lua_Debug *ar )
+{
+    (void)ar;
+
+    LuaContext *ctx = contextOf( L );
+
+    if( ctx->budget == 0 )
+    {
+        // Coroutines keep the hook (see hookCoroutines()), but there's nothing to enforce now.
+        return;
+    }
+
+    if( micros() - ctx->budgetStart < ctx->budget )
+    {
+        return;
+    }
+
+    if( L == ctx->budgetThread && lua_isyieldable( L ) )
     {
-        debug( "Calling the Lua script 'setup' function");
-        callFunction( L, 0, 0 );
-        setupFuncCalled = true;
+        lua_yield( L, 0 );
+        return;
     }
 
-    debug( "lua_Integer=%d  int=%d   long=%d   size_t=%d", sizeof(lua_Integer), sizeof(int), sizeof(long), sizeof(size_t) );
-    debug( "lua_Number=%d   float=%d   double=%d", sizeof(lua_Number), sizeof(float), sizeof(double) );
+    luaL_error( L, "'%s' ran over its time budget of %d us", ctx->budgetName, (int)ctx->budget );
+}
 
-    debug( "Lua setup 0 complete." );
+
+/**
+ * Give every coroutine the budget hook when it is created.
+ *
+ * A coroutine only inherits the hook if it's created while a budget is running. One created
+ * earlier (a generator made in setup(), say) and resumed by a loop function would otherwise
+ * run past the budget without limit. The hook does nothing while there is no budget.
+ */
+static void hookCoroutines( lua_State *L )
+{
+    lua_getglobal( L, LUA_COLIBNAME );
+
+    lua_getfield( L, -1, "create" );
+    lua_pushcclosure( L, coroutineCreate, 1 );
+    lua_setfield( L, -2, "create" );
+
+    lua_getfield( L, -1, "wrap" );
+    lua_pushcclosure( L, coroutineWrap, 1 );
+    lua_setfield( L, -2, "wrap" );
+
+    lua_pop( L, 1 );
 }
 
 
-void setupLua1()
+/**
+ * coroutine.create(), upvalue 1 is the original.
+ */
+static int coroutineCreate( lua_State *L )
 {
-    struct lua_State *L = luaState;
+    lua_pushvalue( L, lua_upvalueindex( 1 ) );
+    lua_insert( L, 1 );
+    lua_call( L, lua_gettop( L ) - 1, 1 );
 
-    // The init event gets called the first time we load the script only.
-    if( findFunction( L, "setup1" ) )
-    {
-        debug( "Calling the Lua script 'setup1' function");
-        callFunction( L, 0, 0 );
-    }
+    lua_sethook( lua_tothread( L, -1 ), budgetHook, LUA_MASKCOUNT, BUDGET_HOOK_COUNT );
 
-    debug( "Lua setup 1 complete." );
+    return 1;
 }
 
 
-// Deal with the special case of no filesystem. (or at least, no `main.lua`)
-void checkLuaSetupFunction( lua_State *L )
+/**
+ * coroutine.wrap(), upvalue 1 is the original. Its coroutine is the first upvalue of the
+ * function it returns.
+ */
+static int coroutineWrap( lua_State *L )
 {
-  if( setupFuncCalled == false )
-  {
-      if( findFunction( L, "setup" ) )
-      {
-          debug( "Calling the Lua script 'setup' function");
-          callFunction( L, 0, 0 );
-          setupFuncCalled = true;
-      }
-  }
+    lua_pushvalue( L, lua_upvalueindex( 1 ) );
+    lua_insert( L, 1 );
+    lua_call( L, lua_gettop( L ) - 1, 1 );
+
+    if( lua_getupvalue( L, -1, 1 ) != NULL )
+    {
+        if( lua_isthread( L, -1 ) )
+        {
+            lua_sethook( lua_tothread( L, -1 ), budgetHook, LUA_MASKCOUNT, BUDGET_HOOK_COUNT );
+        }
+        lua_pop( L, 1 );
+    }
+
+    return 1;
 }
 
 
-void runLua()
+/**
+ * In the idle GC mode, do a collection step if there is time for one before the next loop
+ * deadline, or if so much has been allocated that it can't wait any longer.
+ *
+ * The step size follows the amount allocated since the last step, so the collector keeps
+ * pace with the script without doing more work at once than it has to.
+ */
+static void idleCollect( lua_State *L, LuaContext *ctx )
 {
-    struct lua_State *L = luaState;
+    if( ctx->gcMode != GC_IDLE )
+    {
+        return;
+    }
 
-    handleShell( L );
+    const size_t bytes = heapBytes( L );
+    if( bytes > ctx->gcLastBytes )
+    {
+        ctx->gcDebt += bytes - ctx->gcLastBytes;
+    }
+    ctx->gcLastBytes = bytes;
 
-    if( lua_gettop( L ) > 5 )
+    if( ctx->gcDebt == 0 )
     {
-        debug( "Stack %d, should never be this high", lua_gettop( L ) );
+        return;
     }
 
-    if( execLoopEnabled )
+    const unsigned long start = micros();
+
+    if( loopSlack( ctx, start ) < (long)ctx->gcMinSlack && ctx->gcDebt < ctx->gcMaxDebt * 1024 )
     {
-        if( findFunction( L, "exec_loop" ) )
-        {
-            if( callFunction( L, 0, 0 ) != 0 )
-            {
-                // If this function fails, stop trying to call it!
-                execLoopEnabled = false;
-            }
-        }
+        // No time now, and it can wait.
+        return;
     }
 
-    if( housekeepingLoopEnabled )
+    int kb = (ctx->gcDebt / 100 * ctx->gcStepMul + 1023) / 1024;
+    lua_gc( L, LUA_GCSTEP, kb );
+
+    ctx->gcDebt = 0;
+    ctx->gcLastBytes = heapBytes( L );
+
+    if( ctx == &context0 )
     {
-        if( findFunction( L, "housekeeping_loop" ) )
-        {
-            if( callFunction( L, 0, 0 ) != 0 )
-            {
-                // If this function fails, stop trying to call it!
-                housekeepingLoopEnabled = false;
-            }
-        }
+        lapLatency( STATS_GC, start );
     }
 }
 
 
-void loadLuaFile( lua_State *L, const char *modname )
+/**
+ * Microseconds until the next enabled loop with a period comes due.
+ * (Only the core 0 loops have periods. Without any, there is always time.)
+ */
+static long loopSlack( LuaContext *ctx, unsigned long now )
 {
-    debug( "Loading module '%s'", modname );
+    long slack = LONG_MAX;
 
-    int rc = loadScript( L, modname );
-    if( rc == 0 )
+    if( ctx != &context0 )
     {
-        rc = callScript( L );
-        if( rc )
-        {
-            // If callScript fails, it pushes an error string onto the stack.
-            lua_writestringerror( "%s\n", lua_tostring( L, -1 ) );
-            lua_pop( L, 1 );
-        }
+        return slack;
     }
-    else
+
+    const bool enabled[] = { execLoopEnabled, housekeepingLoopEnabled };
+
+    for( int i = EXEC_LOOP; i <= HOUSEKEEPING_LOOP; i++ )
     {
-        // If loadScript fails, it pushes an error string onto the stack.
-        lua_writestringerror( "%s\n", lua_tostring( L, -1 ) );
-        lua_pop( L, 1 );
+        const LoopFunction *lf = &ctx->loops[i];
+
+        if( enabled[i] && lf->isFunction && lf->period != 0 )
+        {
+            long t = (long)(lf->deadline - now);
+            if( t < slack )
+            {
+                slack = t;
+            }
+        }
     }
+
+    return slack;
 }
 
 
-//=============================================================================================
-//=============================================================================================
-//=============================================================================================
+static size_t heapBytes( lua_State *L )
+{
+    return (size_t)lua_gc( L, LUA_GCCOUNT ) * 1024 + lua_gc( L, LUA_GCCOUNTB );
+}
+
 
 /**
- * Load a file from disk.
+ * Pass the next batch of queued events to the Lua event_handler() function.
  *
- * Pushes the loaded script as a function on top of the Lua stack and returns zero if it succeeds.
- * If this fails, it returns non-zero and leaves an error string on the Lua stack.
+ * Taking a limited number per pass keeps a flood of events from starving the loops.
+ * Events that arrive while there is no event handler are thrown away.
+ *
+ * @return true if there were any events
  */
-static int loadScript( lua_State *L, const char *name )
+static bool handleEvents( lua_State *L, LuaContext *ctx )
 {
-    // Look for the file "<name>.lua"
-    char fname[64];
-    snprintf( fname, sizeof(fname), "/%s.lua", name );
+    Event events[EVENT_BATCH_SIZE];
 
-#if defined (ARDUINO_ARCH_RP2040)
-    File file = SDFS.open( fname, "r" );
-#else
-    File file = SD.open( fname );
-#endif
-    if( ! file )
+    const int n = takeEvents( events, EVENT_BATCH_SIZE );
+    for( int i = 0; i < n; i++ )
     {
-        lua_pushfstring( L, "no file '%s'", fname );
-        return -1;
+        callEvent( L, ctx, &events[i] );
     }
 
-    // Set up a buffer to load the file into.
-    luaL_Buffer b;
-    luaL_buffinit( L, &b );
+    return n > 0;
+}
 
-    size_t len;
 
-    do
+/**
+ * Call event_handler( name, source, value, time )
+ */
+static void callEvent( lua_State *L, LuaContext *ctx, const Event *ev )
+{
+    if( pushLoopFunction( L, ctx, EVENT_HANDLER ) )
     {
-        // Get pointer to buffer space.
-        uint8_t *buf = (uint8_t*) luaL_prepbuffer( &b );
+        lua_pushstring( L, eventName( ev->type ) );
+        lua_pushinteger( L, ev->source );
+        lua_pushinteger( L, ev->value );
+        lua_pushinteger( L, ev->time );
+        // Stack is now: ... [error-func]  [func-to-call]  [name] [source] [value] [time]  <-- Top
 
-        // Read a segment of the file into the buffer.
-        len = file.read( buf, LUAL_BUFFERSIZE );
-        luaL_addsize( &b, len );
+        callFunction( L, 4, 0 );
     }
-    while( len > 0 );
+}
 
-    file.close();
 
-    // Push the buffer contents onto the stack as a string.
-    luaL_pushresult( &b );
 
-    // Get the pointer to the string, and its length.
-    const char *p = lua_tolstring( L, -1, &len );
+/**
+ * Find function and leave it the top of the Lua stack.
+ *
+ * @param name The name of the function
+ * @return true if the function was found
+ */
+static bool findFunction( lua_State *L, const char *name )
+{
+    lua_getglobal( L, name );
 
-    // Load the buffer.
-    int ret = luaL_loadbuffer( L, p, len, name );
-    lua_remove( L, -2 );    // Remove the chunk string from the stack.
-    if( ret != LUA_OK )
+    if( ! lua_isfunction( L, -1 ) )
     {
-        // Compile error
-        lua_pushfstring( L, "Compile error: %s\n", lua_tostring( L, -1 ) );
-        lua_remove( L, -2 );
-        return -1;
+        // Not a function
+        lua_pop( L, 1 );
+        return false;
     }
 
-    return 0;
+    return true;
 }
 
 
 /**
- * Call the function on the top of the Lua stack.
+ * Push a loop function onto the Lua stack.
  *
- * If this fails, it returns non-zero and leaves an error string on the Lua stack.
+ * @return true if the global is currently a function, false if nothing was pushed
  */
-static int callScript( lua_State *L )
+static bool pushLoopFunction( lua_State *L, LuaContext *ctx, LoopFunctionId id )
 {
-    int rc = lua_pcall( L, 0, LUA_MULTRET, 0 );
-    if( rc )
+    LoopFunction *lf = &ctx->loops[id];
+
+    lua_rawgeti( L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS );
+    lua_rawgeti( L, LUA_REGISTRYINDEX, lf->nameRef );
+    lua_rawget( L, -2 );
+    lua_remove( L, -2 );
+
+    lf->isFunction = lua_isfunction( L, -1 );
+    if( ! lf->isFunction )
     {
-        lua_pushfstring( L, "Run script failed: %s\n", lua_tostring( L, -1 ) );
+        lua_pop( L, 1 );
+        return false;
     }
 
-    return rc;
+    return true;
 }
 
 
 /**
- * Call a function on the stack. This also expects any arguments to be there as well.
+ * Decide if a loop should be called on this pass, and advance its deadline if so.
  *
- * stack:  [func] [args...] <-- Top
+ * Deadlines advance by whole periods from the previous deadline rather than from
+ * the time the loop actually ran, so the loop rate doesn't drift.
+ * All of the time comparisons are done as differences so micros() wrapping is harmless.
  */
-static int callFunction( lua_State *L, int numArgs, int numRets )
+static bool loopIsDue( LoopFunction *lf, bool enabled, unsigned long now )
 {
-        // Tuck our error handler *under* the function on the stack
-        lua_pushcfunction( L, errorHandler );
-        lua_insert( L, -(numArgs+2) );
+    if( ! enabled )
+    {
+        // Keep the deadline current so re-enabling doesn't count as an overrun.
+        lf->deadline = now;
+        return false;
+    }
 
-        // Stack is now: ... [error-func]  [func-to-call] [args...] <-- Top
+    if( lf->period == 0 )
+    {
+        return true;
+    }
 
-        // The last argument to pcall is the index of the error handler
-        int err = lua_pcall( L, numArgs, 0, -(numArgs+2) );
-        if( err )
-        {
-            lua_writestringerror( "Error: %s\n", lua_tostring( L, -1 ) );
-            lua_pop( L, 1 );
-            return -1;
-        }
+    if( (long)(now - lf->deadline) < 0 )
+    {
+        // Not due yet
+        return false;
+    }
 
-        lua_pop( L, 1 );        // error handler
+    lf->deadline += lf->period;
 
-        return 0;
-}
+    if( (long)(now - lf->deadline) >= 0 )
+    {
+        // We are a whole period (or more) late. Skip the missed deadlines rather than
+        // running the loop back-to-back to catch up, but stay in phase.
+        unsigned long missed = (now - lf->deadline) / lf->period + 1;
 
+        lf->deadline += missed * lf->period;
+        lf->overruns += missed;
+    }
 
+    return true;
+}
 
 
 /**
- * This version will check for aliases and call them as well.
+ * Keep the name strings of the loop functions in the registry.
  */
-static void callEvent( lua_State *L, const char *name, const void *data, int size )
+static void registerLoopFunctions( lua_State *L, LuaContext *ctx )
 {
-//     printf( "call event %s\n", name );
-    if( findFunction( L, "event_handler" ) )
+    for( int i = 0; i < NUM_LOOP_FUNCTIONS; i++ )
     {
-        // Function exists
-        lua_pushstring( L, name);
-
-        if( data )
-        {
-            lua_pushlstring( L, (const char*)data, size );
-            // Stack is now: ... [error-func]  [func-to-call]  [data]  <-- Top
-        }
+        LoopFunction *lf = &ctx->loops[i];
 
-        int argc = data ? 2 : 1;
+        lf->name = loopFunctionNames[i];
 
-        callFunction( L, argc, 0 );
+        lua_pushstring( L, lf->name );
+        lf->nameRef = luaL_ref( L, LUA_REGISTRYINDEX );
     }
-}
 
+    resolveLoopFunctions( L, ctx );
+}
 
 
 /**
- * Find function and leave it the top of the Lua stack.
+ * Look up each loop function, to know which ones are defined.
  *
- * @param name The name of the function
- * @return true if the function was found
+ * Called after each script is loaded. (Otherwise a loop is only looked up when it is due.)
  */
-static bool findFunction( lua_State *L, const char *name )
+static void resolveLoopFunctions( lua_State *L, LuaContext *ctx )
 {
-    lua_getglobal( L, name );
-
-    if( ! lua_isfunction( L, -1 ) )
+    for( int i = 0; i < NUM_LOOP_FUNCTIONS; i++ )
     {
-        // Not a function
-        lua_pop( L, 1 );
-        return false;
+        if( pushLoopFunction( L, ctx, (LoopFunctionId)i ) )
+        {
+            lua_pop( L, 1 );
+        }
     }
-
-    return true;
 }
 
 
@@ -473,10 +1320,14 @@ static void registerSearcher( lua_State *L )
     lua_pushnil( L );
     lua_rawseti( L, -2, 2 );
 
-    // Add our searcher in the second index.
+    // Add our searchers after it. Files on the SD card come first, so an embedded module
+    // can be replaced with a newer version without rebuilding the firmware.
     lua_pushcfunction( L, arduinoSearcher );
     lua_rawseti( L, -2, 2 );
 
+    lua_pushcfunction( L, embeddedSearcher );
+    lua_rawseti( L, -2, 3 );
+
     // Clean up the stack.
     lua_pop( L, 2 );
 }
@@ -490,21 +1341,113 @@ static int arduinoSearcher( lua_State *L )
     const char* const modname = lua_tostring(L, 1);
     debug( "Searching for module: %s", modname );
 
-    (void) loadScript( L, modname );
+    MemStats *ms = &contextOf( L )->mem;
+    const int prevModule = memBeginModule( ms, modname, true );
+
+    int rc = loadScript( L, modname );
+
+    memEndModule( ms, prevModule );
+
+    if( rc == 0 )
+    {
+        // Run the chunk through moduleLoader, so what it allocates is counted against the module.
+        lua_pushvalue( L, 1 );
+        lua_pushcclosure( L, moduleLoader, 2 );
+    }
+
+    return 1;
+}
+
+
+/**
+ * Searcher for modules built into the firmware.
+ */
+static int embeddedSearcher( lua_State *L )
+{
+    const char* const modname = lua_tostring(L, 1);
+
+    MemStats *ms = &contextOf( L )->mem;
+    const int prevModule = memBeginModule( ms, modname, true );
+
+    int rc = loadEmbeddedModule( L, modname );
+
+    memEndModule( ms, prevModule );
+
+    if( rc < 0 )
+    {
+        lua_pushfstring( L, "no embedded module '%s'", modname );
+        return 1;
+    }
+    else if( rc != LUA_OK )
+    {
+        // Bad bytecode, so stop the search with the error.
+        return luaL_error( L, "error loading embedded module '%s':\n\t%s", modname, lua_tostring( L, -1 ) );
+    }
+
+    lua_pushvalue( L, 1 );
+    lua_pushcclosure( L, moduleLoader, 2 );
     return 1;
 }
 
 
+#define MODULE_GUARD_NAME   "MemModuleGuard"
+
+/**
+ * The loader returned by arduinoSearcher() and embeddedSearcher().
+ *
+ * Upvalues: [chunk] [module name]
+ */
+static int moduleLoader( lua_State *L )
+{
+    const int nargs = lua_gettop( L );
+
+    MemStats *ms = &contextOf( L )->mem;
+    const int prevModule = memBeginModule( ms, lua_tostring( L, lua_upvalueindex( 2 ) ), false );
+
+    // A to-be-closed guard ends the module's accounting even if the chunk raises an error.
+    int *guard = (int*)lua_newuserdatauv( L, sizeof(int), 0 );
+    *guard = prevModule;
+
+    if( luaL_newmetatable( L, MODULE_GUARD_NAME ) )
+    {
+        lua_pushcfunction( L, closeModuleGuard );
+        lua_setfield( L, -2, "__close" );
+    }
+    lua_setmetatable( L, -2 );
+    lua_toclose( L, -1 );
+
+    // Call the chunk with the arguments from require.
+    lua_pushvalue( L, lua_upvalueindex( 1 ) );
+    for( int i = 1; i <= nargs; i++ )
+    {
+        lua_pushvalue( L, i );
+    }
+    lua_call( L, nargs, LUA_MULTRET );
+
+    return lua_gettop( L ) - (nargs + 1);
+}
+
+
+static int closeModuleGuard( lua_State *L )
+{
+    int *guard = (int*)lua_touserdata( L, 1 );
+    memEndModule( &contextOf( L )->mem, *guard );
+    return 0;
+}
+
+
 static void debug( const char *format, ... )
 {
 #if DEBUG_ENABLED
-    static char buf[256];
+    // On the stack, since either core may be calling this.
+    char buf[256];
 
     va_list	args;
     va_start( args, format );
 
     vsnprintf( buf, sizeof(buf), format, args );
-    LUA_SERIAL.println( buf );
+    writeOutput( buf, strlen( buf ) );
+    writeOutput( "\r\n", 2 );
 
     va_end( args );
 #endif
@@ -518,6 +1461,9 @@ static void debug( const char *format, ... )
 // This allows routing Lua print() and error messages to the port of our choice.
 // (e.g. Serial)
 //
+// They go through the output buffer. Error messages are sent straight away, since they may
+// be the last thing written before Lua aborts.
+//
 // Don't call these directly!
 // Call:
 //   lua_writestring
@@ -526,13 +1472,27 @@ static void debug( const char *format, ... )
 
 extern "C" void dtm_writestring( const char *p, int len )
 {
-    LUA_SERIAL.write( p, len );
+    writeOutput( p, len );
 }
 
 
 extern "C" void dtm_writestringerror( const char *s, const char *p )
 {
-    static char buf[512];
+    char buf[512];
     snprintf( buf, sizeof(buf), s, p );
-    LUA_SERIAL.print( buf );
+    outputWriteWait( buf, strlen( buf ) );
+    flushOutput();
+}
+
+
+static void writeOutput( const char *p, size_t len )
+{
+    if( inRunLoop[currentCore()] )
+    {
+        outputWrite( p, len );
+    }
+    else
+    {
+        outputWriteWait( p, len );
+    }
 }
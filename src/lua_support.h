@@ -20,18 +20,90 @@
 
 
 struct lua_State;
+struct LuaPool;
+struct MemStats;
 
 
 extern bool execLoopEnabled;
 extern bool housekeepingLoopEnabled;
+extern volatile bool loop1Enabled;
 
 
+enum LoopFunctionId {
+    EXEC_LOOP,
+    HOUSEKEEPING_LOOP,
+    LOOP1,
+
+    // Not a loop, but called often enough to be cached the same way.
+    EVENT_HANDLER,
+
+    NUM_LOOP_FUNCTIONS
+};
+
+// Loop periods are in microseconds. A period of zero calls the loop on every pass.
+// (Only the core 0 loops are scheduled, and setLoopPeriod() must only be called on core 0.)
+void setLoopPeriod( LoopFunctionId id, unsigned long period );
+unsigned long loopPeriod( LoopFunctionId id );
+unsigned long loopOverruns( LoopFunctionId id );
+
+// Loop time budgets are in microseconds. A loop that runs longer than its budget is stopped
+// with an error (and so disabled). A budget of zero, the default, is no limit.
+void setLoopBudget( LoopFunctionId id, unsigned long budget );
+unsigned long loopBudget( LoopFunctionId id );
+
+// Enforce a time budget on the Lua code run by L until endBudget() is called.
+// If L is a coroutine it is yielded when the time is up, otherwise it gets an error.
+void startBudget( lua_State *L, unsigned long budget, const char *name );
+void endBudget( lua_State *L );
+
+
+
+//
+// Garbage collector modes
+//
+// In the idle mode the collector never runs on its own (so never in the middle of a loop
+// function). Instead the run loop does collection steps between passes, when there is time
+// before the next loop deadline, sized to keep up with the amount allocated.
+//
+enum GCMode {
+    GC_INCREMENTAL,     // Lua's standard incremental collector
+    GC_GENERATIONAL,
+    GC_IDLE,
+
+    NUM_GC_MODES
+};
+
+void setGCMode( lua_State *L, GCMode mode );
+GCMode gcMode( lua_State *L );
+
+// stepMul: percent of the amount allocated to collect on each idle step.
+// minSlack: microseconds there must be until the next loop deadline to do a step.
+// maxDebt: KB that may be allocated before a step is done regardless of the deadlines.
+void setIdleGC( lua_State *L, int stepMul, unsigned long minSlack, unsigned long maxDebt );
+
+
+// The small block pools of L's allocator.
+const LuaPool *luaPool( lua_State *L );
+
+// The memory statistics of L's allocator.
+MemStats *luaMemStats( lua_State *L );
+
+// The metatable of each class (by LuaClassId) in L's state, or NULL if not known yet.
+const void **luaClassCache( lua_State *L );
+
 
 void loadLuaFile( lua_State *L, const char *modname );
 
+void lockFilesystem();
+void unlockFilesystem();
+
+// The core the caller is running on, 0 or 1.
+int currentCore();
+
 void checkLuaSetupFunction( lua_State *L );
 
 void setupLua();
 void setupLua1();
 
 void runLua();
+void runLua1();
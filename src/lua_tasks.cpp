@@ -0,0 +1,565 @@
+// lua_tasks.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+
+#include "lua.hpp"
+
+#include "lua_tools.h"
+#include "lua_support.h"
+#include "lua_tasks.h"
+
+
+
+// The ready ring's counters wrap around cleanly only for a power of two, and tasks are
+// indexed with 16 bits.
+static_assert( (MAX_TASKS & (MAX_TASKS - 1)) == 0 && MAX_TASKS <= 65536, "MAX_TASKS must be a power of two" );
+
+
+enum TaskState {
+    TASK_FREE,
+    TASK_READY,         // In the ready queue
+    TASK_RUNNING,
+    TASK_SLEEPING,      // In the sleeping heap
+    TASK_WAITING        // In the waiting list, for a predicate or a poll function
+};
+
+
+struct Task {
+    lua_State *thread;
+    int ref;                    // Registry reference that keeps the thread alive
+    int waitRef;                // Registry reference to the waitUntil() predicate
+    TaskPollFunc poll;          // Or the C function to poll, from taskAwait()
+    void *pollObj;
+    unsigned long wakeTime;     // millis() time to wake from a sleep()
+    TaskState state;
+};
+
+
+struct TaskScheduler {
+    Task tasks[MAX_TASKS];
+    int count;
+
+    // Microseconds a task may run before it is made to yield, zero for no limit.
+    unsigned long budget;
+
+    // The task currently being resumed, if any.
+    Task *current;
+
+    // Sleeping tasks, as a min-heap ordered by wake time.
+    uint16_t sleeping[MAX_TASKS];
+    int numSleeping;
+
+    // Tasks waiting for a predicate or poll function to become true.
+    uint16_t waiting[MAX_TASKS];
+    int numWaiting;
+
+    // Tasks ready to be resumed, as a ring. Every task is in here at most once.
+    uint16_t ready[MAX_TASKS];
+    unsigned int readyHead;
+    unsigned int readyTail;
+};
+
+
+// The address of this is used as the registry key of the scheduler.
+static const char schedulerKey = 0;
+
+
+static TaskScheduler *getScheduler( lua_State *L );
+static Task *currentTask( lua_State *L, TaskScheduler *ts );
+
+static void resumeTask( lua_State *L, TaskScheduler *ts, Task *t );
+static void freeTask( lua_State *L, TaskScheduler *ts, Task *t );
+static void reportTaskError( lua_State *L, lua_State *co );
+
+static void makeReady( TaskScheduler *ts, Task *t );
+static bool isEarlier( TaskScheduler *ts, uint16_t a, uint16_t b );
+static void sleepingPush( TaskScheduler *ts, Task *t );
+static Task *sleepingPop( TaskScheduler *ts );
+
+
+
+TaskScheduler *newTaskScheduler( lua_State *L )
+{
+    TaskScheduler *ts = (TaskScheduler*)calloc( 1, sizeof(TaskScheduler) );
+    if( ts == NULL )
+    {
+        return NULL;
+    }
+
+    for( int i = 0; i < MAX_TASKS; i++ )
+    {
+        ts->tasks[i].ref = LUA_NOREF;
+        ts->tasks[i].waitRef = LUA_NOREF;
+    }
+
+    lua_pushlightuserdata( L, ts );
+    lua_rawsetp( L, LUA_REGISTRYINDEX, &schedulerKey );
+
+    return ts;
+}
+
+
+int taskCount( TaskScheduler *ts )
+{
+    return ts ? ts->count : 0;
+}
+
+
+bool runTasks( lua_State *L, TaskScheduler *ts )
+{
+    if( ts == NULL || ts->count == 0 )
+    {
+        return false;
+    }
+
+    // Wake the sleepers that are due.
+    const unsigned long now = millis();
+
+    while( ts->numSleeping > 0 )
+    {
+        Task *t = &ts->tasks[ts->sleeping[0]];
+        if( (long)(now - t->wakeTime) < 0 )
+        {
+            break;
+        }
+
+        sleepingPop( ts );
+        makeReady( ts, t );
+    }
+
+    // Check the waiters.
+    for( int i = 0; i < ts->numWaiting; )
+    {
+        Task *t = &ts->tasks[ts->waiting[i]];
+        bool done;
+
+        if( t->poll )
+        {
+            done = t->poll( t->pollObj );
+        }
+        else
+        {
+            lua_rawgeti( L, LUA_REGISTRYINDEX, t->waitRef );
+            if( lua_pcall( L, 0, 1, 0 ) != LUA_OK )
+            {
+                lua_writestringerror( "Task wait error: %s\n", lua_tostring( L, -1 ) );
+                lua_pop( L, 1 );
+
+                ts->waiting[i] = ts->waiting[--ts->numWaiting];
+                freeTask( L, ts, t );
+                continue;
+            }
+
+            done = lua_toboolean( L, -1 );
+            lua_pop( L, 1 );
+        }
+
+        if( done )
+        {
+            ts->waiting[i] = ts->waiting[--ts->numWaiting];
+
+            luaL_unref( L, LUA_REGISTRYINDEX, t->waitRef );
+            t->waitRef = LUA_NOREF;
+            t->poll = NULL;
+            t->pollObj = NULL;
+
+            makeReady( ts, t );
+            continue;
+        }
+
+        i++;
+    }
+
+    // Resume the tasks that are ready. Tasks that become ready again while doing this
+    // wait for the next pass.
+    unsigned int n = ts->readyTail - ts->readyHead;
+    while( n-- > 0 )
+    {
+        Task *t = &ts->tasks[ts->ready[ts->readyHead++ % MAX_TASKS]];
+        resumeTask( L, ts, t );
+    }
+
+    return true;
+}
+
+
+static void resumeTask( lua_State *L, TaskScheduler *ts, Task *t )
+{
+    lua_State *co = t->thread;
+
+    // A task that has never run still has its function (and arguments) on its stack.
+    int nargs = (lua_status( co ) == LUA_OK) ? lua_gettop( co ) - 1 : 0;
+
+    t->state = TASK_RUNNING;
+    ts->current = t;
+
+    int nres;
+    startBudget( co, ts->budget, "task" );
+    int rc = lua_resume( co, L, nargs, &nres );
+    endBudget( co );
+
+    ts->current = NULL;
+
+    if( rc == LUA_YIELD )
+    {
+        lua_pop( co, nres );
+
+        // Whatever made the task yield also set what it is waiting for.
+        switch( t->state )
+        {
+            case TASK_SLEEPING:
+                sleepingPush( ts, t );
+                break;
+
+            case TASK_WAITING:
+                ts->waiting[ts->numWaiting++] = t - ts->tasks;
+                break;
+
+            default:
+                // A plain yield, run it again next pass.
+                makeReady( ts, t );
+                break;
+        }
+    }
+    else
+    {
+        if( rc != LUA_OK )
+        {
+            reportTaskError( L, co );
+        }
+
+        freeTask( L, ts, t );
+    }
+}
+
+
+static void freeTask( lua_State *L, TaskScheduler *ts, Task *t )
+{
+    luaL_unref( L, LUA_REGISTRYINDEX, t->ref );
+    luaL_unref( L, LUA_REGISTRYINDEX, t->waitRef );
+
+    t->thread = NULL;
+    t->ref = LUA_NOREF;
+    t->waitRef = LUA_NOREF;
+    t->poll = NULL;
+    t->pollObj = NULL;
+    t->state = TASK_FREE;
+
+    ts->count--;
+}
+
+
+static void reportTaskError( lua_State *L, lua_State *co )
+{
+    const char *msg = lua_tostring( co, -1 );
+    luaL_traceback( L, co, msg, 0 );
+    lua_writestringerror( "Task error: %s\n", lua_tostring( L, -1 ) );
+    lua_pop( L, 1 );
+}
+
+
+static TaskScheduler *getScheduler( lua_State *L )
+{
+    lua_rawgetp( L, LUA_REGISTRYINDEX, &schedulerKey );
+    TaskScheduler *ts = (TaskScheduler*)lua_touserdata( L, -1 );
+    lua_pop( L, 1 );
+
+    if( ts == NULL )
+    {
+        luaL_error( L, "No task scheduler" );
+    }
+
+    return ts;
+}
+
+
+// The task that L is running, or NULL if L is not a task.
+static Task *currentTask( lua_State *L, TaskScheduler *ts )
+{
+    Task *t = ts->current;
+    if( t == NULL || t->thread != L || ! lua_isyieldable( L ) )
+    {
+        return NULL;
+    }
+
+    return t;
+}
+
+
+int taskAwait( lua_State *L, TaskPollFunc poll, void *obj, lua_KFunction k )
+{
+    lua_rawgetp( L, LUA_REGISTRYINDEX, &schedulerKey );
+    TaskScheduler *ts = (TaskScheduler*)lua_touserdata( L, -1 );
+    lua_pop( L, 1 );
+
+    Task *t = (ts != NULL) ? currentTask( L, ts ) : NULL;
+    if( t == NULL )
+    {
+        return luaL_error( L, "Can only wait from a task" );
+    }
+
+    t->poll = poll;
+    t->pollObj = obj;
+    t->state = TASK_WAITING;
+
+    return lua_yieldk( L, 0, 0, k );
+}
+
+
+void checkTask( lua_State *L )
+{
+    lua_rawgetp( L, LUA_REGISTRYINDEX, &schedulerKey );
+    TaskScheduler *ts = (TaskScheduler*)lua_touserdata( L, -1 );
+    lua_pop( L, 1 );
+
+    if( ts == NULL || currentTask( L, ts ) == NULL )
+    {
+        luaL_error( L, "Await methods can only be called from a task" );
+    }
+}
+
+
+//==================================================================================
+// Ready queue and sleeping heap
+//==================================================================================
+
+static void makeReady( TaskScheduler *ts, Task *t )
+{
+    t->state = TASK_READY;
+    ts->ready[ts->readyTail++ % MAX_TASKS] = t - ts->tasks;
+}
+
+
+// True if task 'a' is to wake before task 'b'. (Safe when millis() wraps.)
+static bool isEarlier( TaskScheduler *ts, uint16_t a, uint16_t b )
+{
+    return (long)(ts->tasks[a].wakeTime - ts->tasks[b].wakeTime) < 0;
+}
+
+
+static void sleepingPush( TaskScheduler *ts, Task *t )
+{
+    int i = ts->numSleeping++;
+    ts->sleeping[i] = t - ts->tasks;
+
+    // Sift up
+    while( i > 0 )
+    {
+        int parent = (i - 1) / 2;
+        if( ! isEarlier( ts, ts->sleeping[i], ts->sleeping[parent] ) )
+        {
+            break;
+        }
+
+        uint16_t tmp = ts->sleeping[i];
+        ts->sleeping[i] = ts->sleeping[parent];
+        ts->sleeping[parent] = tmp;
+        i = parent;
+    }
+}
+
+
+static Task *sleepingPop( TaskScheduler *ts )
+{
+    Task *t = &ts->tasks[ts->sleeping[0]];
+
+    ts->sleeping[0] = ts->sleeping[--ts->numSleeping];
+
+    // Sift down
+    int i = 0;
+    for( ;; )
+    {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int smallest = i;
+
+        if( left < ts->numSleeping && isEarlier( ts, ts->sleeping[left], ts->sleeping[smallest] ) )
+        {
+            smallest = left;
+        }
+
+        if( right < ts->numSleeping && isEarlier( ts, ts->sleeping[right], ts->sleeping[smallest] ) )
+        {
+            smallest = right;
+        }
+
+        if( smallest == i )
+        {
+            break;
+        }
+
+        uint16_t tmp = ts->sleeping[i];
+        ts->sleeping[i] = ts->sleeping[smallest];
+        ts->sleeping[smallest] = tmp;
+        i = smallest;
+    }
+
+    return t;
+}
+
+
+//==================================================================================
+// Lua functions
+//==================================================================================
+
+/**
+ * spawn( func, args... )
+ *
+ * Start a new task that calls the function with the given arguments.
+ * The task first runs on the next pass of the run loop.
+ */
+int luaTaskSpawn( lua_State *L )
+{
+    luaL_checktype( L, 1, LUA_TFUNCTION );
+
+    TaskScheduler *ts = getScheduler( L );
+
+    Task *t = NULL;
+    for( int i = 0; i < MAX_TASKS; i++ )
+    {
+        if( ts->tasks[i].state == TASK_FREE )
+        {
+            t = &ts->tasks[i];
+            break;
+        }
+    }
+
+    if( t == NULL )
+    {
+        return luaL_error( L, "Too many tasks (%d max)", MAX_TASKS );
+    }
+
+    const int nargs = lua_gettop( L ) - 1;
+
+    // Move the function and its arguments onto the new thread's stack.
+    lua_State *co = lua_newthread( L );
+    lua_insert( L, 1 );
+    lua_xmove( L, co, nargs + 1 );
+
+    // Stack is now: [thread]
+    t->thread = co;
+    t->ref = luaL_ref( L, LUA_REGISTRYINDEX );
+    ts->count++;
+
+    makeReady( ts, t );
+
+    return 0;
+}
+
+
+/**
+ * sleep( ms )
+ *
+ * Suspend the calling task for the given number of milliseconds.
+ */
+int luaTaskSleep( lua_State *L )
+{
+    TaskScheduler *ts = getScheduler( L );
+
+    Task *t = currentTask( L, ts );
+    if( t == NULL )
+    {
+        return luaL_error( L, "sleep() can only be called from a task" );
+    }
+
+    lua_Number ms = functionArgNumber( L, 1 );
+    if( ms < 0 )
+    {
+        return luaL_error( L, "Sleep time cannot be negative" );
+    }
+
+    t->wakeTime = millis() + (unsigned long)ms;
+    t->state = TASK_SLEEPING;
+
+    return lua_yield( L, 0 );
+}
+
+
+/**
+ * waitUntil( predicate )
+ *
+ * Suspend the calling task until the predicate function returns true.
+ * The predicate is checked once each pass of the run loop.
+ */
+int luaTaskWaitUntil( lua_State *L )
+{
+    luaL_checktype( L, 1, LUA_TFUNCTION );
+
+    TaskScheduler *ts = getScheduler( L );
+
+    Task *t = currentTask( L, ts );
+    if( t == NULL )
+    {
+        return luaL_error( L, "waitUntil() can only be called from a task" );
+    }
+
+    // Don't wait at all if the predicate is already true.
+    lua_pushvalue( L, 1 );
+    lua_call( L, 0, 1 );
+    bool done = lua_toboolean( L, -1 );
+    lua_pop( L, 1 );
+
+    if( done )
+    {
+        return 0;
+    }
+
+    lua_pushvalue( L, 1 );
+    t->waitRef = luaL_ref( L, LUA_REGISTRYINDEX );
+    t->state = TASK_WAITING;
+
+    return lua_yield( L, 0 );
+}
+
+
+/**
+ * int taskCount()
+ */
+int luaTaskCount( lua_State *L )
+{
+    lua_pushinteger( L, getScheduler( L )->count );
+    return 1;
+}
+
+
+/**
+ * setTaskBudget( microseconds )
+ *
+ * A task that runs longer than this without sleeping or waiting is made to yield.
+ */
+int luaTaskSetBudget( lua_State *L )
+{
+    int budget = functionArgInt( L, 1 );
+    if( budget < 0 )
+    {
+        return luaL_error( L, "Task budget cannot be negative" );
+    }
+
+    getScheduler( L )->budget = budget;
+    return 0;
+}
+
+
+/**
+ * int taskBudget()
+ */
+int luaTaskBudget( lua_State *L )
+{
+    lua_pushinteger( L, getScheduler( L )->budget );
+    return 1;
+}
@@ -0,0 +1,81 @@
+// lua_tasks.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Tasks are Lua coroutines run by the platform.
+//
+// A task runs until it sleeps, waits, or yields, and is then resumed from runLua() when it is
+// ready to go again. Sleeping tasks are kept in a min-heap ordered by wake time, so the cost
+// of a pass doesn't depend on how many tasks are asleep.
+//
+
+#ifndef LUA_TASKS_H
+#define LUA_TASKS_H  1
+
+#include "lua.hpp"
+
+struct TaskScheduler;
+
+
+// Most tasks that may exist at one time in each Lua state. Each one takes about 36 bytes,
+// allocated with the state. (Can be set in the build flags, to a power of two.)
+#ifndef MAX_TASKS
+#define MAX_TASKS   256
+#endif
+
+
+// Create the scheduler for a Lua state.
+TaskScheduler *newTaskScheduler( lua_State *L );
+
+// Resume all of the tasks that are ready to run. Returns false if there are no tasks.
+bool runTasks( lua_State *L, TaskScheduler *ts );
+
+int taskCount( TaskScheduler *ts );
+
+
+// Returns true when whatever is being waited on is done.
+typedef bool (*TaskPollFunc)( void *obj );
+
+//
+// Suspend the calling task until poll(obj) returns true, and then finish by calling k.
+// The poll function is called from C each pass, so there is no Lua cost while waiting.
+//
+// This returns what k returns, so a C function should end with:
+//
+//     return taskAwait( L, poll, obj, k );
+//
+// Only a task can be suspended. Waiting anywhere else would hold up the whole run loop (and
+// the shell) where the time budget can't stop it, so it is an error instead. Call checkTask()
+// before starting whatever is to be waited on, so the error comes before anything is started.
+//
+int taskAwait( lua_State *L, TaskPollFunc poll, void *obj, lua_KFunction k );
+
+// Raise a Lua error if the caller is not a task.
+void checkTask( lua_State *L );
+
+
+//
+// Lua functions (part of the luaplatform library)
+//
+int luaTaskSpawn( lua_State *L );
+int luaTaskSleep( lua_State *L );
+int luaTaskWaitUntil( lua_State *L );
+int luaTaskCount( lua_State *L );
+int luaTaskSetBudget( lua_State *L );
+int luaTaskBudget( lua_State *L );
+
+#endif
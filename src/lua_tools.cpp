@@ -20,6 +20,26 @@
 #include <lua.hpp>
 
 #include "lua_tools.h"
+#include "lua_support.h"
+
+
+// Metatable names, by LuaClassId
+static const char * const classNames[NUM_LUA_CLASSES] = {
+    "EVNMotor",
+    "EVNServo",
+    "EVNContinuousServo",
+    "EVNDrivebase",
+    "EVNDistanceSensor",
+    "EVNColourSensor",
+    "EVNCompassSensor",
+    "EVNIMUSensor",
+    "EVNDisplay",
+    "EVNMatrixLED",
+    "EVNRGBLED",
+    "EVNSevenSegmentLED",
+    "LuaChannel",
+    "RoTable",
+};
 
 
 
@@ -69,11 +89,48 @@ bool hasField( lua_State *L, const char *key, int type )
 void addIntegerConstant( lua_State *L, const char *name, lua_Integer value )
 {
     lua_pushstring( L, name );
-    lua_pushnumber( L, value );
+    lua_pushinteger( L, value );
     lua_settable( L, -3 );
 }
 
 
+/**
+ * Return the object at arg if it is a userdata of the given class, otherwise throw an error.
+ */
+void *checkObject( lua_State *L, int arg, LuaClassId id )
+{
+    void *p = lua_touserdata( L, arg );
+    if( p != NULL && lua_getmetatable( L, arg ) )
+    {
+        const void *mt = lua_topointer( L, -1 );
+        lua_pop( L, 1 );
+
+        const void **cache = luaClassCache( L );
+        if( mt == cache[id] )
+        {
+            return p;
+        }
+
+        if( cache[id] == NULL )
+        {
+            // First check of this class. (The metatable may not exist yet, if no object
+            // of the class has been made.)
+            luaL_getmetatable( L, classNames[id] );
+            cache[id] = lua_topointer( L, -1 );
+            lua_pop( L, 1 );
+
+            if( mt == cache[id] )
+            {
+                return p;
+            }
+        }
+    }
+
+    luaL_typeerror( L, arg, classNames[id] );
+    return NULL;
+}
+
+
 #if 0
 void dumpstack( lua_State *L, const char *message )
 {
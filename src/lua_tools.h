@@ -33,6 +33,33 @@ bool hasField( lua_State *L, const char *key, int type );
 
 void addIntegerConstant( lua_State *L, const char *name, lua_Integer value );
 
+
+//
+// Userdata classes, for checkObject().
+//
+enum LuaClassId {
+    CLASS_MOTOR,
+    CLASS_SERVO,
+    CLASS_CONTINUOUS_SERVO,
+    CLASS_DRIVEBASE,
+    CLASS_DISTANCE_SENSOR,
+    CLASS_COLOUR_SENSOR,
+    CLASS_COMPASS_SENSOR,
+    CLASS_IMU_SENSOR,
+    CLASS_DISPLAY,
+    CLASS_MATRIXLED,
+    CLASS_RGBLED,
+    CLASS_SEVENSEGMENT_LED,
+    CLASS_CHANNEL,
+    CLASS_ROTABLE,
+
+    NUM_LUA_CLASSES
+};
+
+// Same as luaL_checkudata(), but the class's metatable is remembered, so the check is a
+// pointer compare rather than a registry lookup by name.
+void *checkObject( lua_State *L, int arg, LuaClassId id );
+
 // void dumpstack( lua_State *L, const char *message);
 
 
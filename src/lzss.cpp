@@ -0,0 +1,159 @@
+// lzss.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "lzss.h"
+
+
+
+// Output window, a ring of the last LZSS_WINDOW_SIZE bytes.
+static uint8_t window[LZSS_WINDOW_SIZE];
+#define WINDOW_MASK     ( LZSS_WINDOW_SIZE - 1 )
+
+// Bytes decoded so far, and how many of those have been handed on.
+static uint32_t outPos;
+static uint32_t flushedPos;
+
+static LzssOutputFn outputFn;
+
+static uint8_t flags;
+static int flagBits;            // Items left for the current flag byte
+
+static bool haveMatchByte;      // Have the first byte of a match
+static uint8_t matchByte;
+
+
+static bool putByte( uint8_t c );
+static bool flush();
+
+
+
+void lzssBegin( LzssOutputFn fn )
+{
+    outputFn = fn;
+
+    outPos = 0;
+    flushedPos = 0;
+
+    flagBits = 0;
+    haveMatchByte = false;
+}
+
+
+bool lzssDecode( const uint8_t *data, size_t len )
+{
+    for( size_t i = 0; i < len; i++ )
+    {
+        const uint8_t c = data[i];
+
+        if( flagBits == 0 )
+        {
+            flags = c;
+            flagBits = 8;
+        }
+        else if( flags & 1 )
+        {
+            // Literal
+            if( putByte( c ) == false )
+            {
+                return false;
+            }
+
+            flags >>= 1;
+            flagBits--;
+        }
+        else if( haveMatchByte == false )
+        {
+            matchByte = c;
+            haveMatchByte = true;
+        }
+        else
+        {
+            // Match
+            const uint32_t distance = ( matchByte | ( ( c >> LZSS_LENGTH_BITS ) << 8 ) ) + 1;
+            int length = ( c & ( ( 1 << LZSS_LENGTH_BITS ) - 1 ) ) + LZSS_MIN_MATCH;
+
+            if( distance > outPos )
+            {
+                // Reaches back before the start.
+                return false;
+            }
+
+            while( length-- )
+            {
+                if( putByte( window[( outPos - distance ) & WINDOW_MASK] ) == false )
+                {
+                    return false;
+                }
+            }
+
+            haveMatchByte = false;
+            flags >>= 1;
+            flagBits--;
+        }
+    }
+
+    // Hand on what this piece decoded to.
+    return flush();
+}
+
+
+bool lzssEnd()
+{
+    return flush() && haveMatchByte == false;
+}
+
+
+//==================================================================================
+
+static bool putByte( uint8_t c )
+{
+    window[outPos & WINDOW_MASK] = c;
+    outPos++;
+
+    // Don't overwrite bytes that haven't been handed on yet.
+    if( outPos - flushedPos == LZSS_WINDOW_SIZE )
+    {
+        return flush();
+    }
+
+    return true;
+}
+
+
+static bool flush()
+{
+    while( flushedPos != outPos )
+    {
+        const uint32_t start = flushedPos & WINDOW_MASK;
+        uint32_t n = outPos - flushedPos;
+
+        // Up to the end of the ring, then the rest from the start.
+        if( n > LZSS_WINDOW_SIZE - start )
+        {
+            n = LZSS_WINDOW_SIZE - start;
+        }
+
+        if( outputFn( window + start, n ) == false )
+        {
+            return false;
+        }
+
+        flushedPos += n;
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+// lzss.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Streaming LZSS decoder, for compressed downloads. (tools/lzss.py is the compressor.)
+//
+// The compressed data is a flag byte followed by up to 8 items, then another flag byte, and
+// so on. Flag bit i (lowest first) tells whether item i is a literal byte (1) or a match (0).
+// A match is two bytes:
+//
+//     distance - 1, low 8 bits
+//     (distance - 1) high 3 bits << 5  |  length - 3
+//
+// copying 3-34 bytes from 1-2048 bytes back in the output.
+//
+// The output window is the only memory the decoder needs. Input can be given in pieces of
+// any size, and the output is handed on in pieces as it is decoded.
+//
+
+#ifndef LZSS_H
+#define LZSS_H  1
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define LZSS_WINDOW_BITS    11
+#define LZSS_LENGTH_BITS    5
+
+#define LZSS_WINDOW_SIZE    ( 1 << LZSS_WINDOW_BITS )
+#define LZSS_MIN_MATCH      3
+#define LZSS_MAX_MATCH      ( LZSS_MIN_MATCH + ( 1 << LZSS_LENGTH_BITS ) - 1 )
+
+
+// Gets the decoded data. Returns false to stop decoding.
+typedef bool (*LzssOutputFn)( const void *data, size_t len );
+
+
+// Start decoding a new stream.
+void lzssBegin( LzssOutputFn fn );
+
+// Decode more of the stream. Returns false if the data is bad or the output function failed.
+bool lzssDecode( const uint8_t *data, size_t len );
+
+// Hand on the last of the output. Returns false if the stream ended in the middle of a match.
+bool lzssEnd();
+
+#endif
@@ -0,0 +1,96 @@
+// mem_stats.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "mem_stats.h"
+
+
+
+void memInit( MemStats *ms )
+{
+    memset( ms, 0, sizeof(MemStats) );
+    ms->current = -1;
+}
+
+
+void memReset( MemStats *ms )
+{
+    ms->peak = ms->live;
+    memset( ms->allocs, 0, sizeof(ms->allocs) );
+}
+
+
+int memBeginModule( MemStats *ms, const char *name, bool restart )
+{
+    const int previous = ms->current;
+
+    for( int i = 0; i < ms->numModules; i++ )
+    {
+        if( strncmp( ms->modules[i].name, name, MEM_MODULE_NAME_SIZE - 1 ) == 0 )
+        {
+            if( restart )
+            {
+                ms->modules[i].bytes = 0;
+            }
+            ms->current = i;
+            return previous;
+        }
+    }
+
+    if( ms->numModules < MEM_MAX_MODULES )
+    {
+        ModuleMem *mod = &ms->modules[ms->numModules];
+
+        strncpy( mod->name, name, MEM_MODULE_NAME_SIZE - 1 );
+        mod->name[MEM_MODULE_NAME_SIZE - 1] = '\0';
+        mod->bytes = 0;
+
+        ms->current = ms->numModules++;
+    }
+    else
+    {
+        ms->current = -1;
+    }
+
+    return previous;
+}
+
+
+void memEndModule( MemStats *ms, int previous )
+{
+    ms->current = previous;
+}
+
+
+size_t memBeginPeak( MemStats *ms )
+{
+    const size_t previous = ms->peak;
+    ms->peak = ms->live;
+    return previous;
+}
+
+
+size_t memEndPeak( MemStats *ms, size_t previous )
+{
+    const size_t peak = ms->peak;
+    if( previous > ms->peak )
+    {
+        ms->peak = previous;
+    }
+    return peak;
+}
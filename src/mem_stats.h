@@ -0,0 +1,101 @@
+// mem_stats.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Accounting of the memory used by a Lua state.
+//
+// Every allocation the state makes passes through memRecord(), which is only a handful of
+// additions, so this is cheap enough to leave on all the time.
+//
+// While a module is being loaded (compiled and run), the bytes allocated are also added to
+// that module's total. This is what the module allocated, not what it still holds, since
+// there's no way to know which module a block belongs to when it is freed.
+//
+
+#ifndef MEM_STATS_H
+#define MEM_STATS_H  1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lua_pool.h"
+
+
+// Most modules that are tracked. Any more are not attributed.
+#define MEM_MAX_MODULES         16
+
+#define MEM_MODULE_NAME_SIZE    24
+
+// Allocation counts are kept for each pool size class, plus one for larger blocks.
+#define MEM_NUM_CLASSES         (POOL_NUM_CLASSES + 1)
+
+
+struct ModuleMem {
+    char name[MEM_MODULE_NAME_SIZE];
+    size_t bytes;
+};
+
+
+struct MemStats {
+    size_t live;
+    size_t peak;
+    uint32_t allocs[MEM_NUM_CLASSES];
+
+    ModuleMem modules[MEM_MAX_MODULES];
+    int numModules;
+    int current;                // Index of the module being loaded, or -1
+};
+
+
+void memInit( MemStats *ms );
+
+// Clears the peak (to the current live size) and the allocation counts.
+void memReset( MemStats *ms );
+
+// Start attributing allocations to the named module. Returns what to pass to memEndModule().
+// Restart clears the module's count, for when it is being (re)loaded from the beginning.
+int memBeginModule( MemStats *ms, const char *name, bool restart );
+void memEndModule( MemStats *ms, int previous );
+
+// Measure the peak over a section of code. The peak starts again from the live size, and the
+// old peak is returned to pass to memEndPeak(), which returns the peak reached in the section.
+size_t memBeginPeak( MemStats *ms );
+size_t memEndPeak( MemStats *ms, size_t previous );
+
+
+// Record a successful allocation, reallocation, or free. (osize is zero for a new block.)
+static inline void memRecord( MemStats *ms, size_t osize, size_t nsize )
+{
+    ms->live = ms->live - osize + nsize;
+
+    if( nsize > osize )
+    {
+        if( ms->live > ms->peak )
+        {
+            ms->peak = ms->live;
+        }
+
+        ms->allocs[(nsize <= POOL_MAX_SMALL) ? poolSizeClass( nsize ) : POOL_NUM_CLASSES]++;
+
+        if( ms->current >= 0 )
+        {
+            ms->modules[ms->current].bytes += nsize - osize;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,374 @@
+// output_buffer.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (ARDUINO_ARCH_RP2040)
+#include <pico/critical_section.h>
+#include <pico/mutex.h>
+#endif
+
+#include "lua_support.h"
+#include "output_buffer.h"
+
+
+
+// Either core may write to the buffer, so the lock must keep out the other core. It is only
+// held to copy in and out of the buffer, never while writing to the port.
+//
+// The send lock is held while a chunk taken from the buffer is written to the port, so that
+// if both cores are sending, the chunks can't go out of order.
+#if defined (ARDUINO_ARCH_RP2040)
+static critical_section_t bufferLock;
+auto_init_mutex( sendMutex );
+#define LOCK_BUFFER()       critical_section_enter_blocking( &bufferLock )
+#define UNLOCK_BUFFER()     critical_section_exit( &bufferLock )
+#define LOCK_SEND()         mutex_enter_blocking( &sendMutex )
+#define TRY_LOCK_SEND()     mutex_try_enter( &sendMutex, NULL )
+#define UNLOCK_SEND()       mutex_exit( &sendMutex )
+#else
+#define LOCK_BUFFER()       noInterrupts()
+#define UNLOCK_BUFFER()     interrupts()
+#define LOCK_SEND()
+#define TRY_LOCK_SEND()     true
+#define UNLOCK_SEND()
+#endif
+
+
+// Most sent to the port at a time.
+#define SEND_CHUNK      64
+
+
+static uint8_t defaultBuffer[OUTPUT_BUFFER_SIZE];
+
+static uint8_t *buffer = defaultBuffer;
+static size_t bufferSize = OUTPUT_BUFFER_SIZE;
+
+// Free-running indexes, only changed with the buffer locked.
+static uint32_t head = 0;
+static uint32_t tail = 0;
+
+// End of the output written with outputWriteWait(). Dropping the oldest output mustn't take
+// tail past this, so shell output (and the like) is never lost.
+static uint32_t waitHead = 0;
+
+static OutputPolicy policy = OUTPUT_DROP_OLDEST;
+
+static volatile unsigned long dropped = 0;
+
+
+static void writeData( const uint8_t *data, size_t len, OutputPolicy overflow );
+static size_t putData( const uint8_t *data, size_t len );
+static size_t takeData( uint8_t *data, size_t max );
+static bool sendChunk( bool wait );
+
+
+
+void initOutput()
+{
+#if defined (ARDUINO_ARCH_RP2040)
+    critical_section_init( &bufferLock );
+#endif
+}
+
+
+bool setOutputBuffer( size_t size )
+{
+    if( size > OUTPUT_BUFFER_MAX )
+    {
+        size = OUTPUT_BUFFER_MAX;
+    }
+
+    size_t newSize = 0;
+    if( size > 0 )
+    {
+        newSize = 1;
+        while( newSize < size )
+        {
+            newSize <<= 1;
+        }
+    }
+
+    uint8_t *newBuffer = defaultBuffer;
+    if( newSize > OUTPUT_BUFFER_SIZE )
+    {
+        newBuffer = (uint8_t*)malloc( newSize );
+        if( newBuffer == NULL )
+        {
+            return false;
+        }
+    }
+
+    LOCK_SEND();
+
+    // Send what is in the old buffer first.
+    while( sendChunk( true ) )
+        ;
+
+    LOCK_BUFFER();
+
+    uint8_t *oldBuffer = buffer;
+    buffer = newBuffer;
+    bufferSize = newSize;
+    head = 0;
+    tail = 0;
+    waitHead = 0;
+
+    UNLOCK_BUFFER();
+
+    UNLOCK_SEND();
+
+    if( oldBuffer != defaultBuffer && oldBuffer != newBuffer )
+    {
+        free( oldBuffer );
+    }
+
+    return true;
+}
+
+
+size_t outputBufferSize()
+{
+    return bufferSize;
+}
+
+
+void setOutputPolicy( OutputPolicy newPolicy )
+{
+    policy = newPolicy;
+}
+
+
+OutputPolicy outputPolicy()
+{
+    return policy;
+}
+
+
+void outputWrite( const void *data, size_t len )
+{
+    writeData( (const uint8_t*)data, len, policy );
+}
+
+
+void outputWriteWait( const void *data, size_t len )
+{
+    writeData( (const uint8_t*)data, len, OUTPUT_BLOCK );
+}
+
+
+void drainOutput()
+{
+    if( ! TRY_LOCK_SEND() )
+    {
+        // The other core is sending.
+        return;
+    }
+
+    while( sendChunk( false ) )
+        ;
+
+    UNLOCK_SEND();
+}
+
+
+void flushOutput()
+{
+    LOCK_SEND();
+
+    while( sendChunk( true ) )
+        ;
+
+    UNLOCK_SEND();
+}
+
+
+size_t outputPending()
+{
+    return head - tail;
+}
+
+
+unsigned long droppedOutput()
+{
+    return dropped;
+}
+
+
+//==================================================================================
+
+static void writeData( const uint8_t *data, size_t len, OutputPolicy overflow )
+{
+    if( bufferSize == 0 )
+    {
+        // Unbuffered
+        LOCK_SEND();
+        LUA_SERIAL.write( data, len );
+        UNLOCK_SEND();
+        return;
+    }
+
+    if( overflow == OUTPUT_BLOCK )
+    {
+        // Send the buffer from here as needed to make room.
+        while( len > 0 )
+        {
+            size_t n = putData( data, len );
+            data += n;
+            len -= n;
+
+            if( len > 0 )
+            {
+                LOCK_SEND();
+                if( sendChunk( true ) == false )
+                {
+                    // Nothing to send, so the buffer was turned off by the other core.
+                    LUA_SERIAL.write( data, len );
+                    len = 0;
+                }
+                UNLOCK_SEND();
+            }
+        }
+        return;
+    }
+
+    LOCK_BUFFER();
+
+    size_t room = bufferSize - ( head - tail );
+
+    if( len > room )
+    {
+        if( overflow == OUTPUT_DROP_NEWEST )
+        {
+            // All or nothing, so messages aren't cut short.
+            dropped += len;
+            len = 0;
+        }
+        else
+        {
+            // Waited-for output in front of the oldest droppable output can't be skipped over,
+            // so if there is any, nothing can be dropped to make room.
+            size_t droppable = ( (int32_t)( waitHead - tail ) > 0 ) ? 0 : head - tail;
+
+            if( len > bufferSize )
+            {
+                // Only the end of it will fit.
+                dropped += len - bufferSize;
+                data += len - bufferSize;
+                len = bufferSize;
+            }
+
+            size_t n = len - room;
+            if( n > droppable )
+            {
+                dropped += len;
+                len = 0;
+            }
+            else
+            {
+                dropped += n;
+                tail += n;
+            }
+        }
+    }
+
+    for( size_t i = 0; i < len; i++ )
+    {
+        buffer[head++ & ( bufferSize - 1 )] = data[i];
+    }
+
+    UNLOCK_BUFFER();
+}
+
+
+/**
+ * Copy in as much as there is room for, as output that can't be dropped.
+ * Returns the number of bytes copied.
+ */
+static size_t putData( const uint8_t *data, size_t len )
+{
+    LOCK_BUFFER();
+
+    size_t room = bufferSize - ( head - tail );
+    size_t n = ( len < room ) ? len : room;
+
+    for( size_t i = 0; i < n; i++ )
+    {
+        buffer[head++ & ( bufferSize - 1 )] = data[i];
+    }
+
+    waitHead = head;
+
+    UNLOCK_BUFFER();
+
+    return n;
+}
+
+
+static size_t takeData( uint8_t *data, size_t max )
+{
+    LOCK_BUFFER();
+
+    size_t n = 0;
+    while( n < max && tail != head )
+    {
+        data[n++] = buffer[tail++ & ( bufferSize - 1 )];
+    }
+
+    UNLOCK_BUFFER();
+
+    return n;
+}
+
+
+/**
+ * Send a chunk of the buffer to the port. Without 'wait', only as much as the port will take
+ * without waiting. Must be called with the send lock held.
+ * Returns false if there was nothing (more) to send.
+ */
+static bool sendChunk( bool wait )
+{
+    size_t max = SEND_CHUNK;
+
+    if( ! wait )
+    {
+        int room = LUA_SERIAL.availableForWrite();
+        if( room <= 0 )
+        {
+            return false;
+        }
+
+        if( (size_t)room < max )
+        {
+            max = room;
+        }
+    }
+
+    uint8_t chunk[SEND_CHUNK];
+    size_t n = takeData( chunk, max );
+    if( n == 0 )
+    {
+        return false;
+    }
+
+    LUA_SERIAL.write( chunk, n );
+
+    return true;
+}
+
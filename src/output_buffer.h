@@ -0,0 +1,83 @@
+// output_buffer.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Buffered output to LUA_SERIAL, for Lua print(), error messages, debug messages and the shell.
+//
+// Output goes into a ring buffer, and the core 0 run loop sends it on a little at a time, only
+// as much as the port will take without waiting. So a print() from a loop function costs a copy
+// into the buffer, however slow the link is.
+//
+// If the buffer fills up, print() output from the loop functions and tasks is dropped (the oldest
+// or the newest, and counted) or waited for, as set by the overflow policy. Other output (the
+// shell, and print() from shell commands or setup()) always waits, and is never dropped to make
+// room for later output, so it is never lost.
+//
+
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H  1
+
+#include <stddef.h>
+
+
+// Default buffer size. (Sizes are rounded up to a power of two.)
+#define OUTPUT_BUFFER_SIZE      1024
+
+// Largest buffer that can be set.
+#define OUTPUT_BUFFER_MAX       32768
+
+
+enum OutputPolicy {
+    OUTPUT_DROP_OLDEST,     // Make room by dropping the oldest output
+    OUTPUT_DROP_NEWEST,     // Drop output that doesn't fit
+    OUTPUT_BLOCK,           // Wait for room (send the output from the caller)
+
+    NUM_OUTPUT_POLICIES
+};
+
+
+// Must be called before any output is written (other than straight to the port).
+void initOutput();
+
+// Set the buffer size, which flushes the buffer. A size of zero sends all output straight to
+// the port, as it is written. Returns false if the buffer couldn't be allocated (the old one is
+// kept).
+bool setOutputBuffer( size_t size );
+size_t outputBufferSize();
+
+void setOutputPolicy( OutputPolicy policy );
+OutputPolicy outputPolicy();
+
+// Output that follows the overflow policy (print() and debug messages). Either core.
+void outputWrite( const void *data, size_t len );
+
+// Output that is never dropped, waiting for room if need be (the shell). Either core.
+void outputWriteWait( const void *data, size_t len );
+
+// Send as much of the buffer as the port will take without waiting. Called from the run loop.
+void drainOutput();
+
+// Send everything in the buffer, waiting for the port as needed.
+void flushOutput();
+
+// Bytes waiting to be sent.
+size_t outputPending();
+
+// Bytes dropped because the buffer was full.
+unsigned long droppedOutput();
+
+#endif
@@ -0,0 +1,252 @@
+// rotable.cpp
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "lua.hpp"
+
+#include "lua_tools.h"
+#include "rotable.h"
+
+
+
+#define ROTABLE_CLASS_NAME      "RoTable"
+
+// Registry key for the table of RoTable objects already made, by entries pointer.
+static const char roTablesKey = 0;
+
+
+static void pushRoTable( lua_State *L, const RoEntry *entries, void (*init)( lua_State *L ) );
+static void pushRoValue( lua_State *L, const RoEntry *e );
+static const RoEntry *checkRoTable( lua_State *L, int arg );
+static int roTableIndex( lua_State *L );
+static int roTableNewIndex( lua_State *L );
+static int roTablePairs( lua_State *L );
+static int roTableNext( lua_State *L );
+static int roIndex( lua_State *L );
+
+
+
+void pushRoTable( lua_State *L, const RoEntry *entries )
+{
+    pushRoTable( L, entries, NULL );
+}
+
+
+static void pushRoTable( lua_State *L, const RoEntry *entries, void (*init)( lua_State *L ) )
+{
+    if( lua_rawgetp( L, LUA_REGISTRYINDEX, &roTablesKey ) != LUA_TTABLE )
+    {
+        lua_pop( L, 1 );
+        lua_newtable( L );
+        lua_pushvalue( L, -1 );
+        lua_rawsetp( L, LUA_REGISTRYINDEX, &roTablesKey );
+    }
+
+    if( lua_rawgetp( L, -1, entries ) == LUA_TNIL )
+    {
+        lua_pop( L, 1 );
+
+        // First use of the table in this state.
+        if( init != NULL )
+        {
+            init( L );
+        }
+
+        const RoEntry **p = (const RoEntry**)lua_newuserdatauv( L, sizeof(const RoEntry*), 1 );
+        *p = entries;
+
+        // Cache of the entries looked up so far.
+        lua_newtable( L );
+        lua_setiuservalue( L, -2, 1 );
+
+        if( luaL_newmetatable( L, ROTABLE_CLASS_NAME ) )
+        {
+            lua_pushcfunction( L, roTableIndex );
+            lua_setfield( L, -2, "__index" );
+            lua_pushcfunction( L, roTableNewIndex );
+            lua_setfield( L, -2, "__newindex" );
+            lua_pushcfunction( L, roTablePairs );
+            lua_setfield( L, -2, "__pairs" );
+        }
+        lua_setmetatable( L, -2 );
+
+        lua_pushvalue( L, -1 );
+        lua_rawsetp( L, -3, entries );
+    }
+
+    lua_remove( L, -2 );    // Remove the RoTables table
+}
+
+
+void setRoIndex( lua_State *L, const RoEntry *entries )
+{
+    // __index is a plain table, so looking up a method is as fast as it would be in a
+    // method table. It starts empty, and its own __index finds each method the first time it
+    // is used and adds it.
+    lua_newtable( L );
+
+    lua_createtable( L, 0, 1 );
+    lua_pushlightuserdata( L, (void*)entries );
+    lua_pushcclosure( L, roIndex, 1 );
+    lua_setfield( L, -2, "__index" );
+    lua_setmetatable( L, -2 );
+
+    lua_setfield( L, -2, "__index" );
+}
+
+
+const RoEntry *findRoEntry( const RoEntry *entries, const char *key )
+{
+    for( const RoEntry *e = entries; e->name != NULL; e++ )
+    {
+        if( e->name[0] == key[0] && strcmp( e->name, key ) == 0 )
+        {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+
+//==================================================================================
+
+static void pushRoValue( lua_State *L, const RoEntry *e )
+{
+    switch( e->type )
+    {
+        case RO_FUNCTION:
+            lua_pushcfunction( L, e->func );
+            break;
+
+        case RO_INTEGER:
+            lua_pushinteger( L, e->value );
+            break;
+
+        case RO_TABLE:
+        case RO_CLASS:
+            pushRoTable( L, e->table, e->init );
+            break;
+
+        default:
+            lua_pushnil( L );
+            break;
+    }
+}
+
+
+static const RoEntry *checkRoTable( lua_State *L, int arg )
+{
+    return *(const RoEntry**)checkObject( L, arg, CLASS_ROTABLE );
+}
+
+
+// __index for RoTable objects
+static int roTableIndex( lua_State *L )
+{
+    const RoEntry *entries = checkRoTable( L, 1 );
+
+    // Looked up before?
+    lua_getiuservalue( L, 1, 1 );
+    lua_pushvalue( L, 2 );
+    if( lua_rawget( L, 3 ) != LUA_TNIL )
+    {
+        return 1;
+    }
+    lua_pop( L, 1 );
+
+    const RoEntry *e = (lua_type( L, 2 ) == LUA_TSTRING) ? findRoEntry( entries, lua_tostring( L, 2 ) ) : NULL;
+    if( e == NULL )
+    {
+        lua_pushnil( L );
+        return 1;
+    }
+
+    pushRoValue( L, e );
+
+    lua_pushvalue( L, 2 );
+    lua_pushvalue( L, -2 );
+    lua_rawset( L, 3 );
+    return 1;
+}
+
+
+static int roTableNewIndex( lua_State *L )
+{
+    return luaL_error( L, "Attempt to change a read-only table" );
+}
+
+
+// pairs( t )
+static int roTablePairs( lua_State *L )
+{
+    checkRoTable( L, 1 );
+
+    lua_pushcfunction( L, roTableNext );
+    lua_pushvalue( L, 1 );
+    lua_pushnil( L );
+    return 3;
+}
+
+
+static int roTableNext( lua_State *L )
+{
+    const RoEntry *e = checkRoTable( L, 1 );
+
+    if( ! lua_isnil( L, 2 ) )
+    {
+        e = findRoEntry( e, luaL_checkstring( L, 2 ) );
+        if( e == NULL )
+        {
+            return luaL_error( L, "Invalid key to 'next'" );
+        }
+        e++;
+    }
+
+    if( e->name == NULL )
+    {
+        lua_pushnil( L );
+        return 1;
+    }
+
+    lua_pushstring( L, e->name );
+    pushRoValue( L, e );
+    return 2;
+}
+
+
+// __index for the method cache of class metatables (cache, key). Upvalue: [entries]
+static int roIndex( lua_State *L )
+{
+    const RoEntry *entries = (const RoEntry*)lua_touserdata( L, lua_upvalueindex( 1 ) );
+
+    const RoEntry *e = (lua_type( L, 2 ) == LUA_TSTRING) ? findRoEntry( entries, lua_tostring( L, 2 ) ) : NULL;
+    if( e == NULL )
+    {
+        lua_pushnil( L );
+        return 1;
+    }
+
+    pushRoValue( L, e );
+
+    // Add it to the cache, so this isn't called for it again.
+    lua_pushvalue( L, 2 );
+    lua_pushvalue( L, -2 );
+    lua_rawset( L, 1 );
+    return 1;
+}
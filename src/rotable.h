@@ -0,0 +1,72 @@
+// rotable.h
+
+/*
+ * Copyright 2024 Donald T. Meyer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//
+// Read-only tables kept in flash.
+//
+// The library function and constant tables never change, so rather than building them as
+// Lua tables in RAM, they are const arrays of RoEntry. Lua sees each one as a small userdata
+// that looks up keys in its array, and can be indexed and iterated with pairs() like a table.
+//
+// A class table can be given an init function, which is called the first time the class is
+// used rather than when the library is loaded, so unused classes cost nothing.
+//
+// The same arrays can also serve as the methods for a class, by making the class metatable's
+// __index look them up with setRoIndex().
+//
+// Entries are found by a linear search, so each one found is cached in a (per state) table,
+// and only looked up once.
+//
+
+#ifndef ROTABLE_H
+#define ROTABLE_H  1
+
+#include "lua.hpp"
+
+
+enum RoType { RO_NONE, RO_FUNCTION, RO_INTEGER, RO_TABLE, RO_CLASS };
+
+
+struct RoEntry {
+    const char *name;
+    RoType type;
+    lua_CFunction func;
+    lua_Integer value;
+    const RoEntry *table;
+    void (*init)( lua_State *L );
+};
+
+
+#define RO_FUNC( name, func )           { name, RO_FUNCTION, func, 0, NULL, NULL }
+#define RO_INT( name, value )           { name, RO_INTEGER, NULL, (lua_Integer)(value), NULL, NULL }
+#define RO_TABLE( name, table )         { name, RO_TABLE, NULL, 0, table, NULL }
+#define RO_END                          { NULL, RO_NONE, NULL, 0, NULL, NULL }
+
+// A table that needs some setup in each Lua state (such as a metatable for its objects).
+// init is called the first time the table is used.
+#define RO_CLASS( name, table, init )   { name, RO_CLASS, NULL, 0, table, init }
+
+
+// Push the read-only table for the entries. The same object is pushed each time.
+void pushRoTable( lua_State *L, const RoEntry *entries );
+
+// Set the __index of the metatable on the top of the stack to look up keys in the entries.
+void setRoIndex( lua_State *L, const RoEntry *entries );
+
+const RoEntry *findRoEntry( const RoEntry *entries, const char *key );
+
+#endif
@@ -16,16 +16,21 @@
  */
 
 #include <Arduino.h>
-#if defined (ARDUINO_ARCH_RP2040)
-#include <SDFS.h>
-#else
-#include <SD.h>
-#endif
 
 #include "lua.hpp"
 
 #include "shell.h"
 #include "lua_support.h"
+#include "loop_stats.h"
+#include "lua_pool.h"
+#include "mem_stats.h"
+#include "bytecode_cache.h"
+#include "crc32.h"
+#include "frame_receiver.h"
+#include "download_file.h"
+#include "lzss.h"
+#include "delta_sync.h"
+#include "output_buffer.h"
 
 
 
@@ -39,7 +44,9 @@ enum class ShellMode {
     Multiline,
 
     DownloadReady,
-    DownloadUnderway
+    DownloadUnderway,
+
+    FramedDownload
 };
 
 static ShellMode shellMode = ShellMode::Interactive;
@@ -48,13 +55,36 @@ static char downloadModname[80];
 
 static unsigned long lastCharTime = 0;
 
+// A framed download is given up if nothing arrives for this long (ms).
+#define FRAMED_DOWNLOAD_TIMEOUT     5000
+
+// Named downloads are written straight to their file as they arrive. Anonymous ones are
+// run rather than saved, so they are collected in downloadBuf.
+static bool downloadToFile;
+static bool downloadOk;
+
+// Of the data downloaded, to check a framed download against its END frame.
+static uint32_t downloadSize;
+static uint32_t downloadCrc;
+
 
 static void handleShellChar( lua_State *L, char c );
 static void processCommand( lua_State *L, const char *line );
 
+static void beginDownload( lua_State *L );
+static bool addDownload( const void *data, size_t len );
 static void finishDownload( lua_State *L );
+static bool addDownloadData( void *ud, const uint8_t *data, size_t len );
+static bool addDecodedData( const void *data, size_t len );
+static void startFramedDownload( lua_State *L, uint8_t allowedFlags );
+static void finishFramedDownload( lua_State *L );
+static void discardDownload( lua_State *L );
+static void printSignature();
+static bool setModname( const char *name, size_t len );
 
 static void processControl( lua_State *L, const char *cmd );
+static void printLoopStats();
+static void printMemStats( lua_State *L );
 static void processInteractiveLine( lua_State *L, const char *line );
 static void processMultiline( lua_State *L, const char *line );
 
@@ -99,15 +129,52 @@ void handleShell( lua_State *L )
         }
     }
 
+    if( shellMode == ShellMode::FramedDownload )
+    {
+        if( millis() - lastCharTime >= FRAMED_DOWNLOAD_TIMEOUT )
+        {
+            shellPrint( "Download timed out\n" );
+
+            discardDownload( L );
+
+            shellMode = ShellMode::Interactive;
+
+            needPrompt = true;
+        }
+    }
+
     // Get all pending characters from the terminal.
     while( LUA_SERIAL.available() )
     {
         int c = LUA_SERIAL.read();
 
-        // If ready to download, prep the buffer and set the mode to Underway.
+        if( shellMode == ShellMode::FramedDownload )
+        {
+            lastCharTime = millis();
+
+            FrameStatus status = frameReceiverByte( c );
+            if( status == FRAME_COMPLETE )
+            {
+                finishFramedDownload( L );
+            }
+            else if( status == FRAME_FAILED )
+            {
+                shellPrint( "Download failed: %s\n", frameReceiverError() );
+                discardDownload( L );
+            }
+
+            if( status != FRAME_MORE )
+            {
+                shellMode = ShellMode::Interactive;
+                needPrompt = true;
+            }
+            continue;
+        }
+
+        // If ready to download, start the file (or buffer) and set the mode to Underway.
         if( shellMode == ShellMode::DownloadReady )
         {
-            luaL_buffinit( L, &downloadBuf );
+            beginDownload( L );
 
             shellMode = ShellMode::DownloadUnderway;
         }
@@ -115,7 +182,9 @@ void handleShell( lua_State *L )
         if( shellMode == ShellMode::DownloadUnderway )
         {
             lastCharTime = millis();
-            luaL_addchar( &downloadBuf, c );
+
+            char ch = c;
+            addDownload( &ch, 1 );
         }
         else
         {
@@ -125,42 +194,77 @@ void handleShell( lua_State *L )
 }
 
 
-static void finishDownload( lua_State *L )
+static void beginDownload( lua_State *L )
 {
-    // Push buffer result onto stack
-    luaL_pushresult( &downloadBuf );
+    downloadSize = 0;
+    downloadCrc = 0;
+
+    downloadToFile = ( downloadModname[0] != '\0' );
+    if( downloadToFile )
+    {
+        downloadOk = downloadFileOpen( downloadModname );
+        if( downloadOk == false )
+        {
+            shellPrint( "Unable to create a file for '%s'\n", downloadModname );
+        }
+    }
+    else
+    {
+        luaL_buffinit( L, &downloadBuf );
+        downloadOk = true;
+    }
+}
 
-    // Get the pointer to the string, and its length.
-    size_t len;
-    const char *p = lua_tolstring( L, -1, &len );
 
-    if( downloadModname[0] != '\0' )
+/**
+ * Add downloaded data to the module's file or the buffer.
+ * Returns false if it can't be saved.
+ */
+static bool addDownload( const void *data, size_t len )
+{
+    if( downloadToFile )
     {
-        // Download has a module name given.
+        if( downloadOk )
+        {
+            downloadOk = downloadFileWrite( data, len );
+        }
+    }
+    else
+    {
+        luaL_addlstring( &downloadBuf, (const char*)data, len );
+    }
 
-        // Write to file
-        char fname[64];
-        snprintf( fname, sizeof(fname), "/%s.lua", downloadModname );
+    downloadSize += len;
+    downloadCrc = crc32Update( downloadCrc, data, len );
 
-        shellPrint( "Writing file '%s'\n", fname );
+    return downloadOk;
+}
 
-#if defined (ARDUINO_ARCH_RP2040)
-        File file = SDFS.open( fname, "w" );
-#else
-        SD.remove( fname );
-        File file = SD.open( fname, FILE_WRITE );
-#endif
-        if( file )
+
+static void finishDownload( lua_State *L )
+{
+    if( downloadToFile )
+    {
+        // Download has a module name given.
+        const DownloadCommit commit = downloadOk ? downloadFileCommit() : DownloadCommit::WriteFailed;
+        if( commit == DownloadCommit::WriteFailed )
         {
-            size_t nr = file.write( (uint8_t*)p, len );
-            file.close();
+            shellPrint( "Unable to write file '/%s.lua'\n", downloadModname );
+            downloadFileAbort();
+            return;
         }
-        else
+
+        if( commit == DownloadCommit::RenameFailed )
         {
-            lua_pushfstring( L, "Unable to open file '%s'", fname );
+            // The old module is still in place, so the new one is left for the user to rename.
+            shellPrint( "Unable to replace file '/%s.lua', the download is in '/%s.tmp'\n", downloadModname, downloadModname );
+            return;
         }
 
-        lua_pop( L, 1 );    // Pop string from stack
+        shellPrint( "Wrote file '/%s.lua'\n", downloadModname );
+
+        // The old compiled version is stale now. Loading the file will cache it again.
+        removeBytecode( downloadModname );
 
         // Load and run the file
         loadLuaFile( L, downloadModname );
@@ -170,6 +274,14 @@ static void finishDownload( lua_State *L )
         // No module name.
         shellPrint( "Loading anonymous Lua chunk\n" );
 
+        // Push buffer result onto stack
+        luaL_pushresult( &downloadBuf );
+        const int base = lua_gettop( L ) - 1;
+
+        // Get the pointer to the string, and its length.
+        size_t len;
+        const char *p = lua_tolstring( L, -1, &len );
+
         // Execute the chunk of Lua code.
         int err = luaL_loadbuffer( L, p, len, "download" );
         if( err )
@@ -191,11 +303,132 @@ static void finishDownload( lua_State *L )
             }
         }
 
+        lua_settop( L, base );      // Pop the chunk string and its results (or error)
+    }
+}
+
+
+// FrameDataFn for framed downloads.
+static bool addDownloadData( void *ud, const uint8_t *data, size_t len )
+{
+    (void)ud;
+
+    if( frameReceiverFlags() & FRAME_FLAG_LZSS )
+    {
+        // Decompressed straight into the file, through addDecodedData().
+        return lzssDecode( data, len );
+    }
+
+    return addDecodedData( data, len );
+}
+
+
+// LzssOutputFn for compressed downloads (and the data of uncompressed ones).
+static bool addDecodedData( const void *data, size_t len )
+{
+    if( frameReceiverFlags() & FRAME_FLAG_DELTA )
+    {
+        // Sync instructions, which rebuild the file through addDownload().
+        return deltaDecode( (const uint8_t*)data, len );
+    }
+
+    return addDownload( data, len );
+}
+
+
+static void startFramedDownload( lua_State *L, uint8_t allowedFlags )
+{
+    beginDownload( L );
+
+    lzssBegin( addDecodedData );
+    deltaBegin( addDownload );
+    frameReceiverBegin( addDownloadData, NULL, allowedFlags );
+
+    lastCharTime = millis();
+
+    shellMode = ShellMode::FramedDownload;
+
+    shellPrint( "Waiting for framed download of '%s'...\n", downloadModname );
+}
+
+
+static void finishFramedDownload( lua_State *L )
+{
+    uint32_t size;
+    uint32_t crc;
+    frameReceiverEnd( &size, &crc );
+
+    if( ( frameReceiverFlags() & FRAME_FLAG_LZSS ) && lzssEnd() == false )
+    {
+        shellPrint( "Download failed: compressed data ended early\n" );
+        discardDownload( L );
+        return;
+    }
+
+    if( ( frameReceiverFlags() & FRAME_FLAG_DELTA ) && deltaEnd() == false )
+    {
+        shellPrint( "Download failed: sync data ended early\n" );
+        discardDownload( L );
+        return;
+    }
+
+    // Done with the old file (if syncing), so it can be replaced.
+    deltaClose();
+
+    if( size != downloadSize || crc != downloadCrc )
+    {
+        shellPrint( "Download failed: got %lu bytes, crc %08lx, expected %lu bytes, crc %08lx\n",
+                    (unsigned long)downloadSize, (unsigned long)downloadCrc, (unsigned long)size, (unsigned long)crc );
+        discardDownload( L );
+        return;
+    }
+
+    shellPrint( "Download complete, %lu bytes\n", (unsigned long)size );
+
+    finishDownload( L );
+}
+
+
+static void discardDownload( lua_State *L )
+{
+    deltaClose();
+
+    if( downloadToFile )
+    {
+        downloadFileAbort();
+    }
+    else
+    {
+        luaL_pushresult( &downloadBuf );
         lua_pop( L, 1 );
     }
 }
 
 
+/**
+ * Open the module's file for syncing, and list the signature of each block.
+ */
+static void printSignature()
+{
+    uint32_t size = deltaOpen( downloadModname );
+    uint32_t blocks = deltaBlockCount();
+
+    shellPrint( "Signature of '/%s.lua': %lu bytes, %lu blocks of %d\n", downloadModname,
+                (unsigned long)size, (unsigned long)blocks, DELTA_BLOCK_SIZE );
+
+    for( uint32_t i = 0; i < blocks; i++ )
+    {
+        uint32_t weak = 0;
+        uint32_t strong = 0;
+
+        // (A block that can't be read gets a signature that won't match.)
+        deltaBlockSignature( i, &weak, &strong );
+
+        shellPrint( "%08lx %08lx\n", (unsigned long)weak, (unsigned long)strong );
+    }
+}
+
+
 static void handleShellChar( lua_State *L, char c )
 {
     static char commandBuf[300];
@@ -234,10 +467,10 @@ static void handleShellChar( lua_State *L, char c )
             shellPrint( "\a" );
         }
     }
-    else
+    else if( commandLen < (int)sizeof(commandBuf) - 1 )
     {
         commandBuf[commandLen++] = c;
-        LUA_SERIAL.write( c );  // echo
+        outputWriteWait( &c, 1 );  // echo
     }
 }
 
@@ -249,9 +482,27 @@ static void processCommand( lua_State *L, const char *line )
     if( *p == '*' )
     {
         // Download a module
+        // Module name is on command line.
+        p++;
+
+        // Skip whitespace
+        while( *p == ' ' )
+        {
+            p++;
+        }
+
+        if( ! setModname( p, strlen( p ) ) )
+        {
+            return;
+        }
+
         shellMode = ShellMode::DownloadReady;
 
-        // Module name is on command line.
+        shellPrint( "Waiting for download of '%s'...\n", downloadModname );
+    }
+    else if( *p == '$' )
+    {
+        // Framed download of a module (from tools/lua_send.py)
         p++;
 
         // Skip whitespace
@@ -260,16 +511,40 @@ static void processCommand( lua_State *L, const char *line )
             p++;
         }
 
-        if( strlen(p) > 0 )
+        if( ! setModname( p, strlen( p ) ) )
         {
-            strcpy( downloadModname, p );
+            return;
         }
-        else
+
+        startFramedDownload( L, FRAME_FLAG_LZSS );
+    }
+    else if( *p == '%' )
+    {
+        // Sync a module: list the blocks of the current file, then take a framed
+        // download of the changes (from tools/lua_send.py --sync)
+        p++;
+
+        // Skip whitespace
+        while( *p == ' ' )
         {
-            downloadModname[0] = '\0';
+            p++;
         }
 
-        shellPrint( "Waiting for download of '%s'...\n", downloadModname );
+        if( *p == '\0' )
+        {
+            shellPrint( "A module name is needed\n" );
+            needPrompt = true;
+            return;
+        }
+
+        if( ! setModname( p, strlen( p ) ) )
+        {
+            return;
+        }
+
+        printSignature();
+
+        startFramedDownload( L, FRAME_FLAG_LZSS | FRAME_FLAG_DELTA );
     }
     else if( *p == '@' )
     {
@@ -283,7 +558,10 @@ static void processCommand( lua_State *L, const char *line )
             p++;
         }
 
-        strcpy( downloadModname, p );
+        if( ! setModname( p, strlen( p ) ) )
+        {
+            return;
+        }
 
         shellPrint( "Reloading '%s'\n", downloadModname );
 
@@ -315,19 +593,14 @@ static void processCommand( lua_State *L, const char *line )
 
             // Look for the dot Lua.
             char *pos = strstr( p, ".lua" );
-            if( pos )
+            if( pos && setModname( p, pos - p ) )
             {
                 // Has a Lua file extension
-                int len = pos - p;
-                strncpy( downloadModname, p, len );
-                downloadModname[len] = '\0';
-
-                // Init the chunk buffer
-                luaL_buffinit( L, &downloadBuf );
+                beginDownload( L );
 
                 // Add the first line.
-                luaL_addstring( &downloadBuf, line );
-                luaL_addchar( &downloadBuf, '\n' );
+                addDownload( line, strlen( line ) );
+                addDownload( "\n", 1 );
 
                 lastCharTime = millis();
 
@@ -348,6 +621,26 @@ static void processCommand( lua_State *L, const char *line )
 }
 
 
+/**
+ * Set the module name for a download or reload.
+ *
+ * @return false (after saying so) if the name is too long
+ */
+static bool setModname( const char *name, size_t len )
+{
+    if( len >= sizeof(downloadModname) )
+    {
+        shellPrint( "Module name is too long (at most %d characters)\n", (int)sizeof(downloadModname) - 1 );
+        needPrompt = true;
+        return false;
+    }
+
+    memcpy( downloadModname, name, len );
+    downloadModname[len] = '\0';
+    return true;
+}
+
+
 static void processControl( lua_State *L, const char *cmd )
 {
     switch( cmd[0] )
@@ -365,6 +658,11 @@ static void processControl( lua_State *L, const char *cmd )
                     shellPrint( "Housekeeping loop enabled\n" );
                     break;
 
+                case '1':
+                    loop1Enabled = true;
+                    shellPrint( "Loop1 enabled\n" );
+                    break;
+
                 default:
                     shellPrint( "Invalid command '%s'", cmd );
                     break;
@@ -384,11 +682,91 @@ static void processControl( lua_State *L, const char *cmd )
                     shellPrint( "Housekeeping loop disabled\n" );
                     break;
 
+                case '1':
+                    loop1Enabled = false;
+                    shellPrint( "Loop1 disabled\n" );
+                    break;
+
                 default:
                     shellPrint( "Invalid command '%s'\n", cmd );
                     break;
             }
             break;
+
+        case 'm':
+            if( strcmp( cmd, "mem" ) == 0 )
+            {
+                printMemStats( L );
+            }
+            else
+            {
+                shellPrint( "Invalid command '%s'\n", cmd );
+            }
+            break;
+
+        case 's':
+            if( strcmp( cmd, "stats" ) == 0 )
+            {
+                printLoopStats();
+            }
+            else if( strcmp( cmd, "stats clear" ) == 0 )
+            {
+                resetLoopStats();
+                shellPrint( "Stats cleared\n" );
+            }
+            else
+            {
+                shellPrint( "Invalid command '%s'\n", cmd );
+            }
+            break;
+
+        default:
+            shellPrint( "Invalid command '%s'\n", cmd );
+            break;
+    }
+}
+
+
+/**
+ * Print the run loop timing statistics, in microseconds.
+ */
+static void printLoopStats()
+{
+    shellPrint( "%-13s %8s %7s %7s %7s %7s %7s %7s\n", "phase", "count", "min", "mean", "p50", "p99", "p99.9", "max" );
+
+    for( int i = 0; i < NUM_STATS_PHASES; i++ )
+    {
+        LatencySummary sum;
+        summarizeLatency( (StatsPhase)i, &sum );
+
+        shellPrint( "%-13s %8lu %7lu %7lu %7lu %7lu %7lu %7lu\n", statsPhaseName( (StatsPhase)i ),
+                    (unsigned long)sum.count, (unsigned long)sum.min, (unsigned long)sum.mean,
+                    (unsigned long)sum.p50, (unsigned long)sum.p99, (unsigned long)sum.p999, (unsigned long)sum.max );
+    }
+
+    shellPrint( "exec overruns %lu   housekeeping overruns %lu\n", loopOverruns( EXEC_LOOP ), loopOverruns( HOUSEKEEPING_LOOP ) );
+}
+
+
+/**
+ * Print the core 0 Lua memory statistics.
+ */
+static void printMemStats( lua_State *L )
+{
+    const MemStats *ms = luaMemStats( L );
+
+    shellPrint( "live %lu   peak %lu\n", (unsigned long)ms->live, (unsigned long)ms->peak );
+
+    shellPrint( "allocs" );
+    for( int i = 0; i < POOL_NUM_CLASSES; i++ )
+    {
+        shellPrint( "  <=%d:%lu", (int)poolClassSize( i ), (unsigned long)ms->allocs[i] );
+    }
+    shellPrint( "  large:%lu\n", (unsigned long)ms->allocs[POOL_NUM_CLASSES] );
+
+    for( int i = 0; i < ms->numModules; i++ )
+    {
+        shellPrint( "module %-24s %8lu\n", ms->modules[i].name, (unsigned long)ms->modules[i].bytes );
     }
 }
 
@@ -463,17 +841,21 @@ static boolean messageHasEOF( lua_State *L )
 
 static void executeChunk( lua_State *L )
 {
+    // The stack isn't empty (the platform keeps items at the bottom), so note where
+    // the chunk's results will begin.
+    const int base = lua_gettop( L ) - 1;
+
     int err = lua_pcall( L, 0, LUA_MULTRET, 0 );
 
     if( err == LUA_OK )
     {
-        int rets = lua_gettop( L );
+        int rets = lua_gettop( L ) - base;
         if( rets > 0 )
         {
             // Print the returned results by calling the Lua print() function.
             luaL_checkstack( L, LUA_MINSTACK, "Too many results to print" );
             lua_getglobal( L, "print" );
-            lua_insert( L, 1 );
+            lua_insert( L, base + 1 );
             if( lua_pcall( L, rets, 0, 0 ) != LUA_OK )
             {
                 const char *msg = lua_pushfstring( L, "Error calling 'print' (%s)", lua_tostring( L, -1 ) );
@@ -555,7 +937,7 @@ static void shellPrint( const char *format, ... )
     va_start( args, format );
 
     vsnprintf( buf, sizeof(buf), format, args );
-    LUA_SERIAL.print( buf );
+    outputWriteWait( buf, strlen( buf ) );
 
     va_end( args );
 }
@@ -0,0 +1,224 @@
+// alloc_bench.cpp
+
+//
+// Host benchmark of the pool allocator against the C heap allocator (the one lauxlib gives
+// luaL_newstate()).
+//
+// The same Lua workload is run on a state using each: rounds of small table, string, and
+// closure churn with a random subset kept alive, each followed by growing one large array
+// (which is the allocation that fails on the board once the heap has fragmented). Then a
+// trace of raw allocations, frees, and resizes with Lua's mix of sizes is replayed against
+// each, without Lua's own costs.
+//
+// For the pool, the largest block still free in the arena after each round shows whether
+// the churn has fragmented it, and the fallbacks how often it had to use the C heap.
+//
+//     make -C tests bench LUA_DIR=~/Arduino/libraries/Lua
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.hpp"
+
+#include "lua_pool.h"
+
+
+// As for core 0 (lua_support.cpp), but Lua's objects are about twice the size on a 64 bit
+// host, so the arena is scaled to hold the same workload.
+#define ARENA_SIZE      (96 * 1024 * sizeof(void*) / 4)
+
+#define TRACE_SLOTS     500
+#define TRACE_STEPS     2000000
+
+
+static const char *workload =
+    "local ROUNDS, ALLOCS, KEEP, ARRAY = ...\n"
+    "local keep = {}\n"
+    "for round = 1, ROUNDS do\n"
+    "    for i = 1, ALLOCS do\n"
+    "        local kind = i % 3\n"
+    "        local obj\n"
+    "        if kind == 0 then obj = { i, i + 1 }\n"
+    "        elseif kind == 1 then obj = 's' .. i\n"
+    "        else obj = function() return i end end\n"
+    "        if math.random( ALLOCS // KEEP ) == 1 then keep[math.random( KEEP )] = obj end\n"
+    "    end\n"
+    "    local t = {}\n"
+    "    for i = 1, ARRAY do t[i] = i end\n"
+    "    t = nil\n"
+    "    collectgarbage()\n"
+    "    report( round )\n"
+    "end\n";
+
+
+static LuaPool pool;
+
+
+static double runWorkload( lua_State *L, bool reportPool );
+static int report( lua_State *L );
+static double replayTrace( lua_Alloc alloc, void *ud );
+static void *heapAlloc( void *ud, void *ptr, size_t osize, size_t nsize );
+static void *luaPoolAlloc( void *ud, void *ptr, size_t osize, size_t nsize );
+static double now();
+
+
+
+int main()
+{
+    printf( "Lua workload, C heap:\n" );
+    lua_State *L = lua_newstate( heapAlloc, NULL );
+    const double heapTime = runWorkload( L, false );
+    lua_close( L );
+
+    printf( "Lua workload, pool (%d KB arena):\n", (int)(ARENA_SIZE / 1024) );
+    poolInit( &pool, ARENA_SIZE );
+    L = lua_newstate( luaPoolAlloc, &pool );
+    const double poolTime = runWorkload( L, true );
+    lua_close( L );
+    free( pool.arena );
+
+    printf( "  %.1f ms C heap, %.1f ms pool\n", heapTime * 1000, poolTime * 1000 );
+
+    const double heapTrace = replayTrace( heapAlloc, NULL );
+
+    poolInit( &pool, ARENA_SIZE );
+    const double poolTrace = replayTrace( luaPoolAlloc, &pool );
+
+    printf( "Allocation trace (%d operations):\n", TRACE_STEPS );
+    printf( "  %.1f ns per operation C heap, %.1f ns per operation pool, %lu fallbacks\n",
+        heapTrace * 1e9 / TRACE_STEPS, poolTrace * 1e9 / TRACE_STEPS, (unsigned long)pool.fallbacks );
+    free( pool.arena );
+
+    return 0;
+}
+
+
+static double runWorkload( lua_State *L, bool reportPool )
+{
+    luaL_openlibs( L );
+
+    lua_pushboolean( L, reportPool );
+    lua_pushcclosure( L, report, 1 );
+    lua_setglobal( L, "report" );
+
+    if( luaL_loadstring( L, workload ) != LUA_OK )
+    {
+        printf( "%s\n", lua_tostring( L, -1 ) );
+        exit( 1 );
+    }
+
+    lua_pushinteger( L, 10 );       // Rounds
+    lua_pushinteger( L, 10000 );    // Allocations per round
+    lua_pushinteger( L, 500 );      // Objects kept
+    lua_pushinteger( L, 2048 );     // Array size
+
+    const double start = now();
+    if( lua_pcallk( L, 4, 0, 0, 0, NULL ) != LUA_OK )
+    {
+        printf( "%s\n", lua_tostring( L, -1 ) );
+        exit( 1 );
+    }
+
+    return now() - start;
+}
+
+
+static int report( lua_State *L )
+{
+    const int round = (int)lua_tointeger( L, 1 );
+
+    if( lua_toboolean( L, lua_upvalueindex( 1 ) ) && (round == 1 || round % 5 == 0) )
+    {
+        printf( "  round %2d: live %6lu, arena used %6lu, largest free %6lu, fallbacks %lu\n", round,
+            (unsigned long)lua_gc( L, LUA_GCCOUNT ) * 1024, (unsigned long)pool.arenaUsed, (unsigned long)poolLargestFree( &pool ), (unsigned long)pool.fallbacks );
+    }
+
+    return 0;
+}
+
+
+/**
+ * Allocate, free, and resize blocks at random, mostly small, some table and stack sized.
+ */
+static double replayTrace( lua_Alloc alloc, void *ud )
+{
+    static void *blocks[TRACE_SLOTS];
+    static size_t sizes[TRACE_SLOTS];
+
+    srand( 1 );
+
+    const double start = now();
+
+    for( int step = 0; step < TRACE_STEPS; step++ )
+    {
+        const int i = rand() % TRACE_SLOTS;
+
+        size_t nsize = 0;
+        const int r = rand() % 100;
+        if( r < 25 )
+        {
+            nsize = 0;
+        }
+        else if( r < 90 )
+        {
+            nsize = 8 + rand() % (POOL_MAX_SMALL - 8);
+        }
+        else if( r < 99 )
+        {
+            nsize = POOL_MAX_SMALL + rand() % 1024;
+        }
+        else
+        {
+            nsize = 1024 + rand() % 4096;
+        }
+
+        blocks[i] = alloc( ud, blocks[i], sizes[i], nsize );
+        sizes[i] = nsize;
+    }
+
+    for( int i = 0; i < TRACE_SLOTS; i++ )
+    {
+        alloc( ud, blocks[i], sizes[i], 0 );
+        blocks[i] = NULL;
+        sizes[i] = 0;
+    }
+
+    return now() - start;
+}
+
+
+//==================================================================================
+
+/**
+ * The allocator lauxlib gives luaL_newstate().
+ */
+static void *heapAlloc( void *ud, void *ptr, size_t osize, size_t nsize )
+{
+    (void)ud;
+    (void)osize;
+
+    if( nsize == 0 )
+    {
+        free( ptr );
+        return NULL;
+    }
+
+    return realloc( ptr, nsize );
+}
+
+
+static void *luaPoolAlloc( void *ud, void *ptr, size_t osize, size_t nsize )
+{
+    return poolAlloc( (LuaPool*)ud, ptr, osize, nsize );
+}
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
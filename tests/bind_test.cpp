@@ -0,0 +1,149 @@
+// bind_test.cpp
+
+//
+// Host tests of the method binder (lua_bind.h): arguments, defaults, and results read and
+// pushed as the entry's signature says, for methods declared with other types, overloads,
+// and const.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+
+#include "lua.hpp"
+
+#include "rotable.h"
+#include "lua_bind.h"
+#include "test_support.h"
+
+
+// Unlike the EVN classes in the ways a binding against the declarations would trip on.
+class Widget {
+public:
+    enum class mode { SLOW, FAST };
+
+    void set( uint8_t value ) { last = value; calls = 1; }
+    void set( uint8_t value, bool twice ) { last = twice ? value * 2 : value; calls = 2; }
+
+    void setLabel( const char *label ) { strncpy( text, label, sizeof(text) - 1 ); }
+    void setLabel( int n ) { snprintf( text, sizeof(text), "#%d", n ); }
+
+    void setMode( mode m ) { current = m; }
+    mode getMode() const { return current; }
+
+    double scaled( uint32_t n, double factor = 1.0 ) const { return n * factor; }
+    uint8_t getLast() const { return last; }
+    int getCalls() { return calls; }
+
+    void link( Widget *other ) { linked = other; }
+    bool isLinked() const { return linked != NULL; }
+
+    int last = 0;
+    int calls = 0;
+    char text[16] = "";
+    mode current = mode::SLOW;
+    Widget *linked = NULL;
+};
+
+LUA_CLASS( Widget, CLASS_MOTOR );
+
+
+static const RoEntry methods[] = {
+    RO_METHOD( "set", Widget, set, void( int, bool ), false ),
+    RO_METHOD( "setOne", Widget, set, void( int ) ),
+    RO_METHOD( "setLabel", Widget, setLabel, void( const char* ) ),
+    RO_METHOD( "setLabelNumber", Widget, setLabel, void( int ) ),
+    RO_METHOD( "setMode", Widget, setMode, void( Widget::mode ) ),
+    RO_METHOD( "getMode", Widget, getMode, int() ),
+    RO_METHOD( "scaled", Widget, scaled, float( lua_Number, float ), 2 ),
+    RO_METHOD( "getLast", Widget, getLast, int() ),
+    RO_METHOD( "getCalls", Widget, getCalls, int() ),
+    RO_METHOD( "link", Widget, link, void( Widget* ) ),
+    RO_METHOD( "isLinked", Widget, isLinked, bool() ),
+
+    RO_END
+};
+
+
+static int newWidget( lua_State *L );
+static bool run( lua_State *L, const char *script );
+
+
+
+int main()
+{
+    lua_State *L = luaL_newstate();
+    luaL_openlibs( L );
+
+    luaL_newmetatable( L, "Widget" );
+    lua_newtable( L );
+    for( const RoEntry *e = methods; e->name; e++ )
+    {
+        lua_pushcfunction( L, e->func );
+        lua_setfield( L, -2, e->name );
+    }
+    lua_setfield( L, -2, "__index" );
+    lua_pop( L, 1 );
+
+    lua_register( L, "Widget", newWidget );
+
+    // Overloads, picked by the signature given.
+    CHECK( run( L, "local w = Widget() w:set( 5 ) assert( w:getLast() == 5 and w:getCalls() == 2 )" ) );
+    CHECK( run( L, "local w = Widget() w:set( 5, true ) assert( w:getLast() == 10 )" ) );
+    CHECK( run( L, "local w = Widget() w:setOne( 7 ) assert( w:getLast() == 7 and w:getCalls() == 1 )" ) );
+    CHECK( run( L, "local w = Widget() w:set( 3, 1 ) assert( w:getLast() == 6 )" ) );
+
+    // Enums are passed and returned as integers.
+    CHECK( run( L, "local w = Widget() w:setMode( 1 ) assert( w:getMode() == 1 and math.type( w:getMode() ) == 'integer' )" ) );
+
+    // A double result pushed as a number, and a default for the second argument.
+    CHECK( run( L, "local w = Widget() assert( w:scaled( 3 ) == 6 and math.type( w:scaled( 3 ) ) == 'float' )" ) );
+    CHECK( run( L, "local w = Widget() assert( w:scaled( 3, 0.5 ) == 1.5 )" ) );
+
+    // Objects of a LUA_CLASS class.
+    CHECK( run( L, "local a, b = Widget(), Widget() assert( not a:isLinked() ) a:link( b ) assert( a:isLinked() )" ) );
+
+    // Bad arguments are errors.
+    CHECK( ! run( L, "Widget():setOne( 1.5 )" ) );
+    CHECK( ! run( L, "Widget():setOne( 'x' )" ) );
+    CHECK( ! run( L, "Widget():link( 1 )" ) );
+    CHECK( ! run( L, "Widget():setOne()" ) );
+    CHECK( ! run( L, "local w = Widget() w.setOne( {}, 1 )" ) );
+
+    lua_close( L );
+
+    return testResult( "bind_test" );
+}
+
+
+static int newWidget( lua_State *L )
+{
+    void *p = lua_newuserdatauv( L, sizeof(Widget), 0 );
+    new(p) Widget();
+    luaL_setmetatable( L, "Widget" );
+    return 1;
+}
+
+
+static bool run( lua_State *L, const char *script )
+{
+    if( luaL_dostring( L, script ) != LUA_OK )
+    {
+        lua_pop( L, 1 );
+        return false;
+    }
+
+    return true;
+}
+
+
+//==================================================================================
+
+// The board's checkObject() (lua_tools.cpp) caches the metatables. This only needs to tell
+// a Widget from anything else.
+void *checkObject( lua_State *L, int arg, LuaClassId id )
+{
+    (void)id;
+    return luaL_checkudata( L, arg, "Widget" );
+}
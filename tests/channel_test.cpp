@@ -0,0 +1,306 @@
+// channel_test.cpp
+
+//
+// Host tests of the channel ring and value codec, with the producer and consumer on their own
+// threads (as on the two cores), each with its own Lua state.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#include "lua.hpp"
+
+#include "channel.h"
+#include "test_support.h"
+
+
+#define THREAD_VALUES   200000
+
+
+static void testFullAndEmpty();
+static void testOwnership();
+static void testCodec();
+static void testThreads();
+
+static bool roundTrip( lua_State *L, const char *expr );
+static bool pushValue( Channel *ch, lua_State *L, lua_Integer i );
+static bool popValue( Channel *ch, lua_State *L, lua_Integer *i );
+
+
+
+int main()
+{
+    testFullAndEmpty();
+    testOwnership();
+    testCodec();
+    testThreads();
+
+    return testResult( "channel_test" );
+}
+
+
+static void testFullAndEmpty()
+{
+    lua_State *L = luaL_newstate();
+
+    Channel *ch = openChannel( "ring", 3 );
+    CHECK( ch != NULL );
+    CHECK( ch->capacity() == 4 );
+    CHECK( openChannel( "ring", 0 ) == ch );
+    CHECK( openChannel( "missing", 0 ) == NULL );
+
+    // Empty
+    CHECK( ch->count() == 0 );
+    CHECK( ch->front() == NULL );
+    CHECK( ch->back() == NULL );
+
+    for( int i = 0; i < 4; i++ )
+    {
+        CHECK( pushValue( ch, L, i ) );
+    }
+
+    // Full
+    CHECK( ch->count() == 4 );
+    CHECK( ch->reserve() == NULL );
+
+    // Newest without removing it, then oldest first.
+    lua_Integer v = -1;
+    channelDecode( L, ch->back() );
+    CHECK( lua_tointeger( L, -1 ) == 3 );
+    lua_pop( L, 1 );
+    CHECK( ch->count() == 4 );
+
+    CHECK( popValue( ch, L, &v ) && v == 0 );
+    CHECK( pushValue( ch, L, 4 ) );
+    CHECK( ch->reserve() == NULL );
+
+    for( int i = 1; i <= 4; i++ )
+    {
+        CHECK( popValue( ch, L, &v ) && v == i );
+    }
+
+    CHECK( ch->count() == 0 );
+    CHECK( ch->front() == NULL );
+    CHECK( ! popValue( ch, L, &v ) );
+
+    lua_close( L );
+}
+
+
+static void testOwnership()
+{
+    Channel *ch = openChannel( "owners", 4 );
+    CHECK( ch != NULL );
+
+    CHECK( ch->claimProducer( 1 ) );
+    CHECK( ch->claimProducer( 1 ) );
+    CHECK( ! ch->claimProducer( 0 ) );
+
+    CHECK( ch->claimConsumer( 0 ) );
+    CHECK( ! ch->claimConsumer( 1 ) );
+    CHECK( ch->claimConsumer( 0 ) );
+
+    // Both sides on one core is fine.
+    Channel *local = openChannel( "local", 4 );
+    CHECK( local->claimProducer( 0 ) );
+    CHECK( local->claimConsumer( 0 ) );
+}
+
+
+static void testCodec()
+{
+    lua_State *L = luaL_newstate();
+    luaL_openlibs( L );
+
+    CHECK( roundTrip( L, "true" ) );
+    CHECK( roundTrip( L, "false" ) );
+    CHECK( roundTrip( L, "0" ) );
+    CHECK( roundTrip( L, "-1" ) );
+    CHECK( roundTrip( L, "123456789" ) );
+    CHECK( roundTrip( L, "math.maxinteger" ) );
+    CHECK( roundTrip( L, "math.mininteger" ) );
+    CHECK( roundTrip( L, "1.5" ) );
+    CHECK( roundTrip( L, "-0.25" ) );
+    CHECK( roundTrip( L, "1e300" ) );
+    CHECK( roundTrip( L, "''" ) );
+    CHECK( roundTrip( L, "'hello'" ) );
+    CHECK( roundTrip( L, "'nul\\0in the middle'" ) );
+    CHECK( roundTrip( L, "{}" ) );
+    CHECK( roundTrip( L, "{ 1, 2.5, 'three', true }" ) );
+    CHECK( roundTrip( L, "{ yaw = 1.25, pitch = -3, name = 'imu', [7] = false }" ) );
+
+    // Values that can't be sent
+    ChannelSlot slot;
+    const char *bad[] = {
+        "nil",
+        "print",
+        "{ { 1 } }",
+        "{ f = print }",
+        "string.rep( 'x', 200 )",
+        "{ string.rep( 'x', 50 ), string.rep( 'y', 50 ) }",
+    };
+    for( size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++ )
+    {
+        char chunk[128];
+        snprintf( chunk, sizeof(chunk), "return %s", bad[i] );
+        CHECK( luaL_dostring( L, chunk ) == LUA_OK );
+
+        const int top = lua_gettop( L );
+        if( channelEncode( L, -1, &slot ) == NULL )
+        {
+            printf( "  encoded: %s\n", bad[i] );
+            CHECK( false );
+        }
+        CHECK( lua_gettop( L ) == top );
+        lua_settop( L, 0 );
+    }
+
+    lua_close( L );
+}
+
+
+//
+// A producer thread pushes a counting sequence as fast as it can, and a consumer thread pops
+// and checks it, both spinning when the channel is full or empty. (They yield when spinning,
+// so the test doesn't crawl on a single CPU.)
+//
+static void testThreads()
+{
+    Channel *ch = openChannel( "threads", 8 );
+    CHECK( ch != NULL );
+
+    int outOfOrder = 0;
+    unsigned long fullSpins = 0;
+    unsigned long emptySpins = 0;
+
+    std::thread producer( [&]() {
+        lua_State *L = luaL_newstate();
+        for( lua_Integer i = 0; i < THREAD_VALUES; i++ )
+        {
+            while( ! pushValue( ch, L, i ) )
+            {
+                fullSpins++;
+                std::this_thread::yield();
+            }
+        }
+        lua_close( L );
+    } );
+
+    std::thread consumer( [&]() {
+        lua_State *L = luaL_newstate();
+        for( lua_Integer i = 0; i < THREAD_VALUES; i++ )
+        {
+            lua_Integer v;
+            while( ! popValue( ch, L, &v ) )
+            {
+                emptySpins++;
+                std::this_thread::yield();
+            }
+
+            if( v != i )
+            {
+                outOfOrder++;
+            }
+        }
+        lua_close( L );
+    } );
+
+    producer.join();
+    consumer.join();
+
+    printf( "  %d values passed between threads (%lu full, %lu empty spins)\n",
+            THREAD_VALUES, fullSpins, emptySpins );
+
+    CHECK( outOfOrder == 0 );
+    CHECK( ch->count() == 0 );
+}
+
+
+//==================================================================================
+
+/**
+ * Encode the value of a Lua expression into a slot, decode it, and compare it with the original.
+ */
+static bool roundTrip( lua_State *L, const char *expr )
+{
+    char chunk[1024];
+    snprintf( chunk, sizeof(chunk),
+              "local v = %s\n"
+              "return v, function( a, b )\n"
+              "    if math.type( a ) ~= math.type( b ) then return false end\n"
+              "    if type( a ) ~= 'table' then return a == b end\n"
+              "    for k, x in pairs( a ) do if b[k] ~= x or math.type( b[k] ) ~= math.type( x ) then return false end end\n"
+              "    for k in pairs( b ) do if a[k] == nil then return false end end\n"
+              "    return type( b ) == 'table'\n"
+              "end\n", expr );
+
+    if( luaL_dostring( L, chunk ) != LUA_OK )
+    {
+        printf( "  %s: %s\n", expr, lua_tostring( L, -1 ) );
+        lua_settop( L, 0 );
+        return false;
+    }
+
+    // value, compare
+    ChannelSlot slot;
+    const char *err = channelEncode( L, 1, &slot );
+    if( err != NULL )
+    {
+        printf( "  %s: %s\n", expr, err );
+        lua_settop( L, 0 );
+        return false;
+    }
+
+    lua_pushvalue( L, 2 );
+    lua_pushvalue( L, 1 );
+    channelDecode( L, &slot );
+    lua_call( L, 2, 1 );
+
+    bool same = lua_toboolean( L, -1 );
+    if( ! same )
+    {
+        printf( "  %s: changed by the round trip\n", expr );
+    }
+
+    lua_settop( L, 0 );
+    return same;
+}
+
+
+static bool pushValue( Channel *ch, lua_State *L, lua_Integer i )
+{
+    ChannelSlot *slot = ch->reserve();
+    if( slot == NULL )
+    {
+        return false;
+    }
+
+    lua_pushinteger( L, i );
+    const char *err = channelEncode( L, -1, slot );
+    lua_pop( L, 1 );
+    if( err != NULL )
+    {
+        return false;
+    }
+
+    ch->commit();
+    return true;
+}
+
+
+static bool popValue( Channel *ch, lua_State *L, lua_Integer *i )
+{
+    const ChannelSlot *slot = ch->front();
+    if( slot == NULL )
+    {
+        return false;
+    }
+
+    channelDecode( L, slot );
+    *i = lua_tointeger( L, -1 );
+    lua_pop( L, 1 );
+
+    ch->release();
+    return true;
+}
@@ -0,0 +1,319 @@
+// pool_test.cpp
+
+//
+// Host tests of the pool allocator: random churn checked against the block contents and the
+// heap's own consistency check, pages going back to the arena, and a Lua state run on it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.hpp"
+
+#include "lua_pool.h"
+#include "test_support.h"
+
+
+#define ARENA_SIZE      (48 * 1024)
+
+#define CHURN_SLOTS     400
+#define CHURN_STEPS     200000
+
+
+static void testChurn();
+static void testPagesReturned();
+static void testLargeBlocks();
+static void testLuaState();
+
+static void *luaPoolAlloc( void *ud, void *ptr, size_t osize, size_t nsize );
+static size_t randomSize();
+static void fill( uint8_t *p, size_t size, uint8_t seed );
+static bool filled( const uint8_t *p, size_t size, uint8_t seed );
+
+
+
+int main()
+{
+    testChurn();
+    testPagesReturned();
+    testLargeBlocks();
+    testLuaState();
+
+    return testResult( "pool_test" );
+}
+
+
+/**
+ * Random allocations, frees, and resizes, each block filled with a pattern that must
+ * survive being moved.
+ */
+static void testChurn()
+{
+    static LuaPool pool;
+    poolInit( &pool, ARENA_SIZE );
+
+    struct Slot {
+        uint8_t *p;
+        size_t size;
+        uint8_t seed;
+    } slots[CHURN_SLOTS] = {};
+
+    srand( 1 );
+
+    bool intact = true;
+    bool consistent = true;
+
+    for( int step = 0; step < CHURN_STEPS; step++ )
+    {
+        Slot *s = &slots[rand() % CHURN_SLOTS];
+
+        if( s->p && ! filled( s->p, s->size, s->seed ) )
+        {
+            intact = false;
+        }
+
+        const size_t nsize = (rand() % 4 == 0) ? 0 : randomSize();
+        uint8_t *p = (uint8_t*)poolAlloc( &pool, s->p, s->p ? s->size : 0, nsize );
+
+        if( nsize == 0 )
+        {
+            s->p = NULL;
+            s->size = 0;
+            continue;
+        }
+
+        CHECK( p != NULL );
+
+        if( p && s->p && ! filled( p, (s->size < nsize) ? s->size : nsize, s->seed ) )
+        {
+            intact = false;
+        }
+
+        s->p = p;
+        s->size = nsize;
+        s->seed = (uint8_t)step;
+        fill( s->p, s->size, s->seed );
+
+        if( step % 1000 == 0 && ! poolCheck( &pool ) )
+        {
+            consistent = false;
+        }
+    }
+
+    CHECK( intact );
+    CHECK( consistent );
+
+    // Some had to come from the C heap, but most from the arena.
+    CHECK( pool.fallbacks < CHURN_STEPS / 10 );
+
+    for( int i = 0; i < CHURN_SLOTS; i++ )
+    {
+        poolAlloc( &pool, slots[i].p, slots[i].size, 0 );
+    }
+
+    CHECK( poolCheck( &pool ) );
+    CHECK( pool.heapBlocks == 0 );
+    CHECK( pool.largeBlocks == 0 );
+
+    // Only the one page kept for each class is left.
+    for( int i = 0; i < POOL_NUM_CLASSES; i++ )
+    {
+        CHECK( pool.classes[i].inUse == 0 );
+        CHECK( pool.classes[i].pages <= 1 );
+    }
+    CHECK( pool.arenaUsed <= POOL_NUM_CLASSES * POOL_PAGE_SIZE );
+
+    free( pool.arena );
+}
+
+
+/**
+ * A burst of one size mustn't keep the arena from the others once it's freed.
+ */
+static void testPagesReturned()
+{
+    static LuaPool pool;
+    poolInit( &pool, ARENA_SIZE );
+
+    const size_t wholeArena = poolLargestFree( &pool );
+
+    static void *blocks[ARENA_SIZE / 16];
+    int n = 0;
+    while( n < (int)(sizeof(blocks) / sizeof(blocks[0])) )
+    {
+        blocks[n] = poolAlloc( &pool, NULL, 0, 16 );
+        if( pool.fallbacks > 0 )
+        {
+            // The arena is full of 16 byte pages.
+            break;
+        }
+        n++;
+    }
+
+    CHECK( pool.classes[0].pages > 40 );
+    CHECK( poolLargestFree( &pool ) < 1024 );
+    CHECK( poolCheck( &pool ) );
+
+    poolAlloc( &pool, blocks[n], 16, 0 );
+    for( int i = 0; i < n; i++ )
+    {
+        poolAlloc( &pool, blocks[i], 16, 0 );
+    }
+
+    CHECK( poolCheck( &pool ) );
+    CHECK( pool.classes[0].pages == 1 );
+
+    // Another size can now have the arena, less the one page kept.
+    CHECK( poolLargestFree( &pool ) >= wholeArena - 2 * POOL_PAGE_SIZE );
+
+    void *big = poolAlloc( &pool, NULL, 0, ARENA_SIZE / 2 );
+    CHECK( big != NULL && pool.heapBlocks == 1 );
+    poolAlloc( &pool, big, ARENA_SIZE / 2, 0 );
+
+    free( pool.arena );
+}
+
+
+/**
+ * Large blocks grow in place when they can, and freed neighbours are joined.
+ */
+static void testLargeBlocks()
+{
+    static LuaPool pool;
+    poolInit( &pool, ARENA_SIZE );
+
+    uint8_t *a = (uint8_t*)poolAlloc( &pool, NULL, 0, 1000 );
+    uint8_t *b = (uint8_t*)poolAlloc( &pool, NULL, 0, 1000 );
+    uint8_t *c = (uint8_t*)poolAlloc( &pool, NULL, 0, 1000 );
+    CHECK( a && b && c );
+    CHECK( a < b && b < c );
+    CHECK( pool.heapBlocks == 3 );
+
+    // The space after c is free, so c grows where it is.
+    fill( c, 1000, 3 );
+    CHECK( poolAlloc( &pool, c, 1000, 4000 ) == c );
+    CHECK( filled( c, 1000, 3 ) );
+
+    // b is hemmed in, so it moves...
+    uint8_t *moved = (uint8_t*)poolAlloc( &pool, b, 1000, 1200 );
+    CHECK( moved != NULL && moved != b );
+
+    // ...and where it was is joined to a when that's freed.
+    poolAlloc( &pool, a, 1000, 0 );
+    CHECK( poolCheck( &pool ) );
+    CHECK( poolAlloc( &pool, NULL, 0, 1500 ) == a );
+
+    // Shrinking gives back the end.
+    const size_t used = pool.arenaUsed;
+    CHECK( poolAlloc( &pool, c, 4000, 2000 ) == c );
+    CHECK( pool.arenaUsed < used );
+    CHECK( poolCheck( &pool ) );
+
+    // Shrinking to a small size moves it into a page.
+    uint8_t *s = (uint8_t*)poolAlloc( &pool, c, 2000, 100 );
+    CHECK( s != c && filled( s, 100, 3 ) );
+    CHECK( pool.classes[poolSizeClass( 100 )].inUse == 1 );
+
+    // Too big for the arena.
+    uint8_t *huge = (uint8_t*)poolAlloc( &pool, NULL, 0, ARENA_SIZE * 2 );
+    CHECK( huge != NULL && pool.largeBlocks == 1 && pool.fallbacks == 1 );
+    poolAlloc( &pool, huge, ARENA_SIZE * 2, 0 );
+    CHECK( pool.largeBlocks == 0 );
+
+    CHECK( poolCheck( &pool ) );
+
+    free( pool.arena );
+}
+
+
+static void testLuaState()
+{
+    static LuaPool pool;
+    poolInit( &pool, ARENA_SIZE );
+
+    lua_State *L = lua_newstate( luaPoolAlloc, &pool );
+    CHECK( L != NULL );
+    luaL_openlibs( L );
+
+    const char *script =
+        "local keep = {}\n"
+        "for i = 1, 20000 do\n"
+        "    local t = { i, tostring( i ), function() return i end }\n"
+        "    keep[i % 300 + 1] = t\n"
+        "end\n"
+        "local big = {}\n"
+        "for i = 1, 5000 do big[i] = i end\n"
+        "local s = 0\n"
+        "for i = 1, #big do s = s + big[i] end\n"
+        "assert( s == 5000 * 5001 // 2 )\n"
+        "assert( keep[1][2] == tostring( keep[1][1] ) )\n";
+
+    const int status = luaL_dostring( L, script );
+    if( status != LUA_OK )
+    {
+        printf( "%s\n", lua_tostring( L, -1 ) );
+    }
+    CHECK( status == LUA_OK );
+
+    lua_gc( L, LUA_GCCOLLECT );
+    CHECK( poolCheck( &pool ) );
+
+    lua_close( L );
+
+    CHECK( poolCheck( &pool ) );
+    CHECK( pool.heapBlocks == 0 && pool.largeBlocks == 0 );
+
+    free( pool.arena );
+}
+
+
+//==================================================================================
+
+static void *luaPoolAlloc( void *ud, void *ptr, size_t osize, size_t nsize )
+{
+    return poolAlloc( (LuaPool*)ud, ptr, osize, nsize );
+}
+
+
+/**
+ * Mostly small sizes, as Lua's are, with some table and stack sized blocks.
+ */
+static size_t randomSize()
+{
+    const int r = rand() % 100;
+
+    if( r < 80 )
+    {
+        return 1 + rand() % POOL_MAX_SMALL;
+    }
+    else if( r < 97 )
+    {
+        return POOL_MAX_SMALL + 1 + rand() % 1024;
+    }
+
+    return 1024 + rand() % 8192;
+}
+
+
+static void fill( uint8_t *p, size_t size, uint8_t seed )
+{
+    for( size_t i = 0; i < size; i++ )
+    {
+        p[i] = (uint8_t)(seed + i);
+    }
+}
+
+
+static bool filled( const uint8_t *p, size_t size, uint8_t seed )
+{
+    for( size_t i = 0; i < size; i++ )
+    {
+        if( p[i] != (uint8_t)(seed + i) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+// test_support.cpp
+
+#include <stdio.h>
+
+#include "test_support.h"
+
+
+int testFailures = 0;
+
+
+int testResult( const char *name )
+{
+    if( testFailures > 0 )
+    {
+        printf( "%s: %d check(s) FAILED\n", name, testFailures );
+        return 1;
+    }
+
+    printf( "%s: passed\n", name );
+    return 0;
+}
+
+
+// The board's luaconf.h sends Lua's output through these (see lua_support.cpp).
+extern "C" void dtm_writestring( const char *p, int len )
+{
+    fwrite( p, 1, len, stdout );
+}
+
+
+extern "C" void dtm_writestringerror( const char *s, const char *p )
+{
+    fprintf( stderr, s, p );
+}
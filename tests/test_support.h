@@ -0,0 +1,28 @@
+// test_support.h
+
+//
+// A minimal check macro and failure count for the host tests.
+//
+
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H  1
+
+#include <stdio.h>
+
+
+extern int testFailures;
+
+#define CHECK( cond )                                                               \
+    do {                                                                            \
+        if( ! (cond) )                                                              \
+        {                                                                           \
+            printf( "FAILED: %s:%d: %s\n", __FILE__, __LINE__, #cond );             \
+            testFailures++;                                                         \
+        }                                                                           \
+    } while( 0 )
+
+
+// Prints the result, and returns the exit code for main().
+int testResult( const char *name );
+
+#endif
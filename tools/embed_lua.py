@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+
+#
+# Compile Lua scripts to bytecode and embed them in the firmware.
+#
+# Writes src/embedded_modules.cpp, with each script as a const array (which goes in flash).
+# Modules are named after their files, so 'helpers.lua' is require("helpers").
+#
+# The bytecode must match the firmware's Lua build, so luac has to be Lua 5.4 built with
+# the same luaconf.h settings (integer and float sizes) as the Lua library on the board.
+# If it isn't, the module will fail to load with a "bad binary format" error.
+#
+# Usage:
+#     tools/embed_lua.py [--luac PATH] [--strip] [-o FILE] script.lua ...
+#
+# Run with no scripts to go back to having no embedded modules.
+#
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+
+HEADER = """// embedded_modules.cpp
+
+//
+// Generated by tools/embed_lua.py. Do not edit.
+//
+// luac: {luac}
+// Instruction={inst}  lua_Integer={int}  lua_Number={num}  stripped={strip}
+//
+
+#include "embedded_modules.h"
+
+"""
+
+
+def compile_script(luac, path, strip):
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "out.luac")
+        cmd = [luac, "-o", out]
+        if strip:
+            cmd.append("-s")
+        cmd.append(path)
+        subprocess.run(cmd, check=True)
+        with open(out, "rb") as f:
+            return f.read()
+
+
+def bytecode_sizes(code):
+    # Lua 5.4 header: signature(4), version, format, LUAC_DATA(6), then the sizes.
+    if code[0:4] != b"\x1bLua" or code[4] != 0x54:
+        sys.exit("embed_lua: luac is not Lua 5.4")
+    return code[12], code[13], code[14]
+
+
+def c_array(name, code):
+    lines = ["static const unsigned char %s[%d] = {" % (name, len(code))]
+    for i in range(0, len(code), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in code[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Embed compiled Lua modules in the firmware")
+    parser.add_argument("--luac", default="luac", help="Lua 5.4 compiler to use")
+    parser.add_argument("--strip", action="store_true", help="leave out debug info (no line numbers in errors)")
+    parser.add_argument("-o", "--output", default=os.path.join(os.path.dirname(__file__), "..", "src", "embedded_modules.cpp"))
+    parser.add_argument("scripts", nargs="*")
+    args = parser.parse_args()
+
+    sizes = ("?", "?", "?")
+    arrays = ""
+    entries = ""
+
+    for i, path in enumerate(args.scripts):
+        name = os.path.splitext(os.path.basename(path))[0]
+        code = compile_script(args.luac, path, args.strip)
+        sizes = bytecode_sizes(code)
+        var = "module%d" % i
+        arrays += "// %s\n" % name
+        arrays += c_array(var, code)
+        entries += '    {{ "{0}", {1}, sizeof({1}) }},\n'.format(name, var)
+        print("%-24s %6d bytes" % (name, len(code)))
+
+    with open(args.output, "w") as f:
+        f.write(HEADER.format(luac=args.luac, inst=sizes[0], int=sizes[1], num=sizes[2], strip=args.strip))
+        f.write(arrays)
+        f.write("\nconst EmbeddedModule embeddedModules[] = {\n")
+        f.write(entries)
+        f.write("    { NULL, NULL, 0 }\n};\n")
+
+
+if __name__ == "__main__":
+    main()
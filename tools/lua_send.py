@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+
+#
+# Send a Lua module to the board with the shell's framed download ('$' command).
+#
+# The file is sent in frames with a sequence number and CRC-32, with several frames in flight
+# at once. Damaged frames are sent again, so it is safe over a noisy link, and it runs at
+# close to the full speed of the link, with no pacing or end of file timeout.
+#
+# Needs pyserial (pip install pyserial).
+#
+# Usage:
+#     tools/lua_send.py --port /dev/ttyACM0 [--baud 115200] [--name module] [--window 8] script.lua
+#
+# The module name defaults to the name of the file. Use --anonymous to run the script without
+# saving it (the same as the '*' command).
+#
+# With --compress the file is sent LZSS compressed (see lzss.py), which roughly halves the
+# time for a typical script. The board decompresses it as it arrives.
+#
+# With --sync only the changes are sent. The board lists a signature (checksums) for each block
+# of its copy of the module, and blocks found unchanged in the new file are sent as an
+# instruction to copy them from the old one (as rsync does). The board builds the new file in
+# a temp file and swaps it in. (--compress works with this too.)
+#
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+import lzss
+
+
+FRAME_SYNC = 0xA5
+FRAME_ACK = 0x06
+FRAME_NAK = 0x15
+FRAME_CAN = 0x18
+
+FRAME_BEGIN = ord("B")
+FRAME_DATA = ord("D")
+FRAME_END = ord("E")
+
+FRAME_MAX_PAYLOAD = 256
+
+FRAME_FLAG_LZSS = 0x01
+FRAME_FLAG_DELTA = 0x02
+
+DELTA_COPY = ord("C")
+DELTA_LITERAL = ord("L")
+
+
+def make_frame(ftype, seq, payload):
+    body = bytes([ftype, seq & 0xFF]) + struct.pack("<H", len(payload)) + payload
+    return bytes([FRAME_SYNC]) + body + struct.pack("<I", zlib.crc32(body))
+
+
+def make_frames(data, payload, flags=0):
+    """
+    The frames for a download. 'payload' is what goes in the DATA frames, and 'data' is what
+    the board ends up with (they differ if the payload is encoded).
+    """
+    frames = [make_frame(FRAME_BEGIN, 0, struct.pack("<BI", flags, len(data)))]
+    for i in range(0, len(payload), FRAME_MAX_PAYLOAD):
+        frames.append(make_frame(FRAME_DATA, len(frames), payload[i:i + FRAME_MAX_PAYLOAD]))
+    frames.append(make_frame(FRAME_END, len(frames), struct.pack("<II", len(data), zlib.crc32(data))))
+    return frames
+
+
+class Link:
+    """
+    The serial port, separating the board's replies to frames from its text output.
+    """
+
+    def __init__(self, port, echo=True):
+        self.port = port
+        self.echo = echo
+        self.seen = b""
+
+    def text(self, b):
+        self.seen = self.seen[-64:] + b
+        if self.echo and b:
+            sys.stdout.write(b.decode("utf-8", "replace"))
+            sys.stdout.flush()
+
+    def wait_for(self, marker, timeout):
+        """Wait for the board to print the marker text."""
+        got = b""
+        deadline = time.monotonic() + timeout
+        while marker not in got:
+            if time.monotonic() > deadline:
+                return False
+            b = self.port.read(1)
+            got += b
+            self.text(b)
+        return True
+
+    def read_line(self, timeout):
+        """The next line the board prints, or None."""
+        line = b""
+        deadline = time.monotonic() + timeout
+        while not line.endswith(b"\n"):
+            if time.monotonic() > deadline:
+                return None
+            b = self.port.read(1)
+            line += b
+        return line.decode("utf-8", "replace").strip()
+
+    def reply(self, timeout):
+        """The next (code, seq) reply, or None if there wasn't one in time."""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            b = self.port.read(1)
+            if not b:
+                continue
+            if b[0] in (FRAME_ACK, FRAME_NAK, FRAME_CAN):
+                # code, seq, ~seq
+                seq = self.port.read(1)
+                check = self.port.read(1)
+                if seq and check and seq[0] ^ check[0] == 0xFF:
+                    return b[0], seq[0]
+            else:
+                self.text(b)
+        return None
+
+
+def weak_sum(block):
+    """The rolling checksum, as the board's deltaWeakSum()."""
+    n = len(block)
+    a = sum(block)
+    b = sum((n - i) * x for i, x in enumerate(block))
+    return (a & 0xFFFF) | ((b & 0xFFFF) << 16)
+
+
+def make_delta(data, signatures, block_size):
+    """
+    Instructions to build data from the old file, given the (weak, strong) signature of each of
+    its blocks.
+    """
+    table = {}
+    for index, (weak, strong) in enumerate(signatures):
+        table.setdefault(weak, []).append((index, strong))
+
+    out = bytearray()
+    copy = None         # (first block, count) of a copy not yet written
+
+    def flush_copy():
+        nonlocal copy
+        if copy:
+            out.extend(struct.pack("<BHH", DELTA_COPY, copy[0], copy[1]))
+            copy = None
+
+    def literal(chunk):
+        if chunk:
+            flush_copy()
+            for k in range(0, len(chunk), 0xFFFF):
+                piece = chunk[k:k + 0xFFFF]
+                out.extend(struct.pack("<BH", DELTA_LITERAL, len(piece)))
+                out.extend(piece)
+
+    n = len(data)
+    i = 0
+    literal_start = 0
+    a = b = 0
+    if table and n >= block_size:
+        a = sum(data[0:block_size])
+        b = sum((block_size - k) * x for k, x in enumerate(data[0:block_size]))
+
+    while table and i + block_size <= n:
+        match = None
+        candidates = table.get((a & 0xFFFF) | ((b & 0xFFFF) << 16))
+        if candidates:
+            strong = zlib.crc32(data[i:i + block_size])
+            for index, s in candidates:
+                if s == strong:
+                    match = index
+                    break
+
+        if match is not None:
+            literal(data[literal_start:i])
+            if copy and copy[0] + copy[1] == match and copy[1] < 0xFFFF:
+                copy = (copy[0], copy[1] + 1)
+            else:
+                flush_copy()
+                copy = (match, 1)
+
+            i += block_size
+            literal_start = i
+            if i + block_size <= n:
+                a = sum(data[i:i + block_size])
+                b = sum((block_size - k) * x for k, x in enumerate(data[i:i + block_size]))
+        else:
+            # Roll the checksum on by one byte.
+            if i + block_size < n:
+                a += data[i + block_size] - data[i]
+                b += a - block_size * data[i]
+            i += 1
+
+    literal(data[literal_start:])
+    flush_copy()
+    return bytes(out)
+
+
+def read_signature(link):
+    """Read the block signatures the board lists for the '%' command."""
+    header = None
+    while header is None:
+        line = link.read_line(3.0)
+        if line is None:
+            return None
+        if line.startswith("Signature of"):
+            header = line
+        else:
+            link.text((line + "\n").encode())
+
+    # "Signature of '/name.lua': <size> bytes, <n> blocks of <block size>"
+    words = header.split(":")[-1].split()
+    count = int(words[2])
+    block_size = int(words[5])
+
+    signatures = []
+    for _ in range(count):
+        line = link.read_line(3.0)
+        if line is None:
+            return None
+        weak, strong = line.split()
+        signatures.append((int(weak, 16), int(strong, 16)))
+
+    return signatures, block_size
+
+
+def send_frames(link, frames, window, timeout=1.0, retries=10):
+    """
+    Go-back-N: keep up to 'window' frames in flight, and on a NAK or timeout go back to the
+    oldest one not yet acknowledged.
+    Returns the number of frames that were sent again.
+    """
+    base = 0
+    nxt = 0
+    resent = 0
+    tries = 0
+
+    while base < len(frames):
+        while nxt < len(frames) and nxt < base + window:
+            link.port.write(frames[nxt])
+            nxt += 1
+
+        r = link.reply(timeout)
+        if r is None:
+            if base == len(frames) - 1 and b"Download" in link.seen:
+                # Only the END frame's ACK was lost, the board has finished. (Sending the
+                # frame again would have it land in the shell.)
+                break
+            tries += 1
+            if tries > retries:
+                raise RuntimeError("no reply from the board")
+            resent += nxt - base
+            nxt = base
+            continue
+
+        code, seq = r
+        # Sequence numbers are 8 bits, so find the frame it means, counting from base.
+        index = base + ((seq - base) & 0xFF)
+
+        if code == FRAME_CAN:
+            raise RuntimeError("the board cancelled the download")
+        elif code == FRAME_ACK:
+            if index < nxt:
+                base = index + 1
+                tries = 0
+        elif code == FRAME_NAK:
+            if index <= nxt:
+                resent += nxt - index
+                base = index
+                nxt = index
+
+    return resent
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Send a Lua module to the board")
+    parser.add_argument("--port", required=True, help="serial port of the board")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--name", help="module name on the board (default: the file name)")
+    parser.add_argument("--anonymous", action="store_true", help="run the script without saving it")
+    parser.add_argument("--window", type=int, default=8, help="frames in flight (1-127)")
+    parser.add_argument("--compress", action="store_true", help="send the file LZSS compressed")
+    parser.add_argument("--sync", action="store_true", help="send only the changes from the board's copy")
+    parser.add_argument("script")
+    args = parser.parse_args()
+
+    import serial
+
+    with open(args.script, "rb") as f:
+        data = f.read()
+
+    name = "" if args.anonymous else (args.name or os.path.splitext(os.path.basename(args.script))[0])
+    if args.sync and not name:
+        sys.exit("lua_send: --sync needs a module name")
+
+    port = serial.Serial(args.port, args.baud, timeout=0.05)
+    link = Link(port)
+
+    flags = 0
+    payload = data
+    if args.sync:
+        port.write(("%%%s\r" % name).encode())
+        sig = read_signature(link)
+        if sig is None:
+            sys.exit("lua_send: the board did not send the file's signature")
+        payload = make_delta(data, *sig)
+        flags |= FRAME_FLAG_DELTA
+    else:
+        port.write(("$%s\r" % name).encode())
+
+    if args.compress:
+        payload = lzss.compress(payload)
+        flags |= FRAME_FLAG_LZSS
+
+    frames = make_frames(data, payload, flags)
+
+    if not link.wait_for(b"Waiting for framed download", 3.0):
+        sys.exit("lua_send: the board did not start the download")
+
+    start = time.monotonic()
+    try:
+        resent = send_frames(link, frames, max(1, min(args.window, 127)))
+    except RuntimeError as e:
+        link.wait_for(b">", 1.0)
+        sys.exit("\nlua_send: %s" % e)
+    elapsed = time.monotonic() - start
+
+    # Show what the board has to say about it (up to the next prompt).
+    link.wait_for(b">", 5.0)
+
+    sys.stderr.write("\n%d bytes (%d sent) in %.2f s (%.0f bytes/s), %d frames, %d resent\n"
+                     % (len(data), len(payload), elapsed, len(data) / elapsed if elapsed else 0, len(frames), resent))
+
+
+if __name__ == "__main__":
+    main()
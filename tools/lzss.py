@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+
+#
+# LZSS compressor for compressed downloads, matching the decoder in src/lzss.cpp.
+#
+# Used by lua_send.py --compress. It can also be run on its own to see how well files compress:
+#
+#     tools/lzss.py [-o FILE] script.lua ...
+#     tools/lzss.py -d -o FILE script.lzss
+#
+# Format: a flag byte, then up to 8 items, then another flag byte, and so on. Flag bit i (lowest
+# first) is 1 for a literal byte and 0 for a match, which is two bytes:
+#
+#     (distance - 1) & 0xFF,   ((distance - 1) >> 8) << 5 | (length - 3)
+#
+# for a copy of 3-34 bytes from 1-2048 bytes back.
+#
+
+import argparse
+import sys
+
+
+WINDOW_BITS = 11
+LENGTH_BITS = 5
+
+WINDOW_SIZE = 1 << WINDOW_BITS
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + (1 << LENGTH_BITS) - 1
+
+# How many earlier places to try for each match (more is slower, and a little smaller).
+MAX_CHAIN = 64
+
+
+def compress(data):
+    out = bytearray()
+    positions = {}      # 3 byte string -> places it was seen
+    flag_pos = 0
+    bit = 8
+    i = 0
+    n = len(data)
+
+    while i < n:
+        if bit == 8:
+            flag_pos = len(out)
+            out.append(0)
+            bit = 0
+
+        best_len = 0
+        best_dist = 0
+        if i + MIN_MATCH <= n:
+            for p in reversed(positions.get(data[i:i + MIN_MATCH], [])[-MAX_CHAIN:]):
+                if i - p > WINDOW_SIZE:
+                    break
+                length = MIN_MATCH
+                while length < MAX_MATCH and i + length < n and data[p + length] == data[i + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_dist = i - p
+                    if length == MAX_MATCH:
+                        break
+
+        if best_len >= MIN_MATCH:
+            d = best_dist - 1
+            out.append(d & 0xFF)
+            out.append(((d >> 8) << LENGTH_BITS) | (best_len - MIN_MATCH))
+            step = best_len
+        else:
+            out[flag_pos] |= 1 << bit
+            out.append(data[i])
+            step = 1
+
+        for k in range(i, i + step):
+            positions.setdefault(data[k:k + MIN_MATCH], []).append(k)
+
+        i += step
+        bit += 1
+
+    return bytes(out)
+
+
+def decompress(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        flags = data[i]
+        i += 1
+        for bit in range(8):
+            if i >= len(data):
+                break
+            if flags & (1 << bit):
+                out.append(data[i])
+                i += 1
+            else:
+                d = data[i] | ((data[i + 1] >> LENGTH_BITS) << 8)
+                length = (data[i + 1] & ((1 << LENGTH_BITS) - 1)) + MIN_MATCH
+                i += 2
+                for _ in range(length):
+                    out.append(out[-(d + 1)])
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="LZSS compress files for download to the board")
+    parser.add_argument("-d", "--decompress", action="store_true")
+    parser.add_argument("-o", "--output", help="write the (de)compressed data here")
+    parser.add_argument("files", nargs="+")
+    args = parser.parse_args()
+
+    total_in = 0
+    total_out = 0
+    for path in args.files:
+        with open(path, "rb") as f:
+            data = f.read()
+        result = decompress(data) if args.decompress else compress(data)
+        if not args.decompress and decompress(result) != data:
+            sys.exit("lzss: round trip failed for %s" % path)
+        if args.output:
+            with open(args.output, "wb") as f:
+                f.write(result)
+        print("%-32s %8d -> %8d  %5.1f%%" % (path, len(data), len(result), 100.0 * len(result) / max(1, len(data))))
+        total_in += len(data)
+        total_out += len(result)
+
+    if len(args.files) > 1:
+        print("%-32s %8d -> %8d  %5.1f%%" % ("total", total_in, total_out, 100.0 * total_out / max(1, total_in)))
+
+
+if __name__ == "__main__":
+    main()